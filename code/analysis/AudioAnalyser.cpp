@@ -2,48 +2,110 @@
 
 using namespace OUS;
 
-std::vector<size_t> AudioAnalyser::getOnsetPositions(juce::AudioBuffer<float> buffer, DetectionSettings settings)
+// Whole hops are given to aubio as they are, which needs its samples to be floats
+static_assert(std::is_same<smpl_t, float>::value, "aubio must be built with single precision samples");
+
+std::vector<size_t> AudioAnalyser::getOnsetPositions(juce::AudioBuffer<float> const& buffer, DetectionSettings const& settings)
 {
-    juce::ignoreUnused(buffer, settings);
+    OnsetDetector detector(settings);
 
-    fvec_t* vecIn = new_fvec(static_cast<uint_t>(settings.hopSize));
-    fvec_t* vecOut = new_fvec(2);
-    aubio_onset_t* onset = new_aubio_onset("default", static_cast<uint_t>(settings.windowSize), static_cast<uint_t>(settings.hopSize), static_cast<uint_t>(settings.sampleRate));
+    std::vector<size_t> onsetPositions = {};
+    detector.process(buffer.getReadPointer(0), buffer.getNumSamples(), onsetPositions);
+    detector.flush(onsetPositions);
+    return onsetPositions;
+}
 
-    aubio_onset_set_threshold(onset, settings.threshold);
+//==============================================================================
+OnsetDetector::OnsetDetector(AudioAnalyser::DetectionSettings const& settings)
+: mSettings(settings)
+{
+    mHop = new_fvec(static_cast<uint_t>(mSettings.hopSize));
+    mOutput = new_fvec(2);
+    reset();
+}
 
-    auto const numSamples = buffer.getNumSamples();
-    auto samplesRemaining = numSamples;
-    auto currentPosition = 0;
+OnsetDetector::~OnsetDetector()
+{
+    del_aubio_onset(mOnset);
+    del_fvec(mHop);
+    del_fvec(mOutput);
+}
 
-    std::vector<size_t> onsetPositions = {};
-    while(samplesRemaining > 0)
+void OnsetDetector::reset()
+{
+    // aubio's onset detection keeps its history (and its count of samples) to itself, so
+    // it's made again
+    if(mOnset != nullptr)
     {
-        auto const numThisTime = std::min(samplesRemaining, settings.hopSize);
-        for(int i = 0; i < numThisTime; ++i)
-        {
-            vecIn->data[i] = buffer.getSample(0, currentPosition + i);
-        }
+        del_aubio_onset(mOnset);
+    }
 
-        for(int i = numThisTime; i < settings.hopSize; ++i)
-        {
-            vecIn->data[i] = 0.0;
-        }
+    mOnset = new_aubio_onset("default", static_cast<uint_t>(mSettings.windowSize), static_cast<uint_t>(mSettings.hopSize), static_cast<uint_t>(mSettings.sampleRate));
+    jassert(mOnset != nullptr);
+    aubio_onset_set_threshold(mOnset, mSettings.threshold);
+
+    mNumInHop = 0;
+    mNumSamplesProcessed = 0;
+}
+
+void OnsetDetector::setThreshold(smpl_t threshold)
+{
+    mSettings.threshold = threshold;
+    aubio_onset_set_threshold(mOnset, threshold);
+}
+
+void OnsetDetector::process(float const* samples, int numSamples, std::vector<size_t>& onsets)
+{
+    auto const hopSize = mSettings.hopSize;
+    mNumSamplesProcessed += static_cast<size_t>(numSamples);
+
+    // Finish the hop the last call started
+    auto position = 0;
+    if(mNumInHop > 0)
+    {
+        auto const numToCopy = std::min(numSamples, hopSize - mNumInHop);
+        std::copy(samples, samples + numToCopy, mHop->data + mNumInHop);
+        mNumInHop += numToCopy;
+        position = numToCopy;
 
-        aubio_onset_do(onset, vecIn, vecOut);
-        if(vecOut->data[0] != 0)
+        if(mNumInHop < hopSize)
         {
-            // got some onset data!
-            onsetPositions.push_back(static_cast<size_t>(aubio_onset_get_last(onset)));
+            return;
         }
 
-        currentPosition += numThisTime;
-        samplesRemaining -= numThisTime;
+        analyse(*mHop, onsets);
+        mNumInHop = 0;
     }
 
-    del_aubio_onset(onset);
-    del_fvec(vecIn);
-    del_fvec(vecOut);
+    // Whole hops where they are (aubio only reads its input)
+    for(; position + hopSize <= numSamples; position += hopSize)
+    {
+        fvec_t const hop{static_cast<uint_t>(hopSize), const_cast<smpl_t*>(samples + position)};
+        analyse(hop, onsets);
+    }
 
-    return onsetPositions;
+    // Start the next
+    std::copy(samples + position, samples + numSamples, mHop->data);
+    mNumInHop = numSamples - position;
+}
+
+void OnsetDetector::flush(std::vector<size_t>& onsets)
+{
+    if(mNumInHop == 0)
+    {
+        return;
+    }
+
+    std::fill(mHop->data + mNumInHop, mHop->data + mSettings.hopSize, 0.0f);
+    analyse(*mHop, onsets);
+    mNumInHop = 0;
+}
+
+void OnsetDetector::analyse(fvec_t const& hop, std::vector<size_t>& onsets)
+{
+    aubio_onset_do(mOnset, &hop, mOutput);
+    if(mOutput->data[0] != 0)
+    {
+        onsets.push_back(static_cast<size_t>(aubio_onset_get_last(mOnset)));
+    }
 }
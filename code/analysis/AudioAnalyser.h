@@ -3,6 +3,8 @@
 #include "aubio.h"
 #include <JuceHeader.h>
 
+#include <vector>
+
 namespace OUS
 {
     class AudioAnalyser
@@ -16,8 +18,60 @@ namespace OUS
             smpl_t threshold = 0.3f;
         };
 
-        std::vector<size_t> static getOnsetPositions(juce::AudioBuffer<float> buffer, DetectionSettings settings);
+        /** The onsets in channel 0 of buffer (samples from its start), all in one go */
+        std::vector<size_t> static getOnsetPositions(juce::AudioBuffer<float> const& buffer, DetectionSettings const& settings);
 
     private:
     };
+
+    //==============================================================================
+    /*
+    OnsetDetector
+
+    aubio's onset detection, kept between calls so audio can be given to it as
+    it arrives (a block at a time, from a file being read, ...) and the same
+    detector reused rather than made again each time.
+
+    Samples are analysed a hop at a time. Whole hops are handed to aubio where
+    they are, in the caller's memory; only a hop split across calls is copied
+    (a block at a time) into one of its own, to be finished by the next call.
+    Onset positions are in samples from the first sample given (since reset()).
+
+    process() doesn't allocate if onsets has the room, so can run on the audio
+    thread. Making one, and reset(), do allocate.
+    */
+    class OnsetDetector
+    {
+    public:
+        explicit OnsetDetector(AudioAnalyser::DetectionSettings const& settings);
+        ~OnsetDetector();
+
+        /** Starts again from nothing, as if just made */
+        void reset();
+
+        void setThreshold(smpl_t threshold);
+
+        /** Analyses numSamples more, adding the onsets found to onsets */
+        void process(float const* samples, int numSamples, std::vector<size_t>& onsets);
+
+        /** At the end, analyses what's left of the last hop (padded with silence) */
+        void flush(std::vector<size_t>& onsets);
+
+        /** Samples given since reset() */
+        size_t getNumSamplesProcessed() const { return mNumSamplesProcessed; }
+
+    private:
+        void analyse(fvec_t const& hop, std::vector<size_t>& onsets);
+
+        AudioAnalyser::DetectionSettings mSettings;
+
+        aubio_onset_t* mOnset = nullptr;
+        fvec_t* mHop = nullptr; // a hop that's come in pieces
+        fvec_t* mOutput = nullptr;
+
+        int mNumInHop = 0;
+        size_t mNumSamplesProcessed = 0;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OnsetDetector)
+    };
 } // namespace OUS
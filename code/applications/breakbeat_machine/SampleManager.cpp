@@ -5,6 +5,11 @@ using namespace OUS;
 SampleManager::SampleManager(juce::AudioFormatManager& formatManager)
 : mFormatManager(formatManager)
 {
+    mStretchScheduler.onComplete = [this](StretchScheduler::Stretch stretch)
+    {
+        // The result stays in the scheduler's cache too, the buffers share it rather than copy it
+        onTimestretchComplete(std::move(stretch));
+    };
 }
 
 bool SampleManager::loadNewSample(juce::String const& filePath, juce::String& error)
@@ -30,6 +35,8 @@ bool SampleManager::loadNewSample(juce::String const& filePath, juce::String& er
             mActiveFileBuffer = newFileBuffer;
             mFileBuffers.add(mActiveFileBuffer);
 
+            mStretchScheduler.setSource(*mActiveFileBuffer->getForwardAudioSampleBuffer(), mSampleSampleRate);
+
             return true;
         }
         else
@@ -153,39 +160,25 @@ void SampleManager::performTimestretch(float stretchFactor, float pitchFactor, s
     }
 
     std::cout << "Performing stretch: factor " << stretchFactor << "x, pitch " << pitchFactor << "\n";
-    mStretchTask = std::make_unique<OfflineStretchProcessor>(mTempStretchedFile,
-                                                             *mActiveFileBuffer->getForwardAudioSampleBuffer(),
-                                                             stretchFactor, pitchFactor,
-                                                             mSampleSampleRate,
-                                                             [this]()
-                                                             {
-                                                                 onTimestretchComplete();
-                                                             });
-    mStretchTask->launchThread();
+    mStretchScheduler.request(stretchFactor, pitchFactor);
 }
 
-void SampleManager::onTimestretchComplete()
+void SampleManager::onTimestretchComplete(StretchScheduler::Stretch stretch)
 {
-    std::cout << "Stretch complete. Temp file: " << mTempStretchedFile.getFile().getFullPathName() << "\n";
-    std::unique_ptr<AudioFormatReader> reader{mFormatManager.createReaderFor(mTempStretchedFile.getFile())};
+    auto const numSamples = stretch->getResult().getNumSamples();
+    mBufferNumSamples = static_cast<size_t>(numSamples);
+    mBufferDuration = static_cast<double>(numSamples) / stretch->getSampleRate();
+    std::cout << "Stretch complete. New duration: " << mBufferDuration << "\n";
 
-    if(reader != nullptr)
-    {
-        // get length
-        mBufferNumSamples = static_cast<size_t>(reader->lengthInSamples);
-        mBufferDuration = static_cast<double>(reader->lengthInSamples) / reader->sampleRate;
-        std::cout << "New duration: " << mBufferDuration << "\n";
+    // TODO: clear existing?
+    ReferenceCountedForwardAndReverseBuffer::Ptr newActiveBuffer = new ReferenceCountedForwardAndReverseBuffer(mSampleFileName + "stretched", std::move(stretch));
+    jassert(newActiveBuffer != nullptr);
 
-        // TODO: clear existing?
-        ReferenceCountedForwardAndReverseBuffer::Ptr newActiveBuffer = new ReferenceCountedForwardAndReverseBuffer(mSampleFileName + "stretched", reader.get());
-        jassert(newActiveBuffer != nullptr);
+    mActiveBuffer = newActiveBuffer;
+    mBuffers.add(mActiveBuffer);
 
-        mActiveBuffer = newActiveBuffer;
-        mBuffers.add(mActiveBuffer);
-
-        if(mCallback != nullptr)
-        {
-            mCallback();
-        }
+    if(mCallback != nullptr)
+    {
+        mCallback();
     }
 }
@@ -1,7 +1,7 @@
 #pragma once
 
 #include "../../core/ReferenceCountedForwardAndReverseBuffer.h"
-#include "../../dsp/processors/OfflineStretcher.h"
+#include "../../dsp/processors/StretchScheduler.h"
 #include <JuceHeader.h>
 
 #define MAX_FILE_LENGTH 60.0 // seconds
@@ -48,13 +48,11 @@ namespace OUS
         void clearFreeBuffers();
 
         void performTimestretch(float stretchFactor, float pitchFactor = 1.0f, std::function<void()> callback = nullptr);
-        void onTimestretchComplete();
+        void onTimestretchComplete(StretchScheduler::Stretch stretch);
 
     private:
         juce::AudioFormatManager& mFormatManager;
 
-        juce::TemporaryFile mTempStretchedFile{".wav"};
-
         double mSampleDuration = 0.0;
         double mSampleSampleRate = 0.0;
         juce::String mSampleFileName = juce::String();
@@ -68,7 +66,8 @@ namespace OUS
         juce::ReferenceCountedArray<ReferenceCountedForwardAndReverseBuffer> mFileBuffers;
         ReferenceCountedForwardAndReverseBuffer::Ptr mActiveFileBuffer;
 
-        std::unique_ptr<OfflineStretchProcessor> mStretchTask = nullptr;
+        // Stretches run in the background, a new one cancels (or replaces) the last
+        StretchScheduler mStretchScheduler;
 
         std::function<void()> mCallback = nullptr;
     };
@@ -0,0 +1,104 @@
+#include "DelayLinePitchShifter.h"
+
+using namespace OUS;
+
+DelayLinePitchShifter::DelayLinePitchShifter(double sampleRate, size_t numChannels, double maxDelaySeconds)
+: mMaxDelay(minDelay + maxDelaySeconds * sampleRate)
+{
+    // A power of two, so the indices can wrap with a mask
+    auto const length = juce::nextPowerOfTwo(static_cast<int>(mMaxDelay) + numTaps + 1);
+    mLines.assign(numChannels, std::vector<float>(static_cast<size_t>(length), 0.0f));
+    mMask = length - 1;
+}
+
+void DelayLinePitchShifter::setDelay(double delaySamples, int rampSamples)
+{
+    mTargetDelay = std::clamp(minDelay + delaySamples, static_cast<double>(minDelay), mMaxDelay);
+    mRampRemaining = std::max(1, rampSamples);
+    mDelayStep = (mTargetDelay - mDelay) / mRampRemaining;
+}
+
+void DelayLinePitchShifter::jumpToDelay(double delaySamples)
+{
+    mDelay = mTargetDelay = std::clamp(minDelay + delaySamples, static_cast<double>(minDelay), mMaxDelay);
+    mRampRemaining = 0;
+}
+
+void DelayLinePitchShifter::reset()
+{
+    for(auto& line : mLines)
+    {
+        std::fill(line.begin(), line.end(), 0.0f);
+    }
+}
+
+void DelayLinePitchShifter::process(AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    auto const numChannels = std::min(static_cast<int>(mLines.size()), buffer.getNumChannels());
+    auto writeIndex = mWriteIndex;
+    auto delay = mDelay;
+    auto rampRemaining = mRampRemaining;
+
+    for(int ch = 0; ch < numChannels; ++ch)
+    {
+        auto& line = mLines[static_cast<size_t>(ch)];
+        auto* samples = buffer.getWritePointer(ch, startSample);
+
+        writeIndex = mWriteIndex;
+        delay = mDelay;
+        rampRemaining = mRampRemaining;
+
+        for(int i = 0; i < numSamples; ++i)
+        {
+            line[static_cast<size_t>(writeIndex)] = samples[i];
+
+            if(rampRemaining > 0)
+            {
+                delay = --rampRemaining == 0 ? mTargetDelay : delay + mDelayStep;
+            }
+
+            samples[i] = read(line.data(), mMask, writeIndex, delay);
+
+            writeIndex = (writeIndex + 1) & mMask;
+        }
+    }
+
+    mWriteIndex = writeIndex;
+    mDelay = delay;
+    mRampRemaining = rampRemaining;
+}
+
+float DelayLinePitchShifter::read(float const* line, int mask, int writeIndex, double delay)
+{
+    // The first of the taps either side of the read position (writeIndex - delay)
+    auto const position = static_cast<double>(writeIndex) - delay;
+    auto const whole = std::floor(position);
+    auto const index = static_cast<int>(whole) - (numTaps / 2 - 1);
+
+    // Lagrange weights for taps at 0..5, read at 2 + fraction
+    auto const t = static_cast<float>(numTaps / 2 - 1) + static_cast<float>(position - whole);
+
+    // Each weight is the product of (t - j) for every other tap j, which is the product of
+    // those before it and those after it
+    std::array<float, numTaps> before;
+    std::array<float, numTaps> after;
+    before[0] = 1.0f;
+    after[numTaps - 1] = 1.0f;
+    for(int k = 1; k < numTaps; ++k)
+    {
+        before[static_cast<size_t>(k)] = before[static_cast<size_t>(k - 1)] * (t - static_cast<float>(k - 1));
+        after[static_cast<size_t>(numTaps - 1 - k)] = after[static_cast<size_t>(numTaps - k)] * (t - static_cast<float>(numTaps - k));
+    }
+
+    // 1 / prod(k - j) for j != k
+    static constexpr std::array<float, numTaps> denominators = {-1.0f / 120.0f, 1.0f / 24.0f, -1.0f / 12.0f, 1.0f / 12.0f, -1.0f / 24.0f, 1.0f / 120.0f};
+
+    auto result = 0.0f;
+    for(int k = 0; k < numTaps; ++k)
+    {
+        auto const weight = denominators[static_cast<size_t>(k)] * before[static_cast<size_t>(k)] * after[static_cast<size_t>(k)];
+        result += weight * line[(index + k) & mask];
+    }
+
+    return result;
+}
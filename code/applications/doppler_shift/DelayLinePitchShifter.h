@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <array>
+#include <vector>
+
+namespace OUS
+{
+    /*
+    DelayLinePitchShifter
+
+    The low latency alternative to RubberbandPitchShifter, and physically what the
+    Doppler effect is: the sound reaches the observer after a delay (distance / speed
+    of sound), which changes as the source moves. Reading a delay line at a delay that
+    changes by s samples per sample plays it back at a pitch ratio of 1 - s.
+
+    The delay is ramped to each new value, and read between samples with 6 point
+    (5th order) Lagrange interpolation. It never goes below the 3 samples the
+    interpolation needs, which is all the latency there is. Everything above that is
+    the time the sound takes to travel, i.e. the effect.
+    */
+    class DelayLinePitchShifter
+    {
+    public:
+        static constexpr int numTaps = 6;
+        static constexpr int minDelay = numTaps / 2;
+
+        /** maxDelaySeconds is the furthest a source can be (in time) */
+        DelayLinePitchShifter(double sampleRate, size_t numChannels, double maxDelaySeconds);
+
+        /** The delay through it, in samples, when the source is as close as it gets */
+        size_t getLatency() const { return static_cast<size_t>(minDelay); }
+
+        /** Audio thread. Ramps the delay (on top of the latency) to delaySamples over the
+            next rampSamples samples, which is what shifts the pitch */
+        void setDelay(double delaySamples, int rampSamples);
+
+        /** Audio thread. Jumps straight to delaySamples (no pitch shift) */
+        void jumpToDelay(double delaySamples);
+
+        /** Audio thread. Empties the delay line */
+        void reset();
+
+        void process(AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+        /** Reads delay samples (at least minDelay) behind writeIndex in a line a power of two
+            long (mask is its length - 1) */
+        static float read(float const* line, int mask, int writeIndex, double delay);
+
+    private:
+
+        std::vector<std::vector<float>> mLines;
+        int mMask = 0;
+        int mWriteIndex = 0;
+
+        double mMaxDelay = 0.0;
+        double mDelay = minDelay;
+        double mTargetDelay = minDelay;
+        double mDelayStep = 0.0;
+        int mRampRemaining = 0;
+    };
+} // namespace OUS
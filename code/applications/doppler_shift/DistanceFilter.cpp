@@ -0,0 +1,81 @@
+#include "DistanceFilter.h"
+
+using namespace OUS;
+
+DistanceFilter::DistanceFilter(double sampleRate, size_t numChannels)
+: mSampleRate(sampleRate)
+, mStates(numChannels, 0.0f)
+{
+}
+
+void DistanceFilter::setDistance(float distance, float closestDistance, int rampSamples)
+{
+    mTargetGain = getGain(distance, closestDistance);
+    mRampRemaining = std::max(1, rampSamples);
+    mGainStep = (mTargetGain - mGain) / static_cast<float>(mRampRemaining);
+
+    // Changes slowly enough, compared to the gain, not to need ramping
+    mCoefficient = getCoefficient(distance, mSampleRate);
+}
+
+void DistanceFilter::jumpToDistance(float distance, float closestDistance)
+{
+    mGain = mTargetGain = getGain(distance, closestDistance);
+    mRampRemaining = 0;
+    mCoefficient = getCoefficient(distance, mSampleRate);
+}
+
+void DistanceFilter::reset()
+{
+    std::fill(mStates.begin(), mStates.end(), 0.0f);
+}
+
+void DistanceFilter::process(AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    auto const numChannels = std::min(static_cast<int>(mStates.size()), buffer.getNumChannels());
+    auto const feed = 1.0f - mCoefficient;
+    auto gain = mGain;
+    auto rampRemaining = mRampRemaining;
+
+    for(int ch = 0; ch < numChannels; ++ch)
+    {
+        auto* samples = buffer.getWritePointer(ch, startSample);
+        auto state = mStates[static_cast<size_t>(ch)];
+        gain = mGain;
+        rampRemaining = mRampRemaining;
+
+        for(int i = 0; i < numSamples; ++i)
+        {
+            if(rampRemaining > 0)
+            {
+                gain = --rampRemaining == 0 ? mTargetGain : gain + mGainStep;
+            }
+
+            state += feed * (samples[i] - state);
+            samples[i] = gain * state;
+        }
+
+        mStates[static_cast<size_t>(ch)] = state;
+    }
+
+    mGain = gain;
+    mRampRemaining = rampRemaining;
+}
+
+float DistanceFilter::getGain(float distance, float closestDistance)
+{
+    auto const closest = std::max(closestDistance, 1.0f);
+    return closest / std::max(distance, closest);
+}
+
+float DistanceFilter::getCoefficient(float distance, double sampleRate)
+{
+    // Not filtered at all when it's close enough for the cutoff to be out of range
+    auto const cutoff = 43850.0 / std::sqrt(std::max(distance, 1.0f));
+    if(cutoff >= 0.45 * sampleRate)
+    {
+        return 0.0f;
+    }
+
+    return static_cast<float>(std::exp(-juce::MathConstants<double>::twoPi * cutoff / sampleRate));
+}
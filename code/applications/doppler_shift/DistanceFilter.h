@@ -0,0 +1,55 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <vector>
+
+namespace OUS
+{
+    /*
+    DistanceFilter
+
+    What distance does to a sound on its way to the observer: it gets quieter
+    (inverse distance, relative to the closest the source gets, so it passes by
+    at unity gain) and duller, as the air absorbs high frequencies more.
+
+    Absorption goes up with the square of frequency (about 0.1dB per metre at
+    8kHz, at 20C / 50% humidity), which a one pole low pass approximates with
+    its cutoff where the loss is 3dB: 43.85kHz / sqrt(distance).
+    */
+    class DistanceFilter
+    {
+    public:
+        DistanceFilter(double sampleRate, size_t numChannels);
+
+        /** Audio thread. Ramps to the gain / absorption for distance (metres) over the next
+            rampSamples samples. closestDistance is where the gain is 1 */
+        void setDistance(float distance, float closestDistance, int rampSamples);
+
+        /** Audio thread. Jumps straight to the gain / absorption for distance */
+        void jumpToDistance(float distance, float closestDistance);
+
+        /** Audio thread. Clears the filter */
+        void reset();
+
+        void process(AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+        /** The gain at distance, 1 at closestDistance (or closer) */
+        static float getGain(float distance, float closestDistance);
+
+        /** The low pass coefficient for the absorption at distance */
+        static float getCoefficient(float distance, double sampleRate);
+
+    private:
+        double const mSampleRate;
+        std::vector<float> mStates;
+
+        float mGain = 1.0f;
+        float mTargetGain = 1.0f;
+        float mGainStep = 0.0f;
+        int mRampRemaining = 0;
+
+        // One pole low pass, y += (1 - coefficient) * (x - y)
+        float mCoefficient = 0.0f;
+    };
+} // namespace OUS
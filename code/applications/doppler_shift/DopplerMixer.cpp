@@ -0,0 +1,297 @@
+#include "DopplerMixer.h"
+#include "DelayLinePitchShifter.h"
+#include "DistanceFilter.h"
+
+using namespace OUS;
+
+namespace
+{
+    // How much quieter the far ear is (binaural), compared to panning
+    float constexpr headShadow = 0.5f;
+} // namespace
+
+DopplerMixer::DopplerMixer(double sampleRate, Output output, double maxDelaySeconds)
+: mSampleRate(sampleRate)
+, mOutput(output)
+, mMaxDelay(DelayLinePitchShifter::minDelay + (maxDelaySeconds + earSpacing / DopplerSource::speedOfSound) * sampleRate)
+{
+    setMaxLatency(0);
+}
+
+std::unique_ptr<DopplerMixer> DopplerMixer::fromJson(juce::var const& scene, double sampleRate, double maxDelaySeconds, juce::String& error)
+{
+    auto const outputName = scene["output"].toString();
+    if(outputName.isNotEmpty() && outputName != "stereo" && outputName != "binaural")
+    {
+        error = "Unknown output \"" + outputName + "\" (stereo or binaural)";
+        return nullptr;
+    }
+
+    auto const toPoint = [](juce::var const& point, juce::Point<float>& result)
+    {
+        auto const* coordinates = point.getArray();
+        if(coordinates == nullptr || coordinates->size() != 2)
+        {
+            return false;
+        }
+
+        result = {static_cast<float>((*coordinates)[0]), static_cast<float>((*coordinates)[1])};
+        return true;
+    };
+
+    auto mixer = std::make_unique<DopplerMixer>(sampleRate, outputName == "binaural" ? Output::Binaural : Output::Stereo, maxDelaySeconds);
+    if(!scene["observer"].isVoid() && !toPoint(scene["observer"], mixer->mObserver))
+    {
+        error = "The observer should be [x, y]";
+        return nullptr;
+    }
+
+    auto const* sources = scene["sources"].getArray();
+    if(sources == nullptr)
+    {
+        error = "There are no sources";
+        return nullptr;
+    }
+
+    for(int i = 0; i < sources->size(); ++i)
+    {
+        auto const& source = sources->getReference(i);
+        auto const* path = source["path"].getArray();
+
+        std::vector<juce::Point<float>> points;
+        for(int p = 0; path != nullptr && p < path->size(); ++p)
+        {
+            juce::Point<float> point;
+            if(!toPoint(path->getReference(p), point))
+            {
+                error = "Source " + juce::String(i + 1) + "'s path should be a list of [x, y]";
+                return nullptr;
+            }
+
+            points.push_back(point);
+        }
+
+        if(points.size() < 2)
+        {
+            error = "Source " + juce::String(i + 1) + " needs a path of at least two points";
+            return nullptr;
+        }
+
+        auto const loop = static_cast<bool>(source.getProperty("loop", false));
+        auto const speed = static_cast<float>(source.getProperty("speed", 10.0));
+        auto const start = static_cast<float>(source.getProperty("start", 0.0));
+        mixer->addSource({std::move(points), loop, start}, speed);
+    }
+
+    return mixer;
+}
+
+int DopplerMixer::addSource(DopplerSource source, float speed)
+{
+    mVoices.push_back({std::move(source), speed, std::vector<float>(static_cast<size_t>(mLength), 0.0f)});
+    update(mVoices.back(), 0, true);
+    return static_cast<int>(mVoices.size()) - 1;
+}
+
+size_t DopplerMixer::getLatency() const
+{
+    // The delay to the ears is measured from just in front of the closer one
+    auto const ears = mOutput == Output::Binaural ? juce::roundToInt(0.5f * earSpacing / DopplerSource::speedOfSound * mSampleRate) : 0;
+    return static_cast<size_t>(DelayLinePitchShifter::minDelay + ears);
+}
+
+void DopplerMixer::setMaxLatency(size_t maxLatency)
+{
+    mMaxOffset = std::max(0, static_cast<int>(maxLatency) - static_cast<int>(getLatency()));
+    mOffset = std::min(mOffset, mMaxOffset);
+
+    // A power of two, so the indices can wrap with a mask
+    mLength = juce::nextPowerOfTwo(static_cast<int>(mMaxDelay) + mMaxOffset + DelayLinePitchShifter::numTaps + 1);
+    mMask = mLength - 1;
+    mWriteIndex = 0;
+
+    for(auto& voice : mVoices)
+    {
+        voice.line.assign(static_cast<size_t>(mLength), 0.0f);
+    }
+}
+
+void DopplerMixer::setLatency(size_t latency)
+{
+    auto const offset = std::clamp(static_cast<int>(latency) - static_cast<int>(getLatency()), 0, mMaxOffset);
+    if(offset == mOffset)
+    {
+        return;
+    }
+
+    // The reads jump back (or forward) through what's already in the lines, rather than
+    // ramp there and sweep the pitch
+    mOffset = offset;
+    for(auto& voice : mVoices)
+    {
+        update(voice, 0, true);
+    }
+}
+
+void DopplerMixer::setObserver(juce::Point<float> position)
+{
+    mObserver = position;
+}
+
+void DopplerMixer::setTime(double seconds)
+{
+    for(auto& voice : mVoices)
+    {
+        voice.source.setTime(seconds, voice.speed);
+    }
+}
+
+void DopplerMixer::process(float const* const* inputs, int numInputs, AudioBuffer<float>& output, int startSample, int numSamples)
+{
+    jassert(output.getNumChannels() >= 2);
+    auto* left = output.getWritePointer(0, startSample);
+    auto* right = output.getWritePointer(1, startSample);
+
+    for(int offset = 0; offset < numSamples; offset += controlBlockSize)
+    {
+        auto const blockSize = std::min(controlBlockSize, numSamples - offset);
+        for(size_t v = 0; v < mVoices.size(); ++v)
+        {
+            auto& voice = mVoices[v];
+            auto const* input = static_cast<int>(v) < numInputs && inputs[v] != nullptr ? inputs[v] + startSample + offset : nullptr;
+
+            voice.source.advance(blockSize / mSampleRate, voice.speed);
+            update(voice, blockSize, false);
+
+            if(mOutput == Output::Binaural)
+            {
+                processBinaural(voice, input, left + offset, right + offset, blockSize);
+            }
+            else
+            {
+                processStereo(voice, input, left + offset, right + offset, blockSize);
+            }
+        }
+
+        mWriteIndex = (mWriteIndex + blockSize) & mMask;
+    }
+}
+
+void DopplerMixer::update(Voice& voice, int numSamples, bool jump)
+{
+    auto const binaural = mOutput == Output::Binaural;
+    auto const numEars = binaural ? 2 : 1;
+    auto const halfSpacing = binaural ? 0.5f * earSpacing : 0.0f;
+
+    // The delays are past the least the sound can take to get to the observer (less half the
+    // head, so neither ear's is ever less than the least the delay line can do)
+    if(voice.closestTo != mObserver)
+    {
+        voice.closest = voice.source.getClosestDistance(mObserver);
+        voice.closestTo = mObserver;
+    }
+
+    auto const closest = voice.closest;
+    auto const offset = (closest - halfSpacing) / DopplerSource::speedOfSound;
+
+    // Which way the source is, -1 (left) to 1 (right)
+    auto const relative = voice.source.getPosition() - mObserver;
+    auto const distance = relative.getDistanceFromOrigin();
+    auto const side = distance > 0.0f ? relative.getX() / distance : 0.0f;
+
+    for(int e = 0; e < numEars; ++e)
+    {
+        auto const ear = mObserver + juce::Point<float>(e == 0 ? -halfSpacing : halfSpacing, 0.0f);
+        auto const earDistance = voice.source.getDistance(ear);
+        auto const delay = mOffset + std::clamp(DelayLinePitchShifter::minDelay + (voice.source.getTravelSeconds(voice.speed, ear) - offset) * mSampleRate, static_cast<double>(DelayLinePitchShifter::minDelay), mMaxDelay);
+
+        auto& state = voice.ears[static_cast<size_t>(e)];
+        state.delayStep = jump ? 0.0 : (delay - state.delay) / numSamples;
+        state.delay = jump ? delay : state.delay;
+        state.coefficient = DistanceFilter::getCoefficient(earDistance, mSampleRate);
+    }
+
+    // Constant power pan, narrower binaurally (where it's the head shadow, the ears' delays
+    // do the rest)
+    auto const angle = (1.0f + (binaural ? headShadow : 1.0f) * side) * juce::MathConstants<float>::pi / 4.0f;
+    auto const gain = DistanceFilter::getGain(distance, closest);
+    std::array<float, 2> const gains = {gain * std::cos(angle), gain * std::sin(angle)};
+
+    for(size_t ch = 0; ch < gains.size(); ++ch)
+    {
+        voice.gainSteps[ch] = jump ? 0.0f : (gains[ch] - voice.gains[ch]) / static_cast<float>(numSamples);
+        voice.gains[ch] = jump ? gains[ch] : voice.gains[ch];
+    }
+}
+
+void DopplerMixer::processStereo(Voice& voice, float const* input, float* left, float* right, int numSamples)
+{
+    auto* line = voice.line.data();
+    auto& ear = voice.ears[0];
+    auto const feed = 1.0f - ear.coefficient;
+
+    auto writeIndex = mWriteIndex;
+    auto delay = ear.delay;
+    auto state = ear.state;
+    auto leftGain = voice.gains[0];
+    auto rightGain = voice.gains[1];
+
+    for(int i = 0; i < numSamples; ++i)
+    {
+        line[writeIndex] = input != nullptr ? input[i] : 0.0f;
+
+        delay += ear.delayStep;
+        state += feed * (DelayLinePitchShifter::read(line, mMask, writeIndex, delay) - state);
+
+        leftGain += voice.gainSteps[0];
+        rightGain += voice.gainSteps[1];
+        left[i] += leftGain * state;
+        right[i] += rightGain * state;
+
+        writeIndex = (writeIndex + 1) & mMask;
+    }
+
+    ear.delay = delay;
+    ear.state = state;
+    voice.gains = {leftGain, rightGain};
+}
+
+void DopplerMixer::processBinaural(Voice& voice, float const* input, float* left, float* right, int numSamples)
+{
+    auto* line = voice.line.data();
+    auto& leftEar = voice.ears[0];
+    auto& rightEar = voice.ears[1];
+    auto const leftFeed = 1.0f - leftEar.coefficient;
+    auto const rightFeed = 1.0f - rightEar.coefficient;
+
+    auto writeIndex = mWriteIndex;
+    auto leftDelay = leftEar.delay;
+    auto rightDelay = rightEar.delay;
+    auto leftState = leftEar.state;
+    auto rightState = rightEar.state;
+    auto leftGain = voice.gains[0];
+    auto rightGain = voice.gains[1];
+
+    for(int i = 0; i < numSamples; ++i)
+    {
+        line[writeIndex] = input != nullptr ? input[i] : 0.0f;
+
+        leftDelay += leftEar.delayStep;
+        rightDelay += rightEar.delayStep;
+        leftState += leftFeed * (DelayLinePitchShifter::read(line, mMask, writeIndex, leftDelay) - leftState);
+        rightState += rightFeed * (DelayLinePitchShifter::read(line, mMask, writeIndex, rightDelay) - rightState);
+
+        leftGain += voice.gainSteps[0];
+        rightGain += voice.gainSteps[1];
+        left[i] += leftGain * leftState;
+        right[i] += rightGain * rightState;
+
+        writeIndex = (writeIndex + 1) & mMask;
+    }
+
+    leftEar.delay = leftDelay;
+    rightEar.delay = rightDelay;
+    leftEar.state = leftState;
+    rightEar.state = rightState;
+    voice.gains = {leftGain, rightGain};
+}
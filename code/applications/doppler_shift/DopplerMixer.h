@@ -0,0 +1,139 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "DopplerSource.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace OUS
+{
+    /*
+    DopplerMixer
+
+    Any number of sources, each moving along its own path, heard by one observer
+    and mixed to stereo. The observer faces -y (up the screen, with the default path
+    in front of them).
+
+    A source only costs a write to its (mono) delay line, a read from it and a gain /
+    one pole low pass per ear: the read is delayed by the time the sound takes to
+    arrive (which is what shifts the pitch, see DelayLinePitchShifter), the gain and
+    low pass are the distance attenuation and air absorption (see DistanceFilter).
+    Stereo reads once, panned by where the source is. Binaural reads once per ear, at
+    each ear's own delay (so the sound arrives at one ear before the other) and with
+    some head shadow, but no HRTF.
+
+    When it's mixed with something later than itself (another engine's output)
+    every read is delayed by the difference, see setLatency.
+
+    The kinematics are worked out every controlBlockSize samples. Nothing is
+    allocated once the sources have been added.
+
+    A scene (for the plugin or the renderer) is JSON:
+
+        {
+            "output": "stereo" or "binaural",
+            "observer": [x, y],
+            "sources": [
+                {"path": [[x, y], [x, y], ...], "loop": false, "speed": 20, "start": 0, "input": "file.wav"},
+                ...
+            ]
+        }
+
+    where start is how far along its path a source starts. The mixer doesn't use input,
+    it's for the renderer.
+    */
+    class DopplerMixer
+    {
+    public:
+        enum class Output
+        {
+            Stereo,
+            Binaural
+        };
+
+        static constexpr int controlBlockSize = 32;
+        static constexpr float earSpacing = 0.175f;
+
+        DopplerMixer(double sampleRate, Output output, double maxDelaySeconds);
+
+        /** Parses a scene, returns nullptr (setting error) if it's not one */
+        static std::unique_ptr<DopplerMixer> fromJson(juce::var const& scene, double sampleRate, double maxDelaySeconds, juce::String& error);
+
+        /** Not while processing. Returns the source's index */
+        int addSource(DopplerSource source, float speed);
+        int getNumSources() const { return static_cast<int>(mVoices.size()); }
+        DopplerSource const& getSource(int index) const { return mVoices[static_cast<size_t>(index)].source; }
+
+        Output getOutput() const { return mOutput; }
+
+        /** The delay through it, in samples, when a source is as close as it gets */
+        size_t getLatency() const;
+
+        /** Not while processing. Makes room for setLatency to line the mix up with as much as
+            maxLatency samples of latency elsewhere */
+        void setMaxLatency(size_t maxLatency);
+
+        /** Audio thread. Delays everything so it comes out latency samples late, to line up
+            with what it's mixed with (not less than getLatency(), nor more than the max) */
+        void setLatency(size_t latency);
+
+        /** Audio thread. Where the observer is from now on */
+        void setObserver(juce::Point<float> position);
+        juce::Point<float> getObserver() const { return mObserver; }
+
+        /** Audio thread. Puts the sources where they'd be seconds after they started */
+        void setTime(double seconds);
+
+        /** Audio thread. Adds what the observer hears to the first two channels of output.
+            inputs[i] is source i's (mono) input, sources past numInputs (or nullptr) are silent */
+        void process(float const* const* inputs, int numInputs, AudioBuffer<float>& output, int startSample, int numSamples);
+
+    private:
+        struct Ear
+        {
+            double delay = 0.0;
+            double delayStep = 0.0;
+            float coefficient = 0.0f;
+            float state = 0.0f;
+        };
+
+        struct Voice
+        {
+            DopplerSource source;
+            float speed = 0.0f;
+            std::vector<float> line;
+
+            // The closest the source gets to the observer, for closestTo
+            float closest = 0.0f;
+            juce::Point<float> closestTo{std::numeric_limits<float>::max(), 0.0f};
+
+            // Stereo only uses the first ear, and pans it to both channels
+            std::array<Ear, 2> ears;
+
+            // Left / right, distance attenuation and pan
+            std::array<float, 2> gains{};
+            std::array<float, 2> gainSteps{};
+        };
+
+        /** Works out where each ear should be by the end of the next numSamples samples */
+        void update(Voice& voice, int numSamples, bool jump);
+
+        void processStereo(Voice& voice, float const* input, float* left, float* right, int numSamples);
+        void processBinaural(Voice& voice, float const* input, float* left, float* right, int numSamples);
+
+        double const mSampleRate;
+        Output const mOutput;
+        double const mMaxDelay;
+
+        std::vector<Voice> mVoices;
+        int mMaxOffset = 0; // samples
+        int mOffset = 0; // added to every read, to line up with what it's mixed with
+        int mLength = 0;
+        int mMask = 0;
+        int mWriteIndex = 0;
+
+        juce::Point<float> mObserver;
+    };
+} // namespace OUS
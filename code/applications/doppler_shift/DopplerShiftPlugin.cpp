@@ -3,20 +3,72 @@
 using namespace OUS;
 
 DopplerShiftProcessor::DopplerShiftProcessor()
-: AudioProcessor(BusesProperties().withInput("Input", AudioChannelSet::stereo()).withOutput("Output", AudioChannelSet::stereo()))
+: AudioProcessor(createBuses())
 , mState(*this,
          nullptr,
          "state",
          {std::make_unique<AudioParameterFloat>("sourceSpeed", "SourceSpeed", NormalisableRange<float>(0.0f, 344.0f), 10.0f),
-          std::make_unique<AudioParameterFloat>("observerY", "ObserverY", NormalisableRange<float>(0.0f, 100.0f), 30.0f)})
+          std::make_unique<AudioParameterFloat>("observerY", "ObserverY", NormalisableRange<float>(0.0f, 100.0f), 30.0f),
+          std::make_unique<AudioParameterChoice>("engine", "Engine", StringArray{"Delay Line", "RubberBand"}, Engine::DelayLine)})
 {
-    startTimerHz(30);
+    juce::String error;
+    setScene(createDefaultScene(), error);
+    startTimerHz(timerHz);
+}
+
+DopplerShiftProcessor::BusesProperties DopplerShiftProcessor::createBuses()
+{
+    auto buses = BusesProperties().withInput("Input", AudioChannelSet::stereo()).withOutput("Output", AudioChannelSet::stereo());
+    for(int source = 2; source <= maxSources; ++source)
+    {
+        buses = buses.withInput("Source " + juce::String(source), AudioChannelSet::mono(), false);
+    }
+
+    return buses;
+}
+
+juce::String DopplerShiftProcessor::createDefaultScene()
+{
+    // Source 1's path, with the others following it round at even spacing
+    juce::Array<juce::var> sources;
+    for(int source = 1; source < maxSources; ++source)
+    {
+        auto* properties = new juce::DynamicObject();
+        properties->setProperty("path", juce::Array<juce::var>{juce::Array<juce::var>{-pathHalfWidth, 0.0f}, juce::Array<juce::var>{pathHalfWidth, 0.0f}});
+        properties->setProperty("speed", 10.0f);
+        properties->setProperty("start", std::fmod(sourceStartX + pathHalfWidth + source * 4.0f * pathHalfWidth / maxSources, 2.0f * pathHalfWidth));
+        sources.add(juce::var(properties));
+    }
+
+    auto* scene = new juce::DynamicObject();
+    scene->setProperty("output", "stereo");
+    scene->setProperty("sources", sources);
+    return juce::JSON::toString(juce::var(scene));
 }
 
 //==============================================================================
 void DopplerShiftProcessor::prepareToPlay(double sampleRate, int samplesPerBlockExpected)
 {
+    mSampleRate = sampleRate;
+
+    mSourceSpeed.reset(sampleRate, parameterRampSeconds);
+    mSourceSpeed.setCurrentAndTargetValue(*mState.getRawParameterValue("sourceSpeed"));
+    mObserverY.reset(sampleRate, parameterRampSeconds);
+    mObserverY.setCurrentAndTargetValue(*mState.getRawParameterValue("observerY"));
+    mNextHostTime = -1;
+
     mPitchShifter = std::make_unique<RubberbandPitchShifter>(sampleRate, 2, samplesPerBlockExpected);
+    mDelayLine = std::make_unique<DelayLinePitchShifter>(sampleRate, 2, maxDelaySeconds);
+    mDistanceFilter = std::make_unique<DistanceFilter>(sampleRate, 2);
+    auto const observer = juce::Point<float>(0.0f, mObserverY.getCurrentValue());
+    mDistanceFilter->jumpToDistance(mSource.getDistance(observer), mSource.getClosestDistance(observer));
+
+    mSceneInputs.setSize(maxSources - 1, samplesPerBlockExpected);
+    juce::String error;
+    setScene(mScene, error);
+
+    mEngine = -1;
+    setEngine(static_cast<int>(*mState.getRawParameterValue("engine")));
 }
 
 void DopplerShiftProcessor::releaseResources()
@@ -25,17 +77,180 @@ void DopplerShiftProcessor::releaseResources()
 
 void DopplerShiftProcessor::processBlock(AudioBuffer<float>& buffer, MidiBuffer& midiBuffer)
 {
-    mPitchShifter->setPitchRatio(mFrequencyRatio);
-    mPitchShifter->process(buffer, buffer.getNumSamples());
+    juce::ScopedNoDenormals noDenormals;
+
+    // Source 1 is heard through the main bus, the rest of the buffer is the scene's inputs
+    auto const numSamples = buffer.getNumSamples();
+    auto const numSceneInputs = gatherSceneInputs(buffer);
+    auto mainBus = getBusBuffer(buffer, false, 0);
+
+    mSourceSpeed.setTargetValue(*mState.getRawParameterValue("sourceSpeed"));
+    mObserverY.setTargetValue(*mState.getRawParameterValue("observerY"));
+    followHost(numSamples);
+
+    auto const engine = static_cast<int>(*mState.getRawParameterValue("engine"));
+    if(engine != mEngine)
+    {
+        setEngine(engine);
+    }
+
+    updateLatency();
+
+    // The delay (and so the pitch), gain and absorption ramp from where the source was at
+    // the start of each control block to where it is at the end
+    auto speed = mSourceSpeed.getCurrentValue();
+    auto observer = juce::Point<float>(0.0f, mObserverY.getCurrentValue());
+    for(int start = 0; start < numSamples; start += controlBlockSize)
+    {
+        auto const blockSize = std::min(controlBlockSize, numSamples - start);
+        speed = mSourceSpeed.skip(blockSize);
+        observer.setY(mObserverY.skip(blockSize));
+        mSource.advance(blockSize / mSampleRate, speed);
+
+        mDistanceFilter->setDistance(mSource.getDistance(observer), mSource.getClosestDistance(observer), blockSize);
+        mDistanceFilter->process(mainBus, start, blockSize);
+
+        if(mEngine == Engine::DelayLine)
+        {
+            mDelayLine->setDelay(mSource.getDelaySeconds(speed, observer) * mSampleRate + mMainDelay, blockSize);
+            mDelayLine->process(mainBus, start, blockSize);
+        }
+    }
+
+    if(mEngine == Engine::RubberBand)
+    {
+        // It ramps the ratio itself, so it's given it once a block
+        mPitchShifter->rampPitchRatio(mSource.getFrequencyRatio(speed, observer));
+        mPitchShifter->process(mainBus, static_cast<size_t>(numSamples));
+    }
+
+    // The rest of the sources, added to source 1's output (so they're never pitch shifted twice),
+    // as late as it is. The mixer ramps to the observer's position itself
+    juce::SpinLock::ScopedTryLockType lock(mMixerLock);
+    if(lock.isLocked() && mMixer != nullptr && mainBus.getNumChannels() >= 2)
+    {
+        mMixer->setLatency(static_cast<size_t>(getLatencySamples()));
+        mMixer->setObserver(observer);
+        mMixer->process(mSceneInputPointers.data(), numSceneInputs, mainBus, 0, numSamples);
+    }
+
+    mSourceX = mSource.getPosition().getX();
+}
+
+int DopplerShiftProcessor::gatherSceneInputs(AudioBuffer<float>& buffer)
+{
+    auto const numSamples = buffer.getNumSamples();
+    if(numSamples > mSceneInputs.getNumSamples())
+    {
+        // Only if the host goes over the block size it said it would use
+        mSceneInputs.setSize(mSceneInputs.getNumChannels(), numSamples, false, false, true);
+    }
+
+    auto const numInputs = std::min(getBusCount(true), maxSources) - 1;
+    for(int source = 0; source < numInputs; ++source)
+    {
+        auto const input = getBusBuffer(buffer, true, source + 1);
+        auto const numChannels = input.getNumChannels();
+        if(numChannels == 0)
+        {
+            mSceneInputPointers[static_cast<size_t>(source)] = nullptr;
+            continue;
+        }
+
+        auto* mono = mSceneInputs.getWritePointer(source);
+        juce::FloatVectorOperations::copyWithMultiply(mono, input.getReadPointer(0), 1.0f / numChannels, numSamples);
+        for(int ch = 1; ch < numChannels; ++ch)
+        {
+            juce::FloatVectorOperations::addWithMultiply(mono, input.getReadPointer(ch), 1.0f / numChannels, numSamples);
+        }
+
+        mSceneInputPointers[static_cast<size_t>(source)] = mono;
+    }
+
+    return numInputs;
+}
+
+void DopplerShiftProcessor::setEngine(int engine)
+{
+    mEngine = engine;
+    updateLatency();
+
+    auto const observer = juce::Point<float>(0.0f, mObserverY.getCurrentValue());
+    if(mEngine == Engine::RubberBand)
+    {
+        mPitchShifter->reset(mSource.getFrequencyRatio(mSourceSpeed.getCurrentValue(), observer));
+        return;
+    }
+
+    mDelayLine->reset();
+    mDelayLine->jumpToDelay(mSource.getDelaySeconds(mSourceSpeed.getCurrentValue(), observer) * mSampleRate + mMainDelay);
+}
+
+void DopplerShiftProcessor::updateLatency()
+{
+    // RubberBand is always later than the scene, the delay line (a few samples) isn't when
+    // the scene's binaural, so then source 1 waits for it
+    auto const engineLatency = static_cast<int>(mEngine == Engine::RubberBand ? mPitchShifter->getLatency() : mDelayLine->getLatency());
+    auto const latency = std::max(engineLatency, mSceneLatency.load());
+    mMainDelay = latency - engineLatency;
+
+    if(latency != getLatencySamples())
+    {
+        setLatencySamples(latency);
+    }
+}
+
+void DopplerShiftProcessor::followHost(int numSamples)
+{
+    auto* playHead = getPlayHead();
+    if(playHead == nullptr)
+    {
+        return;
+    }
+
+    auto const position = playHead->getPosition();
+    if(!position.hasValue() || !position->getIsPlaying())
+    {
+        mNextHostTime = -1;
+        return;
+    }
+
+    auto const time = position->getTimeInSamples();
+    if(!time.hasValue())
+    {
+        return;
+    }
+
+    // The source moves on by itself from block to block, it only needs putting back on
+    // course when the transport jumps
+    if(*time != mNextHostTime)
+    {
+        auto const seconds = static_cast<double>(*time) / mSampleRate;
+        mSource.setTime(seconds, mSourceSpeed.getTargetValue());
+
+        juce::SpinLock::ScopedTryLockType lock(mMixerLock);
+        if(lock.isLocked() && mMixer != nullptr)
+        {
+            mMixer->setTime(seconds);
+        }
+    }
+
+    mNextHostTime = *time + numSamples;
 }
 
 //==============================================================================
 AudioProcessorEditor* DopplerShiftProcessor::createEditor()
 {
     auto* editor = new DopplerShiftPluginEditor(*this, mState);
-    // TODO: Not sure this is such a good idea - but is needed to initialise positions correctly
-    editor->setSourcePosition(mSourcePosition);
-    editor->setObserverPosition({0.0f, *mState.getRawParameterValue("observerY")});
+    editor->onLoadScene = [this](juce::File const& file)
+    {
+        juce::String error;
+        if(!loadScene(file, error))
+        {
+            juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Couldn't load " + file.getFileName(), error);
+        }
+    };
+
     return editor;
 }
 bool DopplerShiftProcessor::hasEditor() const
@@ -91,12 +306,27 @@ void DopplerShiftProcessor::changeProgramName(int, const String&)
 //==============================================================================
 void DopplerShiftProcessor::getStateInformation(MemoryBlock& destData)
 {
-    // MemoryOutputStream (destData, true).writeFloat (*mSourceFrequency);
+    auto state = mState.copyState();
+    state.setProperty("scene", mScene, nullptr);
+    if(auto const xml = state.createXml())
+    {
+        copyXmlToBinary(*xml, destData);
+    }
 }
 
 void DopplerShiftProcessor::setStateInformation(const void* data, int sizeInBytes)
 {
-    // mSourceFrequency->setValueNotifyingHost (MemoryInputStream (data, static_cast<size_t> (sizeInBytes), false).readFloat());
+    auto const xml = getXmlFromBinary(data, sizeInBytes);
+    if(xml == nullptr || !xml->hasTagName(mState.state.getType()))
+    {
+        return;
+    }
+
+    auto state = juce::ValueTree::fromXml(*xml);
+    juce::String error;
+    setScene(state.getProperty("scene", createDefaultScene()).toString(), error);
+    state.removeProperty("scene", nullptr);
+    mState.replaceState(state);
 }
 
 //==============================================================================
@@ -105,60 +335,94 @@ bool DopplerShiftProcessor::isBusesLayoutSupported(const BusesLayout& layouts) c
     const auto& mainInLayout = layouts.getChannelSet(true, 0);
     const auto& mainOutLayout = layouts.getChannelSet(false, 0);
 
-    return (mainInLayout == mainOutLayout && (!mainInLayout.isDisabled()));
+    if(mainInLayout != mainOutLayout || mainInLayout.isDisabled())
+    {
+        return false;
+    }
+
+    for(int bus = 1; bus < layouts.inputBuses.size(); ++bus)
+    {
+        auto const& source = layouts.inputBuses.getReference(bus);
+        if(!source.isDisabled() && source != AudioChannelSet::mono() && source != AudioChannelSet::stereo())
+        {
+            return false;
+        }
+    }
+
+    return true;
 }
 
-void DopplerShiftProcessor::timerCallback()
+//==============================================================================
+bool DopplerShiftProcessor::loadScene(juce::File const& file, juce::String& error)
 {
-    auto* editor = dynamic_cast<DopplerShiftPluginEditor*>(getActiveEditor());
-    if(!editor)
+    if(!file.existsAsFile())
     {
-        return;
+        error = file.getFullPathName() + " doesn't exist";
+        return false;
     }
 
-    auto const drawingViewHalfWidth = editor->getDrawingViewWidth() / 2.0f;
-
-    auto const timerInterval = getTimerInterval();
-    float constexpr speedOfSound = 344.0f / 1000.0f;
+    return setScene(file.loadFileAsString(), error);
+}
 
-    const auto srcSpeed = *mState.getRawParameterValue("sourceSpeed") / 1000.0f;
-    const auto observerYPos = *mState.getRawParameterValue("observerY") / 1.0f;
-    const auto srcVelocity = srcSpeed * mSourceDirection;
+bool DopplerShiftProcessor::setScene(juce::String const& json, juce::String& error)
+{
+    juce::var scene;
+    auto const result = juce::JSON::parse(json, scene);
+    if(result.failed())
+    {
+        error = result.getErrorMessage();
+        return false;
+    }
 
-    auto const prevSourceXPosition = mSourcePosition.getX();
-    auto const prevFreqValue = mFrequencyRatio;
-    auto const newSourceXPositon = mSourcePosition.getX() + timerInterval * srcVelocity;
-    if(newSourceXPositon >= drawingViewHalfWidth || newSourceXPositon <= -drawingViewHalfWidth)
+    // Built here, so the audio thread only has to swap it in (at whatever rate it's playing
+    // at, or a guess until then)
+    auto const sampleRate = getSampleRate() > 0.0 ? getSampleRate() : 44100.0;
+    auto mixer = DopplerMixer::fromJson(scene, sampleRate, maxDelaySeconds, error);
+    if(mixer == nullptr)
     {
-        mSourceDirection *= -1;
+        return false;
     }
 
-    mSourcePosition = {std::clamp(newSourceXPositon, -drawingViewHalfWidth, drawingViewHalfWidth), mSourcePosition.getY()};
+    // The plugin's observer is where the observerY parameter puts them
+    mixer->setObserver({0.0f, mState.getRawParameterValue("observerY")->load()});
+
+    // Room to line up with the latest engine (the engines are made before the scene, in
+    // prepareToPlay, which builds it again)
+    if(mPitchShifter != nullptr)
+    {
+        mixer->setMaxLatency(std::max(mPitchShifter->getLatency(), mDelayLine->getLatency()));
+    }
 
-    // work out angle based on source distance
-    float angleRelativeToObserver = std::atan2(observerYPos, std::abs(mSourcePosition.getX()));
-    if(mSourcePosition.getX() > 0.0f)
+    mScene = json;
     {
-        angleRelativeToObserver -= MathConstants<float>::pi - angleRelativeToObserver;
+        juce::SpinLock::ScopedLockType lock(mMixerLock);
+        std::swap(mMixer, mixer);
+        mSceneLatency = static_cast<int>(mMixer->getLatency());
     }
 
-    float radialSpeed = srcVelocity * std::cos(angleRelativeToObserver);
-    mFrequencyRatio = speedOfSound / (speedOfSound - radialSpeed);
+    return true;
+}
+
+void DopplerShiftProcessor::timerCallback()
+{
+    auto* editor = dynamic_cast<DopplerShiftPluginEditor*>(getActiveEditor());
+    if(!editor)
+    {
+        return;
+    }
 
-    editor->setObserverPosition({0.0, observerYPos});
-    editor->updatePositions({mSourcePosition.getX() - prevSourceXPosition, 0.0f});
+    // The scene is drawn with the whole path across it
+    auto const pixelsPerMetre = editor->getDrawingViewWidth() / (2.0f * pathHalfWidth);
+    auto const sourceX = mSourceX.load();
+    auto const observerY = mState.getRawParameterValue("observerY")->load();
 
-    std::cout << "Latency: " << mPitchShifter->getLatency() << "\n";
+    editor->setSourcePosition({sourceX * pixelsPerMetre, 0.0f});
+    editor->setObserverPosition({0.0f, observerY * pixelsPerMetre});
 
 #if PRINT_DOPPLER_DEBUG
-    auto const incordec = (mFrequencyRatio > prevFreqValue) ? "increasing" : "decreasing";
     std::cout
-        << ", radialSpeed=" << radialSpeed * 1000.0f
-        << ", distance=" << mSourcePosition.getX()
-        << ", angle=" << juce::radiansToDegrees(angleRelativeToObserver)
-        << ", frequencyRatio=" << mFrequencyRatio
-        << ", "
-        << incordec
+        << "sourceX=" << sourceX
+        << ", distance=" << std::hypot(sourceX, observerY)
         << "\n";
 #endif
 }
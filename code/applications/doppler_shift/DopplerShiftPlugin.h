@@ -1,13 +1,34 @@
 #pragma once
 
 #include "../JuceLibraryCode/JuceHeader.h"
+#include "DelayLinePitchShifter.h"
+#include "DistanceFilter.h"
+#include "DopplerMixer.h"
 #include "DopplerShiftPluginEditor.h"
+#include "DopplerSource.h"
 #include "RubberbandPitchShifter.h"
 #include <algorithm>
+#include <array>
+#include <atomic>
 
 namespace OUS
 {
     //==============================================================================
+    /*
+    DopplerShiftProcessor
+
+    A source moving back and forth past an observer, heard through the input. The
+    audio thread moves the source on (following the host's transport when it's
+    playing), a control block at a time, and hears it through the engine in use,
+    the distance attenuation and the air absorption. The editor just draws where the
+    audio thread says the source is, so it all works without one.
+
+    The other sources (up to maxSources, the optional "Source 2"... inputs, mono or
+    stereo) are a scene: each moving along its own path (a DopplerMixer), heard by the
+    same observer and added to the output. The scene comes from a JSON file (see
+    DopplerMixer) and is saved with the plugin's state; until one is loaded they
+    follow source 1 along its path, spread out behind it.
+    */
     class DopplerShiftProcessor
     : public juce::AudioProcessor
     , private juce::Timer
@@ -45,22 +66,84 @@ namespace OUS
         //==============================================================================
         bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
 
+        //==============================================================================
+        /** Message thread. Loads the other sources' scene, returns false (setting error) if
+            it's not one */
+        bool loadScene(juce::File const& file, juce::String& error);
+        bool setScene(juce::String const& json, juce::String& error);
+
     private:
+        // The "engine" parameter's choices
+        enum Engine
+        {
+            DelayLine,
+            RubberBand
+        };
+
         void timerCallback() override;
+
+        /** Audio thread. Starts the engine switched to afresh, reports its latency to the host */
+        void setEngine(int engine);
+
+        /** Audio thread. Reports the later of the engine's and the scene's latency to the
+            host, and works out how much source 1 is delayed to line up with the scene */
+        void updateLatency();
+
+        /** Audio thread. Puts the source where the host's transport says it should be, if it's
+            playing and has jumped (started, looped, moved) */
+        void followHost(int numSamples);
+
+        /** Audio thread. Mixes each of the other sources' inputs down to mono, for the scene.
+            Returns how many there are */
+        int gatherSceneInputs(AudioBuffer<float>& buffer);
+
+        static BusesProperties createBuses();
+        static juce::String createDefaultScene();
         //==============================================================================
 
         juce::AudioProcessorValueTreeState mState;
 
-        float static constexpr timerUpdateTime = 1000; // 1 second
+        int static constexpr timerHz = 30;
+
+        // The source's path runs from -pathHalfWidth to pathHalfWidth metres, it starts at sourceStartX
+        float static constexpr pathHalfWidth = 200.0f;
+        float static constexpr sourceStartX = -30.0f;
+
+        // Furthest the source can be from the observer (past the closest it gets), in time
+        double static constexpr maxDelaySeconds = 2.0;
 
-        // TODO: Check the thread saftey of this parameter
-        float mFrequencyRatio{1.0f};
+        // The kinematics are worked out (and the engines / filter updated) this often
+        int static constexpr controlBlockSize = 32;
+        double static constexpr parameterRampSeconds = 0.05;
 
-        // Note in this way origin is defined as the center of the world (not the left top / bottom corner)!
-        juce::Point<float> mSourcePosition{-30.0f, 0.0f};
-        float mSourceDirection{1.0f};
+        // Source 1 is the main input, the rest are the scene's
+        int static constexpr maxSources = 8;
+
+        // Set by the audio thread, for the editor
+        std::atomic<float> mSourceX{sourceStartX};
+
+        // Audio thread
+        double mSampleRate{44100.0};
+        int mEngine{-1};
+        juce::int64 mNextHostTime{-1};
+        DopplerSource mSource{DopplerSource::line(pathHalfWidth, sourceStartX)};
+        juce::SmoothedValue<float> mSourceSpeed;
+        juce::SmoothedValue<float> mObserverY;
 
         std::unique_ptr<RubberbandPitchShifter> mPitchShifter;
+        std::unique_ptr<DelayLinePitchShifter> mDelayLine;
+        std::unique_ptr<DistanceFilter> mDistanceFilter;
+
+        // Added to the delay line engine's delay, when the scene's later than it (binaural)
+        int mMainDelay{0};
+
+        // The scene, swapped in by the message thread (the audio thread skips it rather than wait)
+        juce::String mScene;
+        juce::SpinLock mMixerLock;
+        std::unique_ptr<DopplerMixer> mMixer;
+        std::atomic<int> mSceneLatency{0};
+        juce::AudioBuffer<float> mSceneInputs;
+        std::array<float const*, maxSources - 1> mSceneInputPointers{};
 
         //==============================================================================
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DopplerShiftProcessor)
@@ -11,12 +11,6 @@ namespace OUS
     : public juce::Component
     {
     public:
-        void updateSourcePosition(juce::Point<float> increment)
-        {
-            mSourcePosition += increment;
-            repaint();
-        }
-
         void setSourcePosition(juce::Point<float> position)
         {
             mSourcePosition = position;
@@ -26,6 +20,7 @@ namespace OUS
         void setObserverPosition(juce::Point<float> position)
         {
             mObserverPosition = position;
+            repaint();
         }
 
         void paint(Graphics& g) override
@@ -50,7 +45,7 @@ namespace OUS
         float static constexpr mCircleRadius = 5.0f;
 
         juce::Point<float> mSourcePosition{0.0f, 0.0f};
-        juce::Point<float> mObserverPosition{0.0f, 0.0f}; // fixed for now
+        juce::Point<float> mObserverPosition{0.0f, 0.0f};
     };
 
     class DopplerShiftPluginEditor
@@ -69,6 +64,29 @@ namespace OUS
             addAndMakeVisible(mObserverYPositionSlider);
             mObserverYPositionSliderLabel.attachToComponent(&mObserverYPositionSlider, true);
 
+            // The choices have to be there before it's attached
+            if(auto* engine = dynamic_cast<juce::AudioParameterChoice*>(state.getParameter("engine")))
+            {
+                mEngineComboBox.addItemList(engine->choices, 1);
+            }
+            mEngineAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(state, "engine", mEngineComboBox);
+            addAndMakeVisible(mEngineComboBox);
+            mEngineComboBoxLabel.attachToComponent(&mEngineComboBox, true);
+
+            mLoadSceneButton.onClick = [this]
+            {
+                mSceneChooser = std::make_unique<juce::FileChooser>("Load a scene", juce::File(), "*.json");
+                mSceneChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles, [this](juce::FileChooser const& chooser)
+                                           {
+                                               auto const file = chooser.getResult();
+                                               if(file != juce::File() && onLoadScene)
+                                               {
+                                                   onLoadScene(file);
+                                               }
+                                           });
+            };
+            addAndMakeVisible(mLoadSceneButton);
+
             addAndMakeVisible(mDopplerScene);
             setSize(400, 400);
         }
@@ -86,6 +104,8 @@ namespace OUS
         {
             auto bounds = getLocalBounds();
 
+            mLoadSceneButton.setBounds(bounds.removeFromBottom(20).removeFromRight(static_cast<int>(bounds.getWidth() * 0.66f)));
+            mEngineComboBox.setBounds(bounds.removeFromBottom(20).removeFromRight(static_cast<int>(bounds.getWidth() * 0.66f)));
             mObserverYPositionSlider.setBounds(bounds.removeFromBottom(20).removeFromRight(static_cast<int>(bounds.getWidth() * 0.66f)));
             mSourceSpeedSlider.setBounds(bounds.removeFromBottom(20).removeFromRight(static_cast<int>(bounds.getWidth() * 0.66f)));
             mDopplerScene.setBounds(bounds);
@@ -101,17 +121,14 @@ namespace OUS
             mDopplerScene.setObserverPosition(position);
         }
 
-        void updatePositions(juce::Point<float> increment)
-        {
-            // update the positions based on the speed of the source
-            mDopplerScene.updateSourcePosition(increment);
-        }
-
         float getDrawingViewWidth()
         {
             return static_cast<float>(mDopplerScene.getWidth());
         }
 
+        // Called with the scene file the user picks
+        std::function<void(juce::File const&)> onLoadScene;
+
     private:
         //=============================================================================
 
@@ -121,8 +138,15 @@ namespace OUS
         juce::Slider mObserverYPositionSlider;
         juce::AudioProcessorValueTreeState::SliderAttachment mObserverYPositionAttachment;
 
+        juce::ComboBox mEngineComboBox;
+        std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> mEngineAttachment;
+
         juce::Label mSourceSpeedSliderLabel{{}, "Source Speed"};
         juce::Label mObserverYPositionSliderLabel{{}, "Observer Y"};
+        juce::Label mEngineComboBoxLabel{{}, "Engine"};
+
+        juce::TextButton mLoadSceneButton{"Load Scene..."};
+        std::unique_ptr<juce::FileChooser> mSceneChooser;
 
         DopplerScene mDopplerScene;
 
@@ -0,0 +1,158 @@
+#include "DopplerSource.h"
+
+using namespace OUS;
+
+DopplerSource::DopplerSource(std::vector<juce::Point<float>> path, bool loop, float startDistance)
+: mPoints(std::move(path))
+, mLoop(loop)
+{
+    jassert(mPoints.size() >= 2);
+
+    // Looping, it comes back round to where it started
+    if(mLoop)
+    {
+        mPoints.push_back(mPoints.front());
+    }
+
+    mDistances.push_back(0.0);
+    for(size_t i = 1; i < mPoints.size(); ++i)
+    {
+        mDistances.push_back(mDistances.back() + mPoints[i - 1].getDistanceFrom(mPoints[i]));
+    }
+
+    // Out and back
+    mPathLength = mLoop ? mDistances.back() : 2.0 * mDistances.back();
+    mStartDistance = std::clamp(static_cast<double>(startDistance), 0.0, mDistances.back());
+    setTime(0.0, 0.0f);
+}
+
+DopplerSource DopplerSource::line(float halfWidth, float startX)
+{
+    return {{{-halfWidth, 0.0f}, {halfWidth, 0.0f}}, false, startX + halfWidth};
+}
+
+void DopplerSource::setTime(double seconds, float speed)
+{
+    mPathPosition = mStartDistance;
+    advance(seconds, speed);
+}
+
+void DopplerSource::advance(double seconds, float speed)
+{
+    if(mPathLength <= 0.0)
+    {
+        return;
+    }
+
+    mPathPosition = std::fmod(mPathPosition + seconds * speed, mPathLength);
+    if(mPathPosition < 0.0)
+    {
+        mPathPosition += mPathLength;
+    }
+}
+
+juce::Point<float> DopplerSource::getPosition() const
+{
+    return getPosition(mPathPosition);
+}
+
+juce::Point<float> DopplerSource::getDirection() const
+{
+    return getDirection(mPathPosition);
+}
+
+float DopplerSource::getDistance(juce::Point<float> observer) const
+{
+    return getPosition().getDistanceFrom(observer);
+}
+
+float DopplerSource::getClosestDistance(juce::Point<float> observer) const
+{
+    auto closest = std::numeric_limits<float>::max();
+    for(size_t i = 1; i < mPoints.size(); ++i)
+    {
+        juce::Point<float> nearest;
+        closest = std::min(closest, juce::Line<float>(mPoints[i - 1], mPoints[i]).getDistanceFromPoint(observer, nearest));
+    }
+
+    return closest;
+}
+
+double DopplerSource::getTravelSeconds(float speed, juce::Point<float> observer) const
+{
+    // The delay is how far away the source was when it was sent, which depends on the delay.
+    // The source is slower than sound, so going back and forth between the two settles on it
+    // (to well under a sample)
+    double delay = getDistance(observer) / speedOfSound;
+    for(int i = 0; i < 8; ++i)
+    {
+        auto const previous = delay;
+        delay = getPosition(mPathPosition - delay * speed).getDistanceFrom(observer) / speedOfSound;
+        if(std::abs(delay - previous) < 1.0e-6)
+        {
+            break;
+        }
+    }
+
+    return delay;
+}
+
+double DopplerSource::getDelaySeconds(float speed, juce::Point<float> observer) const
+{
+    return getTravelSeconds(speed, observer) - getClosestDistance(observer) / speedOfSound;
+}
+
+float DopplerSource::getFrequencyRatio(float speed, juce::Point<float> observer) const
+{
+    // How fast the source is coming towards the observer
+    auto const towardsObserver = observer - getPosition();
+    auto const distance = std::max(towardsObserver.getDistanceFromOrigin(), 1.0f);
+    auto const radialSpeed = getDirection().getDotProduct(towardsObserver) * speed / distance;
+    return speedOfSound / std::max(speedOfSound - radialSpeed, 1.0f);
+}
+
+juce::Point<float> DopplerSource::getPosition(double pathPosition) const
+{
+    auto const [segment, along] = getSegment(pathPosition);
+    auto const& start = mPoints[segment];
+    auto const& end = mPoints[segment + 1];
+    auto const length = mDistances[segment + 1] - mDistances[segment];
+    auto const proportion = length > 0.0 ? static_cast<float>(along / length) : 0.0f;
+    return start + (end - start) * proportion;
+}
+
+juce::Point<float> DopplerSource::getDirection(double pathPosition) const
+{
+    auto const segment = getSegment(pathPosition).first;
+    auto const delta = mPoints[segment + 1] - mPoints[segment];
+    auto const length = delta.getDistanceFromOrigin();
+    auto const direction = length > 0.0f ? delta / length : juce::Point<float>();
+
+    // On the way back
+    pathPosition = std::fmod(pathPosition, mPathLength);
+    if(pathPosition < 0.0)
+    {
+        pathPosition += mPathLength;
+    }
+
+    return !mLoop && pathPosition > mDistances.back() ? -direction : direction;
+}
+
+std::pair<size_t, double> DopplerSource::getSegment(double pathPosition) const
+{
+    pathPosition = std::fmod(pathPosition, mPathLength);
+    if(pathPosition < 0.0)
+    {
+        pathPosition += mPathLength;
+    }
+
+    // On the way back it's the same distance from the far end
+    if(!mLoop && pathPosition > mDistances.back())
+    {
+        pathPosition = mPathLength - pathPosition;
+    }
+
+    auto const next = std::upper_bound(mDistances.begin(), mDistances.end(), pathPosition);
+    auto const segment = std::clamp(static_cast<size_t>(std::distance(mDistances.begin(), next)), static_cast<size_t>(1), mPoints.size() - 1) - 1;
+    return {segment, pathPosition - mDistances[segment]};
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <vector>
+
+namespace OUS
+{
+    /*
+    DopplerSource
+
+    Where a sound source is as it moves along a path: straight lines through a list
+    of points, either going back and forth along it or (looped) round and round it.
+    Positions are in metres and speeds in metres per second.
+
+    The audio thread moves it on block by block, and it works out what an observer
+    hears from there: how long the sound takes to arrive (the delay line's delay),
+    the frequency ratio (for the RubberBand engine) and how far away it is.
+    */
+    class DopplerSource
+    {
+    public:
+        static constexpr float speedOfSound = 344.0f;
+
+        /** startDistance is how far along the path it starts. A path needs at least two points */
+        DopplerSource(std::vector<juce::Point<float>> path, bool loop, float startDistance);
+
+        /** Back and forth along the x axis between -halfWidth and halfWidth, starting at
+            startX heading towards +x */
+        static DopplerSource line(float halfWidth, float startX);
+
+        /** Puts the source where it would be seconds after it started, i.e. follows the
+            host's transport */
+        void setTime(double seconds, float speed);
+
+        /** Moves the source on by seconds */
+        void advance(double seconds, float speed);
+
+        juce::Point<float> getPosition() const;
+
+        /** Which way it's going, a unit vector */
+        juce::Point<float> getDirection() const;
+
+        float getDistance(juce::Point<float> observer) const;
+
+        /** The closest it gets to observer along the whole path */
+        float getClosestDistance(juce::Point<float> observer) const;
+
+        /** The time the sound the observer hears now took to reach them. It was sent from
+            where the source was then, which is what makes the pitch shift c / (c - radial speed) */
+        double getTravelSeconds(float speed, juce::Point<float> observer) const;
+
+        /** The travel time past the least it can take (when the source is closest) */
+        double getDelaySeconds(float speed, juce::Point<float> observer) const;
+
+        /** The ratio the frequency is shifted by */
+        float getFrequencyRatio(float speed, juce::Point<float> observer) const;
+
+    private:
+        juce::Point<float> getPosition(double pathPosition) const;
+        juce::Point<float> getDirection(double pathPosition) const;
+
+        /** The segment (index of its first point) pathPosition is on, and how far along it */
+        std::pair<size_t, double> getSegment(double pathPosition) const;
+
+        std::vector<juce::Point<float>> mPoints;
+        std::vector<double> mDistances; // along the path to each point
+        bool mLoop;
+        double mStartDistance;
+
+        // How far along the path the source is, there and back again unless it loops
+        double mPathPosition = 0.0;
+        double mPathLength = 0.0;
+    };
+} // namespace OUS
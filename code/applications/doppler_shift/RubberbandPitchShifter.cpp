@@ -5,26 +5,22 @@ using namespace OUS;
 RubberbandPitchShifter::RubberbandPitchShifter(int sampleRate, size_t numChannels, int blockSize)
 : mChannels(numChannels)
 , mOutputBuffer(numChannels)
+, mReadPointers(numChannels, nullptr)
+, mWritePointers(numChannels, nullptr)
 {
     RubberBand::RubberBandStretcher::Options ops = RubberBand::RubberBandStretcher::OptionProcessRealTime;
     mRubber = std::make_unique<RubberBand::RubberBandStretcher>(sampleRate, numChannels, ops);
+    mRubber->setMaxProcessSize(static_cast<size_t>(std::max(blockSize, chunkSize)));
+    mRatios.prepare(sampleRate, 1.0, 1.0);
 
-    mInputBuffer.setSize(static_cast<int>(numChannels), blockSize);
-    mInputBuffer.clear();
-    mScratchBuffer.setSize(static_cast<int>(numChannels), blockSize);
-    mScratchBuffer.clear();
-
-    auto const bufferSize = blockSize + 8192 * 2;
+    mScratchBuffer.setSize(static_cast<int>(numChannels), chunkSize);
     for(size_t ch = 0; ch < numChannels; ++ch)
     {
-        mOutputBuffer[ch] = std::make_unique<RubberBand::RingBuffer<float>>(bufferSize);
-        mOutputBuffer[ch]->reset();
+        mWritePointers[ch] = mScratchBuffer.getWritePointer(static_cast<int>(ch));
+        mOutputBuffer[ch] = std::make_unique<RubberBand::RingBuffer<float>>(chunkSize + blockSize + chunkSize);
     }
 
-    // TODO: Check why this causes NAN issues, the original logic was copied from the LADSPA eg:
-    // https://github.com/breakfastquay/rubberband/blob/default/ladspa-lv2/RubberBandPitchShifter.h
-    // float const* readPtrs[2] = {mScratchBuffer.getReadPointer(0, 0), mScratchBuffer.getReadPointer(1, 0)};
-    //    mRubber->process(readPtrs, 8192, false);
+    mLatency = prime();
 }
 
 RubberbandPitchShifter::~RubberbandPitchShifter()
@@ -33,70 +29,94 @@ RubberbandPitchShifter::~RubberbandPitchShifter()
 
 size_t RubberbandPitchShifter::getLatency()
 {
-    return mRubber->getLatency();
+    return mLatency;
 }
 
-void RubberbandPitchShifter::setPitchRatio(float ratio)
+void RubberbandPitchShifter::reset(float pitchRatio)
 {
-    mRubber->setPitchScale(ratio);
+    mRubber->reset();
+    mRatios.jumpTo(RatioCommandQueue::Ratio::Pitch, pitchRatio);
+    mRatios.apply(*mRubber, 0);
+    for(auto& buffer : mOutputBuffer)
+    {
+        buffer->reset();
+    }
+
+    prime();
 }
 
-void RubberbandPitchShifter::process(AudioBuffer<float>& buffer, size_t numSamples)
+size_t RubberbandPitchShifter::prime()
 {
-    size_t processedSamples = 0;
-    size_t outTotal = 0;
+    mScratchBuffer.clear();
+    for(size_t ch = 0; ch < mChannels; ++ch)
+    {
+        mReadPointers[ch] = mScratchBuffer.getReadPointer(static_cast<int>(ch));
+    }
 
-    for(int ch = 0; ch < static_cast<int>(mChannels); ++ch)
+    // RubberBand wants a couple of windows of input before it gives anything back, give it
+    // silence for that now (a chunk at a time, giving it more than it asks for at once is
+    // what made the LADSPA plugin's version of this produce NANs)
+    auto numIn = 0;
+    while(mRubber->available() <= 0)
     {
-        mInputBuffer.copyFrom(ch, 0, buffer, ch, 0, static_cast<int>(numSamples));
+        auto const inChunk = std::min(std::max(1, static_cast<int>(mRubber->getSamplesRequired())), chunkSize);
+        mRubber->process(mReadPointers.data(), static_cast<size_t>(inChunk), false);
+        numIn += inChunk;
     }
 
-    while(processedSamples < numSamples)
+    auto numOut = 0;
+    while(auto const available = std::min(static_cast<int>(mRubber->available()), chunkSize))
     {
-        auto const requiredSamples = mRubber->getSamplesRequired();
-        auto const inChunk = std::min(numSamples - processedSamples, requiredSamples);
+        numOut += static_cast<int>(mRubber->retrieve(mWritePointers.data(), static_cast<size_t>(available)));
+    }
 
-        std::vector<float const*> readPtrs(mChannels, nullptr);
-        for(size_t ch = 0; ch < mChannels; ++ch)
-        {
-            readPtrs[ch] = mInputBuffer.getReadPointer(static_cast<int>(ch), static_cast<int>(processedSamples));
-        }
+    for(auto& buffer : mOutputBuffer)
+    {
+        buffer->zero(chunkSize);
+    }
 
-        mRubber->process(readPtrs.data(), static_cast<size_t>(inChunk), false);
-        processedSamples += inChunk;
+    // The silence still inside RubberBand plus the pre-roll
+    return static_cast<size_t>(numIn - numOut + chunkSize);
+}
 
-        auto const availableSamples = mRubber->available();
-        auto const writableSamples = mOutputBuffer[0]->getWriteSpace();
+void RubberbandPitchShifter::setPitchRatio(float ratio)
+{
+    mRatios.push(RatioCommandQueue::Ratio::Pitch, ratio);
+}
 
-        if(availableSamples > writableSamples)
-        {
-#if PRINT_RUBBERBAND_ERRORS
-            std::cerr << "RubberbandPitchShifter::process: output buffer is not large enough. size = "
-                      << mOutputBuffer[0]->getSize() << ", chunk = " << availableSamples << ", space = "
-                      << writableSamples << " (buffer contains " << mOutputBuffer[0]->getReadSpace() << " unread)\n";
-#endif
-        }
+void RubberbandPitchShifter::rampPitchRatio(float ratio)
+{
+    mRatios.rampTo(RatioCommandQueue::Ratio::Pitch, ratio);
+}
+
+void RubberbandPitchShifter::process(AudioBuffer<float>& buffer, size_t numSamples)
+{
+    mRatios.drain();
 
-        auto const outChunk = std::min(availableSamples, writableSamples);
+    // Feed the block in place, in the chunks RubberBand asks for
+    size_t processedSamples = 0;
+    while(processedSamples < numSamples)
+    {
+        auto const requiredSamples = mRubber->getSamplesRequired();
+        auto const remainingSamples = numSamples - processedSamples;
+        auto const inChunk = requiredSamples > 0 ? std::min(remainingSamples, requiredSamples) : remainingSamples;
 
-        std::vector<float*> writePtrs(mChannels, nullptr);
         for(size_t ch = 0; ch < mChannels; ++ch)
         {
-            writePtrs[ch] = mScratchBuffer.getWritePointer(static_cast<int>(ch), 0);
+            mReadPointers[ch] = buffer.getReadPointer(static_cast<int>(ch), static_cast<int>(processedSamples));
         }
 
-        auto const retrieved = mRubber->retrieve(writePtrs.data(), static_cast<size_t>(outChunk));
-        outTotal += retrieved;
+        mRatios.apply(*mRubber, static_cast<int>(inChunk));
+        mRubber->process(mReadPointers.data(), inChunk, false);
+        processedSamples += inChunk;
 
-        for(size_t ch = 0; ch < mChannels; ++ch)
-        {
-            mOutputBuffer[ch]->write(mScratchBuffer.getReadPointer(static_cast<int>(ch)), static_cast<int>(outTotal));
-        }
+        retrieveAvailable();
     }
 
     auto const toRead = mOutputBuffer[0]->getReadSpace();
     if(toRead < static_cast<int>(numSamples))
     {
+        ++mNumUnderruns;
 #if PRINT_RUBBERBAND_ERRORS
         std::cerr << "RubberbandPitchShifter::process: buffer underrun: required = " << numSamples
                   << ", available = " << toRead << "\n";
@@ -108,5 +128,34 @@ void RubberbandPitchShifter::process(AudioBuffer<float>& buffer, size_t numSampl
     for(size_t ch = 0; ch < mChannels; ++ch)
     {
         mOutputBuffer[ch]->read(buffer.getWritePointer(static_cast<int>(ch)), chunk);
+        buffer.clear(static_cast<int>(ch), chunk, static_cast<int>(numSamples) - chunk);
+    }
+}
+
+void RubberbandPitchShifter::retrieveAvailable()
+{
+    while(auto const available = static_cast<int>(mRubber->available()))
+    {
+        auto const writableSamples = mOutputBuffer[0]->getWriteSpace();
+        if(available > writableSamples)
+        {
+#if PRINT_RUBBERBAND_ERRORS
+            std::cerr << "RubberbandPitchShifter::process: output buffer is not large enough. size = "
+                      << mOutputBuffer[0]->getSize() << ", chunk = " << available << ", space = "
+                      << writableSamples << " (buffer contains " << mOutputBuffer[0]->getReadSpace() << " unread)\n";
+#endif
+        }
+
+        auto const outChunk = std::min({available, writableSamples, chunkSize});
+        if(outChunk <= 0)
+        {
+            return;
+        }
+
+        auto const retrieved = static_cast<int>(mRubber->retrieve(mWritePointers.data(), static_cast<size_t>(outChunk)));
+        for(size_t ch = 0; ch < mChannels; ++ch)
+        {
+            mOutputBuffer[ch]->write(mWritePointers[ch], retrieved);
+        }
     }
 }
@@ -1,29 +1,67 @@
 #pragma once
 
+#include "../../core/RatioCommandQueue.h"
 #include "../../core/RingBuffer.h"
 #include "../../dependencies/rubberband/rubberband/RubberBandStretcher.h"
 #include "../JuceLibraryCode/JuceHeader.h"
 
 namespace OUS
 {
+    /*
+    RubberbandPitchShifter
+
+    Shifts the pitch of a live signal with RubberBand's real time mode, a block at
+    a time. Everything is allocated up front, so process doesn't allocate: the input
+    is fed to RubberBand straight from the block and its output goes through a FIFO,
+    which starts with a pre-roll of silence to cover the chunks it comes back in.
+    */
     class RubberbandPitchShifter
     {
     public:
+        /** blockSize is the most process will be given at once */
         RubberbandPitchShifter(int sampleRate, size_t numChannels, int blockSize);
         ~RubberbandPitchShifter();
 
+        /** The delay through it, in samples (at the pitch it started at) */
         size_t getLatency();
 
+        /** Not from the audio thread, the change is made (ramped) by the next process call */
         void setPitchRatio(float ratio);
+
+        /** Audio thread, e.g. from automation or the source moving. Ramps from where it is */
+        void rampPitchRatio(float ratio);
+
         void process(AudioBuffer<float>& buffer, size_t numSamples);
 
+        /** Audio thread. Drops everything in flight and starts again at pitchRatio (e.g. after
+            it's been bypassed, when the ratio it had is stale), latency stays the same */
+        void reset(float pitchRatio);
+
+        /** Blocks process couldn't (completely) fill */
+        int getNumUnderruns() const { return mNumUnderruns; }
+
     private:
+        // The most RubberBand is asked for at once, and the silence the output starts with
+        static constexpr int chunkSize = 1024;
+
+        /** Gives RubberBand the silence it needs before it gives anything back, then fills
+            the output FIFO with the pre-roll. Returns the latency */
+        size_t prime();
+
+        /** Moves whatever RubberBand has ready into the output FIFO */
+        void retrieveAvailable();
+
         size_t mChannels;
 
-        juce::AudioBuffer<float> mInputBuffer;
         juce::AudioBuffer<float> mScratchBuffer;
         std::vector<std::unique_ptr<RubberBand::RingBuffer<float>>> mOutputBuffer;
+        std::vector<float const*> mReadPointers;
+        std::vector<float*> mWritePointers;
+
+        size_t mLatency = 0;
+        int mNumUnderruns = 0;
 
         std::unique_ptr<RubberBand::RubberBandStretcher> mRubber;
+        RatioCommandQueue mRatios;
     };
 } // namespace OUS
@@ -1,8 +1,12 @@
 #include "../../dependencies/freeverb/revmodel.hpp"
+#include "../../utils/ReverbChannelLayout.h"
+#include "../../utils/SampleAccurateParameterChanges.h"
 #include "cids.h"
 #include "pluginterfaces/vst/ivstparameterchanges.h"
 #include "public.sdk/source/vst/vstaudioeffect.h"
 
+#include <cmath>
+
 namespace OUS
 {
     class ReverbVST : public Steinberg::Vst::AudioEffect
@@ -39,8 +43,9 @@ namespace OUS
             }
 
             //--- create Audio IO ------
-            addAudioInput(STR16("Stereo In"), Steinberg::Vst::SpeakerArr::kStereo);
-            addAudioOutput(STR16("Stereo Out"), Steinberg::Vst::SpeakerArr::kStereo);
+            addAudioInput(STR16("Audio In"), Steinberg::Vst::SpeakerArr::kStereo);
+            addAudioOutput(STR16("Audio Out"), Steinberg::Vst::SpeakerArr::kStereo);
+            m_layout = OUS::ReverbChannelLayout(Steinberg::Vst::SpeakerArr::kStereo, Steinberg::Vst::SpeakerArr::kStereo);
 
             m_reverb->setdry(0.5);
             m_reverb->setwet(0.5);
@@ -50,6 +55,26 @@ namespace OUS
             return Steinberg::kResultOk;
         }
 
+        Steinberg::tresult PLUGIN_API setBusArrangements(Steinberg::Vst::SpeakerArrangement* inputs, Steinberg::int32 numIns, Steinberg::Vst::SpeakerArrangement* outputs, Steinberg::int32 numOuts) override
+        {
+            // Mono, stereo, quad and 5.1, or mono in to any of those
+            if(numIns != 1 || numOuts != 1 || !OUS::ReverbChannelLayout::isSupported(inputs[0], outputs[0]))
+            {
+                return Steinberg::kResultFalse;
+            }
+
+            m_layout = OUS::ReverbChannelLayout(inputs[0], outputs[0]);
+            return AudioEffect::setBusArrangements(inputs, numIns, outputs, numOuts);
+        }
+
+        Steinberg::tresult setupProcessing(Steinberg::Vst::ProcessSetup& newSetup) override
+        {
+            // Scale the reverb tunings to the host sample rate
+            m_reverb->setsamplerate(static_cast<float>(newSetup.sampleRate));
+
+            return AudioEffect::setupProcessing(newSetup);
+        }
+
         Steinberg::tresult setActive(Steinberg::TBool state) override
         {
             // Reset the RevModel object when the plugin is activated or deactivated
@@ -84,79 +109,108 @@ namespace OUS
             return Steinberg::kResultOk;
         }
 
+        Steinberg::uint32 PLUGIN_API getTailSamples() override
+        {
+            // Until the tail has decayed below the silence threshold
+            auto const seconds = m_reverb->gettaillength();
+            if(std::isinf(seconds))
+            {
+                return Steinberg::Vst::kInfiniteTail;
+            }
+
+            return static_cast<Steinberg::uint32>(seconds * processSetup.sampleRate);
+        }
+
         Steinberg::tresult PLUGIN_API process(Steinberg::Vst::ProcessData& data) override
         {
+            // Reverb model parameters are updated in sample order as the block is processed,
+            // splitting it at each automation point
+            OUS::SampleAccurateParameterChanges parameterChanges(data.inputParameterChanges);
+            auto const applyParameter = [this](Steinberg::Vst::ParamID id, Steinberg::Vst::ParamValue value)
+            {
+                setParameter(id, value);
+            };
+
             // Check if there is input and output audio
-            if(data.numInputs == 0 || data.numOutputs == 0)
+            if(data.numInputs == 0 || data.numOutputs == 0 || data.numSamples <= 0)
+            {
+                parameterChanges.applyAll(applyParameter);
                 return Steinberg::kResultOk;
+            }
 
-            // Get audio input and output buffers
-            float* inL = data.inputs[0].channelBuffers32[0];
-            float* inR = data.inputs[0].channelBuffers32[1];
-            float* outL = data.outputs[0].channelBuffers32[0];
-            float* outR = data.outputs[0].channelBuffers32[1];
+            // Not the arrangement agreed to, output silence rather than whatever the host left there
+            if(!m_layout.matches(data.inputs[0], data.outputs[0]))
+            {
+                parameterChanges.applyAll(applyParameter);
+                OUS::ReverbChannelLayout::setSilent(data.outputs[0], data.numSamples, data.symbolicSampleSize);
+                return Steinberg::kResultOk;
+            }
 
-            // Update reverb model parameters
-            if(data.inputParameterChanges)
+            // Once the tail has died away silent input means silent output, so skip the audio altogether
+            if(OUS::ReverbChannelLayout::isSilent(data.inputs[0]) && m_reverb->isidle())
             {
-                Steinberg::int32 numParamsChanged = data.inputParameterChanges->getParameterCount();
-                for(Steinberg::int32 i = 0; i < numParamsChanged; i++)
-                {
-                    Steinberg::Vst::IParamValueQueue* paramQueue = data.inputParameterChanges->getParameterData(i);
-                    if(paramQueue)
-                    {
-                        Steinberg::Vst::ParamValue value;
-                        Steinberg::int32 sampleOffset;
-                        Steinberg::int32 numPoints = paramQueue->getPointCount();
-                        switch(paramQueue->getParameterId())
-                        {
-                            case OUS::GPTVerbParams::kParamDampId:
-                                if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == Steinberg::kResultTrue)
-                                    m_reverb->setdamp(value);
-                                break;
-                            case OUS::GPTVerbParams::kParamRoomSizeId:
-                                if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == Steinberg::kResultTrue)
-                                    m_reverb->setroomsize(value);
-                                break;
-                            case OUS::GPTVerbParams::kParamWidthId:
-                                if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == Steinberg::kResultTrue)
-                                    m_reverb->setwidth(value);
-                                break;
-                            case OUS::GPTVerbParams::kParamFreezeModeId:
-                                if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == Steinberg::kResultTrue)
-                                    m_reverb->setmode(value > 1.0);
-                                break;
-                            case OUS::GPTVerbParams::kParamDryWetId:
-                                if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == Steinberg::kResultTrue)
-                                    m_reverb->setdry(1.0 - value);
-                                m_reverb->setwet(value);
-                                break;
-                            default:
-                                break;
-                        }
-                    }
-                }
+                parameterChanges.applyAll(applyParameter);
+                OUS::ReverbChannelLayout::setSilent(data.outputs[0], data.numSamples, data.symbolicSampleSize);
+                return Steinberg::kResultOk;
             }
 
+            data.outputs[0].silenceFlags = 0;
+
+            // Get audio input and output buffers, in the order the reverb model wants them
+            float** busInputs = data.inputs[0].channelBuffers32;
+            float** busOutputs = data.outputs[0].channelBuffers32;
+            float* inputs[OUS::ReverbChannelLayout::maxChannels];
+            float* outputs[OUS::ReverbChannelLayout::maxChannels];
+
             // Process audio
-            if(data.numSamples > 0)
+            Steinberg::int32 offset = 0;
+            while(offset < data.numSamples)
             {
-                Steinberg::Vst::SpeakerArrangement arr;
-                getBusArrangement(Steinberg::Vst::kOutput, 0, arr);
-                int numChannels = Steinberg::Vst::SpeakerArr::getChannelCount(arr);
-                if(numChannels == 1)
-                {
-                    return Steinberg::kResultOk;
-                }
-                
-                m_reverb->processreplace(inL, inR, outL, outR, data.numSamples, 1);
+                // Every point before the end of the sub block is applied at its start
+                auto const nextOffset = parameterChanges.getNextOffset(offset, data.numSamples);
+                parameterChanges.applyUntil(nextOffset - 1, applyParameter);
+
+                m_layout.getChannels(busInputs, busOutputs, offset, inputs, outputs);
+                m_reverb->processreplace(inputs, m_layout.getNumInputs(), outputs, m_layout.getNumOutputs(), nextOffset - offset);
+                m_layout.processLfe(busInputs, busOutputs, offset, nextOffset - offset);
+                offset = nextOffset;
             }
 
+            // Anything the host has placed beyond the end of the block
+            parameterChanges.applyAll(applyParameter);
+
             return Steinberg::kResultOk;
         }
 
     private:
+        // Update reverb model parameters
+        void setParameter(Steinberg::Vst::ParamID id, Steinberg::Vst::ParamValue value)
+        {
+            switch(id)
+            {
+                case OUS::GPTVerbParams::kParamDampId:
+                    m_reverb->setdamp(value);
+                    break;
+                case OUS::GPTVerbParams::kParamRoomSizeId:
+                    m_reverb->setroomsize(value);
+                    break;
+                case OUS::GPTVerbParams::kParamWidthId:
+                    m_reverb->setwidth(value);
+                    break;
+                case OUS::GPTVerbParams::kParamFreezeModeId:
+                    m_reverb->setmode(value > 1.0);
+                    break;
+                case OUS::GPTVerbParams::kParamDryWetId:
+                    m_reverb->setdry(1.0 - value);
+                    m_reverb->setwet(value);
+                    break;
+                default:
+                    break;
+            }
+        }
+
         revmodel* m_reverb;
+        OUS::ReverbChannelLayout m_layout;
     };
 
 } // namespace OUS
@@ -18,7 +18,8 @@ namespace OUS
         kDampingId = 103,
         kWidthId = 104,
         kRoomSizeId = 105,
-        kPreDelaySizeId = 106
+        kPreDelaySizeId = 106,
+        kEngineId = 107
     };
 
     //------------------------------------------------------------------------
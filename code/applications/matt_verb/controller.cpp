@@ -51,6 +51,44 @@ namespace OUS
         return wrapper.scanFloat(normValue);
     }
 
+    class EngineParameter : public Vst::Parameter
+    {
+    public:
+        EngineParameter(int32 flags, int32 id);
+
+        void toString(Vst::ParamValue normValue, Vst::String128 string) const SMTG_OVERRIDE;
+        bool fromString(const Vst::TChar* string, Vst::ParamValue& normValue) const SMTG_OVERRIDE;
+    };
+
+    EngineParameter::EngineParameter(int32 flags, int32 id)
+    {
+        Steinberg::UString(info.title, USTRINGSIZE(info.title)).assign(USTRING("Engine"));
+
+        info.flags = flags;
+        info.id = id;
+        info.stepCount = 1;
+        info.defaultNormalizedValue = 0.0f;
+        info.unitId = Steinberg::Vst::kRootUnitId;
+    }
+
+    void EngineParameter::toString(Vst::ParamValue normValue, Vst::String128 string) const
+    {
+        if(normValue >= 0.5f)
+        {
+            Steinberg::UString(string, 128).fromAscii("FDN");
+        }
+        else
+        {
+            Steinberg::UString(string, 128).fromAscii("Freeverb");
+        }
+    }
+
+    bool EngineParameter::fromString(const Vst::TChar* string, Vst::ParamValue& normValue) const
+    {
+        UString wrapper(const_cast<char16*>(string), tstrlen(string));
+        return wrapper.scanFloat(normValue);
+    }
+
     class PredelayParameter : public Vst::Parameter
     {
     public:
@@ -136,6 +174,8 @@ namespace OUS
         parameters.addParameter(STR16("Dry / Wet"), nullptr, 0, 1, Steinberg::Vst::ParameterInfo::kCanAutomate, kDryWetId);
         auto* predelayParam = new PredelayParameter(Steinberg::Vst::ParameterInfo::kCanAutomate, kPreDelaySizeId);
         parameters.addParameter(predelayParam);
+        auto* engineParam = new EngineParameter(Steinberg::Vst::ParameterInfo::kCanAutomate | Steinberg::Vst::ParameterInfo::kIsList, kEngineId);
+        parameters.addParameter(engineParam);
 
         return result;
     }
@@ -171,6 +211,13 @@ namespace OUS
             return kResultFalse;
         }
 
+        // The engine was added later, older states don't have it
+        float engineSaveParam = 0.0f;
+        if(streamer.readFloat(engineSaveParam) == false)
+        {
+            engineSaveParam = 0.0f;
+        }
+
         if(auto dryWetParam = parameters.getParameter(kDryWetId))
         {
             dryWetParam->setNormalized(dryWetSaveParam);
@@ -199,6 +246,10 @@ namespace OUS
         {
             preDelayParam->setNormalized(preDelaySaveParam);
         }
+        if(auto engineParam = parameters.getParameter(kEngineId))
+        {
+            engineParam->setNormalized(engineSaveParam);
+        }
 
         return kResultOk;
     }
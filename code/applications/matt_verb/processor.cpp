@@ -8,6 +8,8 @@
 #include "base/source/fstreamer.h"
 #include "pluginterfaces/vst/ivstparameterchanges.h"
 
+#include <cmath>
+
 using namespace Steinberg;
 
 namespace OUS
@@ -40,12 +42,16 @@ namespace OUS
         }
 
         //--- create Audio IO ------
-        addAudioInput(STR16("Stereo In"), Steinberg::Vst::SpeakerArr::kStereo);
-        addAudioOutput(STR16("Stereo Out"), Steinberg::Vst::SpeakerArr::kStereo);
+        addAudioInput(STR16("Audio In"), Steinberg::Vst::SpeakerArr::kStereo);
+        addAudioOutput(STR16("Audio Out"), Steinberg::Vst::SpeakerArr::kStereo);
+        mLayout = ReverbChannelLayout(Steinberg::Vst::SpeakerArr::kStereo, Steinberg::Vst::SpeakerArr::kStereo);
 
-        rev.setdry(0.5);
-        rev.setwet(0.5);
-        rev.setroomsize(0.8);
+        forEachEngine([](auto& engine)
+                      {
+                          engine.setdry(0.5);
+                          engine.setwet(0.5);
+                          engine.setroomsize(0.8);
+                      });
 
         return kResultOk;
     }
@@ -70,146 +76,224 @@ namespace OUS
     tresult PLUGIN_API MattVerbProcessor::process(Vst::ProcessData& data)
     {
         //--- First : Read inputs parameter changes-----------
-        if(data.inputParameterChanges)
+        // These are applied in sample order as we go, splitting the block at each automation point
+        SampleAccurateParameterChanges parameterChanges(data.inputParameterChanges);
+        auto const applyParameter = [this](Vst::ParamID id, Vst::ParamValue value)
         {
-            int32 numParamsChanged = data.inputParameterChanges->getParameterCount();
-            for(int32 index = 0; index < numParamsChanged; index++)
-            {
-                if(auto* paramQueue = data.inputParameterChanges->getParameterData(index))
-                {
-                    Vst::ParamValue value;
-                    int32 sampleOffset;
-                    int32 numPoints = paramQueue->getPointCount();
-                    switch(paramQueue->getParameterId())
-                    {
-                        case MattVerbParams::kBypassId:
-                        {
-                            if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == kResultTrue)
-                            {
-                                mBypass = (value > 0.5f);
-                            }
-
-                            break;
-                        }
-                        case MattVerbParams::kDryWetId:
-                        {
-                            if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == kResultTrue)
-                            {
-                                rev.setdry(1.0 - value);
-                                rev.setwet(value);
-                            }
-
-                            break;
-                        }
-                        case MattVerbParams::kModeId:
-                        {
-                            if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == kResultTrue)
-                            {
-                                rev.setmode(value);
-                            }
-
-                            break;
-                        }
-                        case MattVerbParams::kDampingId:
-                        {
-                            if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == kResultTrue)
-                            {
-                                rev.setdamp(value);
-                            }
-
-                            break;
-                        }
-                        case MattVerbParams::kWidthId:
-                        {
-                            if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == kResultTrue)
-                            {
-                                rev.setwidth(value);
-                            }
-
-                            break;
-                        }
-                        case MattVerbParams::kRoomSizeId:
-                        {
-                            if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == kResultTrue)
-                            {
-                                rev.setroomsize(value);
-                            }
-
-                            break;
-                        }
-                        case MattVerbParams::kPreDelaySizeId:
-                        {
-                            if(paramQueue->getPoint(numPoints - 1, sampleOffset, value) == kResultTrue)
-                            {
-                                // scale to appropriate range
-                                constexpr float min = 0.0;
-                                constexpr float max = 10000; // 10 secs
-
-                                auto const scaledValue = (max - min) * value + min;
-                                rev.setpredelaytime(scaledValue);
-                            }
-                        }
-                    }
-                }
-            }
+            setParameter(id, value);
+        };
+
+        if(data.numInputs == 0 || data.numOutputs == 0 || data.numSamples <= 0)
+        {
+            parameterChanges.applyAll(applyParameter);
+            return kResultOk;
         }
-        
-        if(data.numInputs == 0 || data.numOutputs == 0)
+
+        // The host should only ever give us the arrangement it agreed to, but don't trust it
+        // (and don't leave it whatever was in the output either)
+        if(!mLayout.matches(data.inputs[0], data.outputs[0]))
         {
+            parameterChanges.applyAll(applyParameter);
+            ReverbChannelLayout::setSilent(data.outputs[0], data.numSamples, data.symbolicSampleSize);
             return kResultOk;
         }
 
-        if(data.numSamples > 0)
+        // With silent input the reverb has nothing left to do once its tail has died away,
+        // so there's no need to touch the audio at all (which is most of the time for an idle send)
+        if(ReverbChannelLayout::isSilent(data.inputs[0]) && isEngineIdle())
         {
-            Steinberg::Vst::SpeakerArrangement arr;
-            getBusArrangement(Steinberg::Vst::kOutput, 0, arr);
-            int numChannels = Steinberg::Vst::SpeakerArr::getChannelCount(arr);
-
-            float** inputChannels = data.inputs[0].channelBuffers32;
-            float** outputChannels = data.outputs[0].channelBuffers32;
-            
-            if(numChannels == 1)
-            {
-                return kResultOk;
-            }
+            parameterChanges.applyAll(applyParameter);
+            ReverbChannelLayout::setSilent(data.outputs[0], data.numSamples, data.symbolicSampleSize);
+            return kResultOk;
+        }
+
+        data.outputs[0].silenceFlags = 0;
+
+        // 64 bit hosts get their buffers processed as they are, rather than converted to float and back
+        if(data.symbolicSampleSize == Vst::kSample64)
+        {
+            processAudio(data.inputs[0].channelBuffers64, data.outputs[0].channelBuffers64, data.numSamples, parameterChanges);
+        }
+        else
+        {
+            processAudio(data.inputs[0].channelBuffers32, data.outputs[0].channelBuffers32, data.numSamples, parameterChanges);
+        }
+
+        // Anything the host has placed beyond the end of the block
+        parameterChanges.applyAll(applyParameter);
+
+        return kResultOk;
+    }
+
+    //------------------------------------------------------------------------
+    template <typename Sample>
+    void MattVerbProcessor::processAudio(Sample** busInputs, Sample** busOutputs, int32 numSamples, SampleAccurateParameterChanges& parameterChanges)
+    {
+        auto const applyParameter = [this](Vst::ParamID id, Vst::ParamValue value)
+        {
+            setParameter(id, value);
+        };
+
+        Sample* inputChannels[ReverbChannelLayout::maxChannels];
+        Sample* outputChannels[ReverbChannelLayout::maxChannels];
+
+        int32 offset = 0;
+        while(offset < numSamples)
+        {
+            // Every point before the end of the sub block is applied at its start
+            auto const nextOffset = parameterChanges.getNextOffset(offset, numSamples);
+            parameterChanges.applyUntil(nextOffset - 1, applyParameter);
+            auto const blockSize = nextOffset - offset;
 
             if(mBypass)
             {
-                for(int sample = 0; sample < data.numSamples; sample++)
+                mLayout.bypass(busInputs, busOutputs, offset, blockSize);
+            }
+            else
+            {
+                // Every channel is tapped from the one reverb, so there's only one set of combs / lines to run
+                mLayout.getChannels(busInputs, busOutputs, offset, inputChannels, outputChannels);
+                if(mUseFdn)
                 {
-                    for(int channel = 0; channel < numChannels; channel++)
-                    {
-                        outputChannels[channel][sample] = inputChannels[channel][sample];
-                    }
+                    fdn.processreplace(inputChannels, mLayout.getNumInputs(), outputChannels, mLayout.getNumOutputs(), blockSize);
                 }
+                else
+                {
+                    rev.processreplace(inputChannels, mLayout.getNumInputs(), outputChannels, mLayout.getNumOutputs(), blockSize);
+                }
+                mLayout.processLfe(busInputs, busOutputs, offset, blockSize);
             }
-            else
+
+            offset = nextOffset;
+        }
+    }
+
+    //------------------------------------------------------------------------
+    void MattVerbProcessor::setParameter(Vst::ParamID id, Vst::ParamValue value)
+    {
+        switch(id)
+        {
+            case MattVerbParams::kBypassId:
+            {
+                mBypass = (value > 0.5f);
+                break;
+            }
+            case MattVerbParams::kDryWetId:
+            {
+                forEachEngine([value](auto& engine)
+                              {
+                                  engine.setdry(1.0 - value);
+                                  engine.setwet(value);
+                              });
+                break;
+            }
+            case MattVerbParams::kModeId:
             {
-                rev.processreplace(inputChannels[0], inputChannels[1], outputChannels[0], outputChannels[1], data.numSamples, 1);
+                forEachEngine([value](auto& engine) { engine.setmode(value); });
+                break;
             }
+            case MattVerbParams::kDampingId:
+            {
+                forEachEngine([value](auto& engine) { engine.setdamp(value); });
+                break;
+            }
+            case MattVerbParams::kWidthId:
+            {
+                forEachEngine([value](auto& engine) { engine.setwidth(value); });
+                break;
+            }
+            case MattVerbParams::kRoomSizeId:
+            {
+                forEachEngine([value](auto& engine) { engine.setroomsize(value); });
+                break;
+            }
+            case MattVerbParams::kPreDelaySizeId:
+            {
+                // scale to appropriate range
+                constexpr float min = 0.0;
+                constexpr float max = 10000; // 10 secs
+
+                auto const scaledValue = (max - min) * value + min;
+                forEachEngine([scaledValue](auto& engine) { engine.setpredelaytime(scaledValue); });
+                break;
+            }
+            case MattVerbParams::kEngineId:
+            {
+                setEngine(value > 0.5f);
+                break;
+            }
+            default:
+                break;
         }
+    }
 
-        return kResultOk;
+    //------------------------------------------------------------------------
+    void MattVerbProcessor::setEngine(bool useFdn)
+    {
+        if(useFdn == mUseFdn)
+        {
+            return;
+        }
+
+        // The engine switched to holds whatever tail it had when it was last used
+        mUseFdn = useFdn;
+        if(mUseFdn)
+        {
+            fdn.mute();
+        }
+        else
+        {
+            rev.mute();
+        }
+    }
+
+    //------------------------------------------------------------------------
+    bool MattVerbProcessor::isEngineIdle()
+    {
+        return mUseFdn ? fdn.isidle() : rev.isidle();
+    }
+
+    //------------------------------------------------------------------------
+    uint32 PLUGIN_API MattVerbProcessor::getTailSamples()
+    {
+        auto const seconds = mUseFdn ? fdn.gettaillength() : rev.gettaillength();
+        if(std::isinf(seconds))
+        {
+            return Vst::kInfiniteTail;
+        }
+
+        return static_cast<uint32>(seconds * processSetup.sampleRate);
     }
 
     //------------------------------------------------------------------------
     tresult PLUGIN_API MattVerbProcessor::setupProcessing(Vst::ProcessSetup& newSetup)
     {
         //--- called before any processing ----
+        // the freeverb tunings are specified at 44.1kHz, scale them to the host rate
+        forEachEngine([&newSetup](auto& engine) { engine.setsamplerate(static_cast<float>(newSetup.sampleRate)); });
+
         return AudioEffect::setupProcessing(newSetup);
     }
 
+    //------------------------------------------------------------------------
+    tresult PLUGIN_API MattVerbProcessor::setBusArrangements(Vst::SpeakerArrangement* inputs, int32 numIns, Vst::SpeakerArrangement* outputs, int32 numOuts)
+    {
+        if(numIns != 1 || numOuts != 1 || !ReverbChannelLayout::isSupported(inputs[0], outputs[0]))
+        {
+            return kResultFalse;
+        }
+
+        mLayout = ReverbChannelLayout(inputs[0], outputs[0]);
+        return AudioEffect::setBusArrangements(inputs, numIns, outputs, numOuts);
+    }
+
     //------------------------------------------------------------------------
     tresult PLUGIN_API MattVerbProcessor::canProcessSampleSize(int32 symbolicSampleSize)
     {
-        // by default kSample32 is supported
-        if(symbolicSampleSize == Vst::kSample32)
+        // The engines process double buffers natively (see processAudio)
+        if(symbolicSampleSize == Vst::kSample32 || symbolicSampleSize == Vst::kSample64)
             return kResultTrue;
 
-        // disable the following comment if your processing support kSample64
-        /* if (symbolicSampleSize == Vst::kSample64)
-                return kResultTrue; */
-
         return kResultFalse;
     }
 
@@ -237,14 +321,25 @@ namespace OUS
             return kResultFalse;
         }
 
+        // The engine was added later, older states don't have it
+        float engineSaveParam = 0.0f;
+        if(streamer.readFloat(engineSaveParam) == false)
+        {
+            engineSaveParam = 0.0f;
+        }
+
         mBypass = bypassSaveParam;
-        rev.setwet(dryWetSaveParam);
-        rev.setdry(1.0 - dryWetSaveParam);
-        rev.setmode(modeSaveParam);
-        rev.setdamp(dampingSaveParam);
-        rev.setwidth(widthSaveParam);
-        rev.setroomsize(roomSizeSaveParam);
-        rev.setpredelaytime(preDelaySaveParam);
+        forEachEngine([&](auto& engine)
+                      {
+                          engine.setwet(dryWetSaveParam);
+                          engine.setdry(1.0 - dryWetSaveParam);
+                          engine.setmode(modeSaveParam);
+                          engine.setdamp(dampingSaveParam);
+                          engine.setwidth(widthSaveParam);
+                          engine.setroomsize(roomSizeSaveParam);
+                          engine.setpredelaytime(preDelaySaveParam);
+                      });
+        setEngine(engineSaveParam > 0.5f);
 
         return kResultOk;
     }
@@ -260,6 +355,7 @@ namespace OUS
         float widthSaveParam = rev.getwidth();
         float roomSizeSaveParam = rev.getroomsize();
         float preDelaySaveParam = rev.getpredelaytime();
+        float engineSaveParam = mUseFdn ? 1.0f : 0.0f;
 
         IBStreamer streamer(state, kLittleEndian);
         streamer.writeFloat(dryWetSaveParam);
@@ -269,6 +365,7 @@ namespace OUS
         streamer.writeFloat(widthSaveParam);
         streamer.writeFloat(roomSizeSaveParam);
         streamer.writeFloat(preDelaySaveParam);
+        streamer.writeFloat(engineSaveParam);
 
         return kResultOk;
     }
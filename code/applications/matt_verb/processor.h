@@ -4,7 +4,10 @@
 
 #pragma once
 
+#include "../../dependencies/freeverb/fdnmodel.hpp"
 #include "../../dependencies/freeverb/revmodel.hpp"
+#include "../../utils/ReverbChannelLayout.h"
+#include "../../utils/SampleAccurateParameterChanges.h"
 #include "public.sdk/source/vst/vstaudioeffect.h"
 
 namespace OUS
@@ -40,9 +43,15 @@ namespace OUS
         /** Will be called before any process call */
         Steinberg::tresult PLUGIN_API setupProcessing(Steinberg::Vst::ProcessSetup& newSetup) SMTG_OVERRIDE;
 
+        /** Mono, stereo, quad and 5.1, or mono in to any of those (see ReverbChannelLayout) */
+        Steinberg::tresult PLUGIN_API setBusArrangements(Steinberg::Vst::SpeakerArrangement* inputs, Steinberg::int32 numIns, Steinberg::Vst::SpeakerArrangement* outputs, Steinberg::int32 numOuts) SMTG_OVERRIDE;
+
         /** Asks if a given sample size is supported see SymbolicSampleSizes. */
         Steinberg::tresult PLUGIN_API canProcessSampleSize(Steinberg::int32 symbolicSampleSize) SMTG_OVERRIDE;
 
+        /** How long the reverb tail of the engine in use lasts once the input stops */
+        Steinberg::uint32 PLUGIN_API getTailSamples() SMTG_OVERRIDE;
+
         /** Here we go...the process call */
         Steinberg::tresult PLUGIN_API process(Steinberg::Vst::ProcessData& data) SMTG_OVERRIDE;
 
@@ -53,9 +62,35 @@ namespace OUS
         //------------------------------------------------------------------------
 
     protected:
+        /** Runs the reverb over the block in 32 (float) or 64 (double) bit, applying the parameter changes in sample order */
+        template <typename Sample>
+        void processAudio(Sample** busInputs, Sample** busOutputs, Steinberg::int32 numSamples, SampleAccurateParameterChanges& parameterChanges);
+
+        /** Applies a single (normalised) parameter change from the host */
+        void setParameter(Steinberg::Vst::ParamID id, Steinberg::Vst::ParamValue value);
+
+        /** Switches between the freeverb (revmodel) and feedback delay network (fdnmodel) engines */
+        void setEngine(bool useFdn);
+
+        /** Whether the engine in use has stopped processing, as its input is silent and its tail has died away */
+        bool isEngineIdle();
+
+        /** Calls f with each reverb engine, so the one not in use keeps the same settings */
+        template <typename Function>
+        void forEachEngine(Function&& f)
+        {
+            f(rev);
+            f(fdn);
+        }
+
         revmodel rev;
+        fdnmodel fdn;
+
+        // Set from the bus arrangements, which the host only changes while we're inactive
+        ReverbChannelLayout mLayout;
 
         bool mBypass;
+        bool mUseFdn = false;
     };
 
     //------------------------------------------------------------------------
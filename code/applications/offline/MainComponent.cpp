@@ -20,6 +20,7 @@ MainComponent::MainComponent()
     {
         saveButtonClicked();
     };
+    mSaveButton.setEnabled(false);
 
     addAndMakeVisible(&mPlayButton);
     mPlayButton.setButtonText("Play");
@@ -44,12 +45,20 @@ MainComponent::MainComponent()
     mStretchFactorSlider.mLabels.add({1, "10x"});
     mStretchFactorSlider.setRange(0.1, 4, 0.1);
     mStretchFactorSlider.setValue(1.0);
+    mStretchFactorSlider.onValueChange = [this]
+    {
+        performOfflineStretch();
+    };
 
     addAndMakeVisible(&mPitchShiftSlider);
     mPitchShiftSlider.mLabels.add({0.0, "0.1x"});
     mPitchShiftSlider.mLabels.add({1, "10x"});
     mPitchShiftSlider.setRange(0.1, 10, 0.1);
     mPitchShiftSlider.setValue(1.0);
+    mPitchShiftSlider.onValueChange = [this]
+    {
+        performOfflineStretch();
+    };
 
     addAndMakeVisible(&mStretchButton);
     mStretchButton.setButtonText("Stretch!");
@@ -59,7 +68,25 @@ MainComponent::MainComponent()
     };
     mStretchButton.setEnabled(false);
 
-    setSize(600, 350);
+    addAndMakeVisible(&mStretchProgressBar);
+
+    // Moving the sliders restarts the stretch, playback can start as soon as it has
+    mStretchScheduler.onStarted = [this](StretchScheduler::Stretch stretch)
+    {
+        stretchStarted(stretch);
+    };
+    mStretchScheduler.onProgress = [this](double progress)
+    {
+        mStretchProgress = progress;
+    };
+    mStretchScheduler.onComplete = [this](StretchScheduler::Stretch stretch)
+    {
+        stretchComplete(stretch);
+    };
+    // Files tend to be opened again, keep their stretches between sessions
+    mStretchScheduler.getCache().setDiskCacheEnabled(true);
+
+    setSize(600, 380);
 
     mFormatManager.registerBasicFormats();
     mTransportSource.addChangeListener(this);
@@ -80,7 +107,7 @@ void MainComponent::prepareToPlay(int samplesPerBlockExpected, double sampleRate
 
 void MainComponent::getNextAudioBlock(const AudioSourceChannelInfo& bufferToFill)
 {
-    if(mReaderSource.get() == nullptr)
+    if(mStretchedSource.get() == nullptr)
     {
         bufferToFill.clearActiveBufferRegion();
         return;
@@ -91,9 +118,9 @@ void MainComponent::getNextAudioBlock(const AudioSourceChannelInfo& bufferToFill
 
 void MainComponent::releaseResources()
 {
-    if(mReaderSource != nullptr)
+    if(mStretchedSource != nullptr)
     {
-        mReaderSource->releaseResources();
+        mStretchedSource->releaseResources();
     }
     mTransportSource.releaseResources();
 }
@@ -127,7 +154,10 @@ void MainComponent::resized()
     bottomButtonBounds.removeFromLeft(twoColumnCompSpacing);
     mStopButton.setBounds(bottomButtonBounds.removeFromLeft(twoColumnCompWidth));
 
-    bounds.removeFromTop(20);
+    bounds.removeFromTop(10);
+    mStretchProgressBar.setBounds(bounds.removeFromTop(20));
+
+    bounds.removeFromTop(10);
     mStretchButton.setBounds(bounds);
 }
 
@@ -149,8 +179,13 @@ void MainComponent::openButtonClicked()
                                   auto reader = std::unique_ptr<juce::AudioFormatReader>(mFormatManager.createReaderFor(file));
                                   if(reader != nullptr)
                                   {
-                                      mFileBuffer.setSize(static_cast<int>(reader->numChannels), static_cast<int>(reader->lengthInSamples));
-                                      reader->read(&mFileBuffer, 0, static_cast<int>(reader->lengthInSamples), 0, true, true);
+                                      juce::AudioSampleBuffer fileBuffer(static_cast<int>(reader->numChannels), static_cast<int>(reader->lengthInSamples));
+                                      reader->read(&fileBuffer, 0, static_cast<int>(reader->lengthInSamples), 0, true, true);
+
+                                      mStretchScheduler.setSource(fileBuffer, reader->sampleRate);
+                                      setCompletedStretch(nullptr);
+                                      mFileLoaded = true;
+                                      mStretchButton.setEnabled(true);
 
                                       performOfflineStretch();
                                   }
@@ -159,14 +194,21 @@ void MainComponent::openButtonClicked()
 
 void MainComponent::saveButtonClicked()
 {
+    if(mCompletedStretch == nullptr)
+    {
+        return;
+    }
+
+    // The stretch that was finished when Save was pressed, even if another's started since
+    auto stretch = mCompletedStretch;
     mFileChooser = std::make_unique<juce::FileChooser>("Please choose a destination for the file...",
                                                        File::getSpecialLocation(juce::File::userHomeDirectory),
                                                        "*.wav");
     auto folderChooserFlags = FileBrowserComponent::saveMode | FileBrowserComponent::canSelectFiles;
-    mFileChooser->launchAsync(folderChooserFlags, [this](const juce::FileChooser& chooser)
+    mFileChooser->launchAsync(folderChooserFlags, [stretch](const juce::FileChooser& chooser)
                               {
                                   auto file(chooser.getResult());
-                                  if(!mStretchedFile.getFile().copyFileTo(file))
+                                  if(!stretch->writeToFile(file))
                                   {
                                       std::cerr << "Saving file to " << file.getFullPathName() << " failed!\n";
                                   }
@@ -232,38 +274,40 @@ void MainComponent::changeListenerCallback(juce::ChangeBroadcaster* source)
 
 void MainComponent::performOfflineStretch()
 {
+    if(!mFileLoaded)
+    {
+        return;
+    }
+
     auto const stretchFactor = static_cast<float>(mStretchFactorSlider.getValue());
     auto const pitchFactor = static_cast<float>(mPitchShiftSlider.getValue());
 
-    mStretchTask = std::make_unique<OfflineStretchProcessor>(mStretchedFile,
-                                                             mFileBuffer,
-                                                             stretchFactor,
-                                                             pitchFactor,
-                                                             static_cast<double>(mSampleRate),
-                                                             [this]()
-                                                             {
-                                                                 stretchComplete();
-                                                             });
+    mStretchScheduler.request(stretchFactor, pitchFactor);
+}
 
+void MainComponent::stretchStarted(StretchScheduler::Stretch stretch)
+{
+    // the transport has to let go of the old stretch before it's replaced
     changeState(Stopping);
-    mPlayButton.setEnabled(false);
-    mStretchButton.setEnabled(false);
+    mTransportSource.setSource(nullptr);
+
+    mStretchedSource = std::make_unique<StretchPreviewSource>(stretch);
+    mTransportSource.setSource(mStretchedSource.get(), 0, nullptr, stretch->getSampleRate());
 
-    mStretchTask->launchThread();
+    mStretchProgress = 0.0;
+    mPlayButton.setEnabled(true);
+
+    // Whatever finished before is for other settings
+    setCompletedStretch(nullptr);
 }
 
-void MainComponent::stretchComplete()
+void MainComponent::stretchComplete(StretchScheduler::Stretch stretch)
 {
-    std::cout << "Written to: " << mStretchedFile.getFile().getFullPathName() << "\n";
-
-    auto reader = std::unique_ptr<juce::AudioFormatReader>(mFormatManager.createReaderFor(mStretchedFile.getFile()));
-    if(reader != nullptr)
-    {
-        mPlayButton.setEnabled(true);
-        mStretchButton.setEnabled(true);
+    setCompletedStretch(stretch);
+}
 
-        auto newSource = std::make_unique<juce::AudioFormatReaderSource>(reader.release(), true);
-        mTransportSource.setSource(newSource.get(), 0, nullptr, mSampleRate);
-        mReaderSource.reset(newSource.release());
-    }
+void MainComponent::setCompletedStretch(StretchScheduler::Stretch stretch)
+{
+    mCompletedStretch = stretch;
+    mSaveButton.setEnabled(mCompletedStretch != nullptr);
 }
@@ -5,7 +5,7 @@
 // clang-format on
 
 #include "../../core/RingBuffer.h"
-#include "../../dsp/processors/OfflineStretcher.h"
+#include "../../dsp/processors/StretchScheduler.h"
 #include "../../ui/CustomLookAndFeel.h"
 
 
@@ -50,7 +50,11 @@ namespace OUS
 
         void changeListenerCallback(juce::ChangeBroadcaster* source) override;
 
-        void stretchComplete();
+        void stretchStarted(StretchScheduler::Stretch stretch);
+        void stretchComplete(StretchScheduler::Stretch stretch);
+
+        /** What Save writes, nullptr (disabling Save) while there's no finished stretch of the current settings */
+        void setCompletedStretch(StretchScheduler::Stretch stretch);
 
         //==============================================================================
         juce::TextButton mOpenButton;
@@ -63,20 +67,23 @@ namespace OUS
         juce::TextButton mPlayButton;
         juce::TextButton mStopButton;
 
-        std::unique_ptr<juce::AudioFormatReaderSource> mReaderSource;
+        double mStretchProgress = 0.0;
+        juce::ProgressBar mStretchProgressBar{mStretchProgress};
+
+        // Plays the stretch as it comes in, mCompletedStretch is the last one to finish (for saving)
+        std::unique_ptr<StretchPreviewSource> mStretchedSource;
+        StretchScheduler::Stretch mCompletedStretch;
 
         juce::AudioFormatManager mFormatManager;
         juce::AudioTransportSource mTransportSource;
-        juce::AudioSampleBuffer mFileBuffer;
-
-        juce::TemporaryFile mStretchedFile{".wav"};
+        bool mFileLoaded = false;
 
         TransportState mState;
 
         int mBlockSize;
         int mSampleRate;
 
-        std::unique_ptr<OfflineStretchProcessor> mStretchTask = nullptr;
+        StretchScheduler mStretchScheduler;
         std::unique_ptr<juce::FileChooser> mFileChooser = nullptr;
 
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MainComponent)
@@ -47,8 +47,10 @@ void MainComponent::prepareToPlay(int samplesPerBlockExpected, double sampleRate
 
 void MainComponent::getNextAudioBlock(const AudioSourceChannelInfo& bufferToFill)
 {
+    // Only the region asked for, the processor works on the whole buffer it's given
+    juce::AudioBuffer<float> block(bufferToFill.buffer->getArrayOfWritePointers(), bufferToFill.buffer->getNumChannels(), bufferToFill.startSample, bufferToFill.numSamples);
     MidiBuffer midiBuffer;
-    mStretchProcessor.processBlock(*bufferToFill.buffer, midiBuffer);
+    mStretchProcessor.processBlock(block, midiBuffer);
 }
 
 void MainComponent::releaseResources()
@@ -76,7 +78,6 @@ void MainComponent::resized()
 
 void MainComponent::stretchValueChanged()
 {
-    // TODO: Not thread safe...
     mStretchProcessor.setStretchFactor(static_cast<float>(mStretchFactorSlider.getValue()));
 }
 
@@ -0,0 +1,165 @@
+#pragma once
+
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+#include "../dependencies/rubberband/rubberband/RubberBandStretcher.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace OUS
+{
+    //==============================================================================
+    /*
+    RatioCommandQueue
+
+    Gets time / pitch ratio changes to a real time RubberBandStretcher, which
+    has to have them made on the thread that's processing it.
+
+    Changes are pushed from one other thread (e.g. the message thread) onto a
+    lock free single producer / single consumer queue, which the audio thread
+    drains at the top of each block. A change isn't made in one go, the ratio
+    ramps to it over rampSeconds (in equal steps of ratio, so it sounds even)
+    and is applied to the stretcher before each chunk of input it's given.
+    */
+    class RatioCommandQueue
+    {
+    public:
+        enum class Ratio
+        {
+            Time,
+            Pitch
+        };
+
+        static constexpr int capacity = 64;
+        static constexpr double rampSeconds = 0.05;
+
+        /** Before processing starts. Drops anything queued and jumps straight to the ratios
+            (they're applied to the stretcher with the first chunk) */
+        void prepare(double sampleRate, double timeRatio, double pitchScale)
+        {
+            mFifo.reset();
+            mRampSamples = std::max(1, static_cast<int>(rampSeconds * sampleRate));
+            mTime.jumpTo(timeRatio);
+            mPitch.jumpTo(pitchScale);
+        }
+
+        /** The one producer thread. Returns false if the queue is full, i.e. nothing's draining it */
+        bool push(Ratio ratio, double value)
+        {
+            auto const scope = mFifo.write(1);
+            if(scope.blockSize1 == 0)
+            {
+                return false;
+            }
+
+            mCommands[static_cast<size_t>(scope.startIndex1)] = {ratio, value};
+            return true;
+        }
+
+        /** Audio thread, at the top of each block. Starts ramping to the latest change to each ratio */
+        void drain()
+        {
+            auto const scope = mFifo.read(mFifo.getNumReady());
+            scope.forEach([this](int index)
+                          {
+                              auto const& command = mCommands[static_cast<size_t>(index)];
+                              rampTo(command.ratio, command.value);
+                          });
+        }
+
+        /** Audio thread. For changes that are already on it (e.g. host automation) */
+        void rampTo(Ratio ratio, double value)
+        {
+            getRamp(ratio).start(value, mRampSamples);
+        }
+
+        /** Audio thread. Goes straight to value, no ramp (e.g. when the stretcher's started
+            again, and has nothing to ramp from) */
+        void jumpTo(Ratio ratio, double value)
+        {
+            getRamp(ratio).jumpTo(value);
+        }
+
+        /** Where the ratio is ramping to */
+        double getTarget(Ratio ratio) const
+        {
+            return ratio == Ratio::Time ? mTime.target : mPitch.target;
+        }
+
+        /** Audio thread, before each chunk of input given to the stretcher. Applies the
+            ratios as far as they've ramped, then moves the ramps on past the chunk */
+        void apply(RubberBand::RubberBandStretcher& stretcher, int numSamples)
+        {
+            if(mTime.current != mTime.applied)
+            {
+                stretcher.setTimeRatio(mTime.current);
+                mTime.applied = mTime.current;
+            }
+
+            if(mPitch.current != mPitch.applied)
+            {
+                stretcher.setPitchScale(mPitch.current);
+                mPitch.applied = mPitch.current;
+            }
+
+            mTime.advance(numSamples);
+            mPitch.advance(numSamples);
+        }
+
+    private:
+        struct Command
+        {
+            Ratio ratio = Ratio::Time;
+            double value = 1.0;
+        };
+
+        struct Ramp
+        {
+            double current = 1.0;
+            double target = 1.0;
+            double step = 1.0; // per sample
+            int remaining = 0;
+            double applied = 0.0; // what the stretcher has, 0 until it's first applied
+
+            void jumpTo(double value)
+            {
+                current = target = value;
+                remaining = 0;
+                applied = 0.0;
+            }
+
+            void start(double value, int numSamples)
+            {
+                target = value;
+                remaining = numSamples;
+                step = std::pow(target / current, 1.0 / numSamples);
+            }
+
+            void advance(int numSamples)
+            {
+                if(remaining <= numSamples)
+                {
+                    current = target;
+                    remaining = 0;
+                    return;
+                }
+
+                current *= std::pow(step, numSamples);
+                remaining -= numSamples;
+            }
+        };
+
+        Ramp& getRamp(Ratio ratio) { return ratio == Ratio::Time ? mTime : mPitch; }
+
+        juce::AbstractFifo mFifo{capacity};
+        std::array<Command, capacity> mCommands;
+
+        int mRampSamples = 1;
+        Ramp mTime;
+        Ramp mPitch;
+    };
+} // namespace OUS
@@ -20,13 +20,20 @@ ReferenceCountedForwardAndReverseBuffer::ReferenceCountedForwardAndReverseBuffer
     std::cout << "Buffer named: '" << mName << "' constructed. numChannels: " << formatReader->numChannels << ", numSamples" << formatReader->lengthInSamples << "\n";
     formatReader->read(&mForwardBuffer, 0, static_cast<int>(formatReader->lengthInSamples), 0, true, true);
 
-    for(auto ch = 0; ch < mReverseBuffer.getNumChannels(); ++ch)
-    {
-        mReverseBuffer.copyFrom(ch, 0, mForwardBuffer, ch, 0, mReverseBuffer.getNumSamples());
-        mReverseBuffer.reverse(ch, 0, mReverseBuffer.getNumSamples());
-    }
+    createReverseBuffer();
+}
 
-    mActiveBuffer = &mForwardBuffer;
+ReferenceCountedForwardAndReverseBuffer::ReferenceCountedForwardAndReverseBuffer(const juce::String& nameToUse, SegmentedStretch::Ptr stretch)
+: mName(nameToUse)
+, mStretch(std::move(stretch))
+// Refers to the result's channels rather than copying them. Nothing writes to the forward
+// buffer, it's only read from (played, reversed, stretched again)
+, mForwardBuffer(const_cast<float* const*>(mStretch->getResult().getArrayOfReadPointers()), mStretch->getResult().getNumChannels(), mStretch->getResult().getNumSamples())
+, mReverseBuffer(mForwardBuffer.getNumChannels(), mForwardBuffer.getNumSamples())
+{
+    std::cout << "Buffer named: '" << mName << "' constructed. numChannels: " << mForwardBuffer.getNumChannels() << ", numSamples" << mForwardBuffer.getNumSamples() << "\n";
+
+    createReverseBuffer();
 }
 
 ReferenceCountedForwardAndReverseBuffer::~ReferenceCountedForwardAndReverseBuffer()
@@ -35,6 +42,17 @@ ReferenceCountedForwardAndReverseBuffer::~ReferenceCountedForwardAndReverseBuffe
               << "\n";
 }
 
+void ReferenceCountedForwardAndReverseBuffer::createReverseBuffer()
+{
+    for(auto ch = 0; ch < mReverseBuffer.getNumChannels(); ++ch)
+    {
+        mReverseBuffer.copyFrom(ch, 0, mForwardBuffer, ch, 0, mReverseBuffer.getNumSamples());
+        mReverseBuffer.reverse(ch, 0, mReverseBuffer.getNumSamples());
+    }
+
+    mActiveBuffer = &mForwardBuffer;
+}
+
 int ReferenceCountedForwardAndReverseBuffer::getPosition() const
 {
     return mPosition.load();
@@ -12,6 +12,8 @@
 
 #include <JuceHeader.h>
 
+#include "../dsp/processors/OfflineStretcher.h"
+
 namespace OUS
 {
     class ReferenceCountedForwardAndReverseBuffer
@@ -21,6 +23,9 @@ namespace OUS
         typedef juce::ReferenceCountedObjectPtr<ReferenceCountedForwardAndReverseBuffer> Ptr;
 
         ReferenceCountedForwardAndReverseBuffer(const juce::String& nameToUse, juce::AudioFormatReader* formatReader);
+        /** Plays stretch's result forwards where it is (sharing it with whoever else holds
+            stretch, so it isn't copied), only the reverse is a buffer of its own */
+        ReferenceCountedForwardAndReverseBuffer(const juce::String& nameToUse, SegmentedStretch::Ptr stretch);
         ~ReferenceCountedForwardAndReverseBuffer();
 
         int getPosition() const;
@@ -32,7 +37,10 @@ namespace OUS
         juce::AudioSampleBuffer* getForwardAudioSampleBuffer();
 
     private:
+        void createReverseBuffer();
+
         juce::String mName;
+        SegmentedStretch::Ptr mStretch; // holds the forward samples, if they came from a stretch
         juce::AudioSampleBuffer mForwardBuffer;
         juce::AudioSampleBuffer mReverseBuffer;
 
@@ -14,6 +14,7 @@ public:
 					allpass();
 			void	setbuffer(float *buf, int size);
 	inline  float	process(float inp);
+	inline  void	processblock(float *inout, int numsamples);
 			void	mute();
 			void	setfeedback(float val);
 			float	getfeedback();
@@ -43,6 +44,37 @@ inline float allpass::process(float input)
 	return output;
 }
 
+// Block version of process (mdh). numsamples must not exceed
+// bufsize, so no sample written here is read back in the same
+// block and the loop has no dependency between iterations.
+// Unlike process() denormals are left to the caller (see
+// denormalguard) so the loop stays branch free.
+
+inline void allpass::processblock(float *inout, int numsamples)
+{
+	int first = bufsize - bufidx;
+	if(first > numsamples) first = numsamples;
+
+	float *buf = buffer + bufidx;
+	for(int i=0; i<first; i++)
+	{
+		float bufout = buf[i];
+		buf[i] = inout[i] + (bufout*feedback);
+		inout[i] = -inout[i] + bufout;
+	}
+
+	inout += first;
+	for(int i=0; i<numsamples-first; i++)
+	{
+		float bufout = buffer[i];
+		buffer[i] = inout[i] + (bufout*feedback);
+		inout[i] = -inout[i] + bufout;
+	}
+
+	bufidx += numsamples;
+	if(bufidx>=bufsize) bufidx -= bufsize;
+}
+
 #endif//_allpass
 
 //ends
\ No newline at end of file
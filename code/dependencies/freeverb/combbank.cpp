@@ -0,0 +1,194 @@
+// Comb filter bank implementation
+//
+// Part of the mdh modifications (see README.md)
+// http://theofficeofunspecifiedservices.com/
+// This code is (also) public domain
+
+#include "combbank.hpp"
+
+#include "transpose.h"
+
+#include <cstring>
+
+combbank::combbank()
+{
+	feedback = 0;
+	damp1 = 0;
+	damp2 = 1;
+
+	for(int lane=0; lane<numlanes; lane++)
+	{
+		filterstore[lane] = 0;
+		buffer[lane] = 0;
+		bufsize[lane] = 0;
+		bufidx[lane] = 0;
+	}
+}
+
+void combbank::setbuffer(int lane, float *buf, int size)
+{
+	buffer[lane] = buf;
+	bufsize[lane] = size;
+	bufidx[lane] = 0;
+}
+
+void combbank::gather(int numsamples)
+{
+// Gather each comb's delayed output for the whole block
+
+	for(int lane=0; lane<numlanes; lane++)
+	{
+		const float *buf = buffer[lane];
+		const int idx = bufidx[lane];
+		int first = bufsize[lane] - idx;
+		if(first > numsamples) first = numsamples;
+
+		std::memcpy(laneblock[lane], buf + idx, first*sizeof(float));
+		std::memcpy(laneblock[lane] + first, buf, (numsamples-first)*sizeof(float));
+	}
+	transpose(&laneblock[0][0], maxblock, &readblock[0][0], numlanes, numlanes, numsamples);
+}
+
+void combbank::scatter(int numsamples)
+{
+// Scatter the new input back into each comb
+
+	transpose(&writeblock[0][0], numlanes, &laneblock[0][0], maxblock, numsamples, numlanes);
+	for(int lane=0; lane<numlanes; lane++)
+	{
+		float *buf = buffer[lane];
+		int idx = bufidx[lane];
+		int first = bufsize[lane] - idx;
+		if(first > numsamples) first = numsamples;
+
+		std::memcpy(buf + idx, laneblock[lane], first*sizeof(float));
+		std::memcpy(buf, laneblock[lane] + first, (numsamples-first)*sizeof(float));
+
+		idx += numsamples;
+		if(idx >= bufsize[lane]) idx -= bufsize[lane];
+		bufidx[lane] = idx;
+	}
+}
+
+void combbank::processblock(const float *inputL, const float *inputR, float *outputL, float *outputR, int numsamples)
+{
+	const int half = numlanes/2;
+	int lane, n;
+
+	if(numsamples > maxblock) numsamples = maxblock;
+
+	gather(numsamples);
+
+	// Run the damping recursion across all lanes at once. The
+	// state is kept in locals so it can live in vector registers
+	alignas(32) float store[numlanes];
+	const float fb = feedback, d1 = damp1, d2 = damp2;
+
+	for(lane=0; lane<numlanes; lane++)
+		store[lane] = filterstore[lane];
+
+	for(n=0; n<numsamples; n++)
+	{
+		const float *out = readblock[n];
+		float *in = writeblock[n];
+		const float inL = inputL[n], inR = inputR[n];
+		float sumL = 0, sumR = 0;
+
+		for(lane=0; lane<numlanes; lane++)
+			store[lane] = (out[lane]*d2) + (store[lane]*d1);
+
+		for(lane=0; lane<half; lane++)
+			in[lane] = inL + (store[lane]*fb);
+		for(lane=half; lane<numlanes; lane++)
+			in[lane] = inR + (store[lane]*fb);
+
+		for(lane=0; lane<half; lane++)
+			sumL += out[lane];
+		for(lane=half; lane<numlanes; lane++)
+			sumR += out[lane];
+
+		outputL[n] = sumL;
+		outputR[n] = sumR;
+	}
+
+	for(lane=0; lane<numlanes; lane++)
+		filterstore[lane] = store[lane];
+
+	scatter(numsamples);
+}
+
+void combbank::processblock(const float *input, const float *taps, float *const *outputs, int numoutputs, int numsamples)
+{
+	int lane, n, o;
+
+	if(numsamples > maxblock) numsamples = maxblock;
+
+	gather(numsamples);
+
+	alignas(32) float store[numlanes];
+	const float fb = feedback, d1 = damp1, d2 = damp2;
+
+	for(lane=0; lane<numlanes; lane++)
+		store[lane] = filterstore[lane];
+
+	for(n=0; n<numsamples; n++)
+	{
+		const float *out = readblock[n];
+		float *in = writeblock[n];
+		const float x = input[n];
+
+		for(lane=0; lane<numlanes; lane++)
+		{
+			store[lane] = (out[lane]*d2) + (store[lane]*d1);
+			in[lane] = x + (store[lane]*fb);
+		}
+
+		// Each output is one dot product across the lanes
+		for(o=0; o<numoutputs; o++)
+		{
+			const float *tap = taps + o*numlanes;
+			float sum = 0;
+			for(lane=0; lane<numlanes; lane++)
+				sum += out[lane]*tap[lane];
+			outputs[o][n] = sum;
+		}
+	}
+
+	for(lane=0; lane<numlanes; lane++)
+		filterstore[lane] = store[lane];
+
+	scatter(numsamples);
+}
+
+void combbank::mute()
+{
+	for(int lane=0; lane<numlanes; lane++)
+	{
+		filterstore[lane] = 0;
+		for(int i=0; i<bufsize[lane]; i++)
+			buffer[lane][i] = 0;
+	}
+}
+
+void combbank::setdamp(float val)
+{
+	damp1 = val;
+	damp2 = 1-val;
+}
+
+float combbank::getdamp()
+{
+	return damp1;
+}
+
+void combbank::setfeedback(float val)
+{
+	feedback = val;
+}
+
+float combbank::getfeedback()
+{
+	return feedback;
+}
+
+//ends
@@ -0,0 +1,70 @@
+// Comb filter bank declaration
+//
+// Part of the mdh modifications (see README.md)
+// http://theofficeofunspecifiedservices.com/
+// This code is (also) public domain
+
+#ifndef _combbank_
+#define _combbank_
+
+#include "tuning.h"
+
+// Runs the left and right parallel combs together.
+//
+// Every comb in freeverb shares the same feedback and damping so
+// the bank keeps its per-comb state in structure-of-arrays form
+// (one lane per comb) and processes a block at a time. Within a
+// block the damping filter recursion runs across all the lanes at
+// once, which the compiler turns into SIMD, and the buffers are
+// read / written contiguously with the wrap handled once per block
+// rather than once per sample.
+//
+// The second form of processblock() feeds the same input to every
+// lane and produces any number of outputs, each a weighted sum of
+// all the lanes (taps holds numoutputs rows of numlanes weights).
+// This is how the multichannel outputs share the one set of combs.
+//
+// Blocks must be no longer than the shortest comb so that nothing
+// written during a block is read back within it. Denormals are
+// expected to be handled by the caller (see denormalguard).
+
+class combbank
+{
+public:
+	static const int	numlanes = numcombs*2;
+	static const int	maxblock = 64;
+
+					combbank();
+			void	setbuffer(int lane, float *buf, int size);
+			void	processblock(const float *inputL, const float *inputR, float *outputL, float *outputR, int numsamples);
+			void	processblock(const float *input, const float *taps, float *const *outputs, int numoutputs, int numsamples);
+			void	mute();
+			void	setdamp(float val);
+			float	getdamp();
+			void	setfeedback(float val);
+			float	getfeedback();
+private:
+			void	gather(int numsamples);
+			void	scatter(int numsamples);
+
+	float	feedback;
+	float	damp1;
+	float	damp2;
+
+	alignas(32) float	filterstore[numlanes];
+
+	float	*buffer[numlanes];
+	int		bufsize[numlanes];
+	int		bufidx[numlanes];
+
+	// Block scratch. The lane major copy is what is read from / written
+	// to the comb buffers, the sample major copies have one vector of
+	// lanes per row for the recursion
+	alignas(32) float	laneblock[numlanes][maxblock];
+	alignas(32) float	readblock[maxblock][numlanes];
+	alignas(32) float	writeblock[maxblock][numlanes];
+};
+
+#endif//_combbank_
+
+//ends
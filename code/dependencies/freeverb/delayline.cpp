@@ -5,28 +5,55 @@
 // This code is (also) public domain
 
 #include "delayline.hpp"
+#include <algorithm>
 #include <cmath>
 
-delayline::delayline()
+delayline::delayline(float maxDelayTime)
 {
     mBufferIdx = 0;
-    setDelayTime(30);
+    mDelay = 0;
+    mTargetDelay = 0;
+    mFadeDelay = 0;
+    mFading = false;
+    mFade = 0.0f;
+    mDelayTime = 30.0f;
+    mMaxDelayTime = maxDelayTime;
+
+    setSampleRate(44100.0f);
 }
 
 void delayline::setDelayTime(float ms)
 {
-    mBuffer.resize(int(std::ceil(ms/1000.0f * 44100.0f)), 0.0f); // For a 30 msec pre delay
-    
-    if(mBufferIdx >= mBuffer.size())
-    {
-        // This is a dumb naive approach, FIX
-        mBufferIdx = 0.0;
-    }
+    // Never allocates - the buffer already holds mMaxDelayTime
+    mDelayTime = ms < 0.0f ? 0.0f : (ms > mMaxDelayTime ? mMaxDelayTime : ms);
+    mTargetDelay = int(std::ceil(mDelayTime/1000.0f * mSampleRate));
 }
 
 float delayline::getDelayTime()
 {
-    return (mBuffer.size() / 44100.0f) * 1000.0f;
+    return mDelayTime;
 }
 
+float delayline::getMaxDelayTime()
+{
+    return mMaxDelayTime;
+}
+
+void delayline::setSampleRate(float sampleRate)
+{
+    // Not real time safe, this is the only place the buffer is sized
+    mSampleRate = sampleRate;
+    mBuffer.assign(int(std::ceil(mMaxDelayTime/1000.0f * mSampleRate)) + 1, 0.0f);
+    mBufferIdx = 0;
+    mFadeIncrement = 1.0f / std::fmax(1.0f, fadeTime/1000.0f * mSampleRate);
+
+    // Nothing to fade from in an empty buffer, so jump straight there
+    setDelayTime(mDelayTime);
+    mDelay = mTargetDelay;
+    mFading = false;
+}
 
+void delayline::clear()
+{
+    std::fill(mBuffer.begin(), mBuffer.end(), 0.0f);
+}
@@ -9,25 +9,80 @@
 
 #include <vector>
 
+// The buffer is allocated for the maximum delay time up front (and
+// again in setSampleRate) so that setDelayTime is safe to call from
+// the audio thread. Changing the delay doesn't move the read head
+// abruptly, instead it crossfades from the old read position to the
+// new one over fadeTime ms. Further changes made during a fade are
+// picked up once it completes.
+
 class delayline
 {
 public:
-    delayline();
+    static constexpr float fadeTime = 20.0f;
+
+    delayline(float maxDelayTime = 10000.0f);
     void setDelayTime(float ms);
     float getDelayTime();
+    float getMaxDelayTime();
+    void setSampleRate(float sampleRate);
+    void clear();
     inline float process(float inp);
     
 private:
+    inline float read(int delay) const;
+
     std::vector<float> mBuffer;
     int mBufferIdx;
+
+    int mDelay;         // current read head, in samples
+    int mTargetDelay;   // most recently requested delay, in samples
+    int mFadeDelay;     // read head being faded to
+    bool mFading;
+    float mFade;
+    float mFadeIncrement;
+
+    float mDelayTime;
+    float mMaxDelayTime;
+    float mSampleRate;
 };
 
+inline float delayline::read(int delay) const
+{
+    int idx = mBufferIdx - delay;
+    if(idx < 0)
+    {
+        idx += static_cast<int>(mBuffer.size());
+    }
+
+    return mBuffer[idx];
+}
+
 inline float delayline::process(float input)
 {
-    float output = mBuffer[mBufferIdx];
     mBuffer[mBufferIdx] = input;
+
+    if(!mFading && mTargetDelay != mDelay)
+    {
+        mFadeDelay = mTargetDelay;
+        mFade = 0.0f;
+        mFading = true;
+    }
+
+    float output = read(mDelay);
+    if(mFading)
+    {
+        output += (read(mFadeDelay) - output) * mFade;
+
+        mFade += mFadeIncrement;
+        if(mFade >= 1.0f)
+        {
+            mDelay = mFadeDelay;
+            mFading = false;
+        }
+    }
     
-    if(++mBufferIdx >= mBuffer.size())
+    if(++mBufferIdx >= static_cast<int>(mBuffer.size()))
     {
         mBufferIdx = 0;
     }
@@ -8,8 +8,60 @@
 #ifndef _denormals_
 #define _denormals_
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define _denormals_sse_
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define _denormals_aarch64_
+#endif
+
 #define undenormalise(sample) if(((*(unsigned int*)&sample)&0x7f800000)==0) sample=0.0f
 
+// Scoped flush-to-zero / denormals-are-zero
+//
+// Added for the block processed filter banks (mdh). Rather than
+// checking every sample in software the FPU is told to flush
+// denormals for the lifetime of the guard, and the previous mode
+// is restored afterwards so the host's state is left untouched.
+// On platforms without a known control register this does nothing.
+
+class denormalguard
+{
+public:
+	denormalguard()
+	{
+#if defined(_denormals_sse_)
+		state = _mm_getcsr();
+		_mm_setcsr(state | 0x8040); // FTZ | DAZ
+#elif defined(_denormals_aarch64_)
+		unsigned long fpcr;
+		__asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+		state = fpcr;
+		fpcr |= (1ul << 24); // FZ
+		__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#endif
+	}
+
+	~denormalguard()
+	{
+#if defined(_denormals_sse_)
+		_mm_setcsr(state);
+#elif defined(_denormals_aarch64_)
+		__asm__ __volatile__("msr fpcr, %0" : : "r"(state));
+#endif
+	}
+
+private:
+	denormalguard(const denormalguard&);
+	denormalguard& operator=(const denormalguard&);
+
+#if defined(_denormals_sse_)
+	unsigned int state;
+#elif defined(_denormals_aarch64_)
+	unsigned long state;
+#endif
+};
+
 #endif//_denormals_
 
 //ends
@@ -0,0 +1,239 @@
+// Feedback delay network reverb model implementation
+//
+// Part of the mdh modifications (see README.md)
+// http://theofficeofunspecifiedservices.com/
+// This code is (also) public domain
+
+#include "fdnmodel.hpp"
+
+#include "transpose.h"
+
+#include <cmath>
+#include <cstring>
+
+// Tunings indexed by line, in samples at tuningsamplerate
+static const int fdntuning[numfdnlines] = {fdntuning1,fdntuning2,fdntuning3,fdntuning4,fdntuning5,fdntuning6,fdntuning7,fdntuning8};
+
+// Signs the input is spread into the lines with, and each output channel
+// is tapped with. The taps are distinct rows of the Hadamard matrix so the
+// channels are decorrelated, the input is the row orthogonal to all of them
+static const float inputsign[numfdnlines] = {1,-1,-1,1,-1,1,1,-1};
+static const float tapsign[maxchannels][numfdnlines] = {
+	{1,-1,1,-1,1,-1,1,-1},
+	{1,1,-1,-1,1,1,-1,-1},
+	{1,-1,-1,1,1,-1,-1,1},
+	{1,1,1,1,-1,-1,-1,-1},
+	{1,-1,1,-1,-1,1,-1,1},
+	{1,1,-1,-1,-1,-1,1,1}
+};
+
+// Average length of the (left) revmodel combs, see updatefeedback()
+static const float combaverage = float(combtuningL1+combtuningL2+combtuningL3+combtuningL4+combtuningL5+combtuningL6+combtuningL7+combtuningL8)/numcombs;
+
+fdnmodel::fdnmodel()
+: reverbmodel(fdnfixedgain)
+{
+	// Size the arena once for the highest rate we support so
+	// that setsamplerate() never needs to allocate
+	int arenasize = 0;
+	for(int i=0; i<numfdnlines; i++)
+		arenasize += scaletuning(fdntuning[i],maxsamplerate);
+	for(int c=0; c<maxchannels; c++)
+		for(int i=0; i<numallpasses; i++)
+			arenasize += scaletuning(allpasstuning(c,i),maxsamplerate);
+	arena.assign(arenasize, 0.0f);
+
+	for(int i=0; i<numfdnlines; i++)
+	{
+		linegain[i] = 0;
+		filterstore[i] = 0;
+		bufidx[i] = 0;
+	}
+
+	// Tie the lines to their buffers
+	setbuffers();
+
+	for(int c=0; c<maxchannels; c++)
+		for(int i=0; i<numallpasses; i++)
+			allpasses[c][i].setfeedback(0.5f);
+
+	// Buffers will be full of rubbish - so we MUST mute them
+	mute();
+}
+
+void fdnmodel::mutefilters()
+{
+	for(int i=0; i<numfdnlines; i++)
+	{
+		filterstore[i] = 0;
+		std::memset(buffer[i], 0, bufsize[i]*sizeof(float));
+	}
+	for(int c=0; c<maxchannels; c++)
+		for(int i=0; i<numallpasses; i++)
+			allpasses[c][i].mute();
+}
+
+void fdnmodel::processwet(const float *input, float **wet, int numoutputs, int numsamples)
+{
+// Run one block of the (predelayed) mono input through the delay
+// network and allpasses, leaving numoutputs wet signals in wet.
+// As the block is no longer than the shortest line nothing written
+// in this block is read back within it, so each stage can run over
+// the whole block before the next
+
+	int i, n, idx, first;
+
+	// Gather each line's output for the whole block
+	for(i=0; i<numfdnlines; i++)
+	{
+		idx = bufidx[i];
+		first = bufsize[i] - idx;
+		if(first > numsamples) first = numsamples;
+
+		std::memcpy(lineblock[i], buffer[i] + idx, first*sizeof(float));
+		std::memcpy(lineblock[i] + first, buffer[i], (numsamples-first)*sizeof(float));
+	}
+
+	// Tap the outputs before the lines are damped
+	for(int c=0; c<numoutputs; c++)
+	{
+		float *out = wet[c];
+		for(n=0; n<numsamples; n++)
+			out[n] = 0;
+		for(i=0; i<numfdnlines; i++)
+		{
+			const float *line = lineblock[i];
+			const float s = tapsign[c][i];
+			for(n=0; n<numsamples; n++)
+				out[n] += line[n]*s;
+		}
+	}
+
+	// Run the damping recursion with one lane per line. The
+	// state is kept in locals so it can live in vector registers
+	transpose(&lineblock[0][0], maxblock, &laneblock[0][0], numfdnlines, numfdnlines, numsamples);
+
+	alignas(32) float store[numfdnlines];
+	const float d1 = curdamp, d2 = 1-curdamp;
+
+	for(i=0; i<numfdnlines; i++)
+		store[i] = filterstore[i];
+
+	for(n=0; n<numsamples; n++)
+	{
+		float *lane = laneblock[n];
+		for(i=0; i<numfdnlines; i++)
+		{
+			store[i] = (lane[i]*d2) + (store[i]*d1);
+			lane[i] = store[i];
+		}
+	}
+
+	for(i=0; i<numfdnlines; i++)
+		filterstore[i] = store[i];
+
+	transpose(&laneblock[0][0], numfdnlines, &lineblock[0][0], maxblock, numsamples, numfdnlines);
+
+	// Mix the lines with a fast Walsh-Hadamard transform, one butterfly
+	// stage per power of two. Each butterfly is a whole block wide
+	for(int half=1; half<numfdnlines; half*=2)
+	{
+		for(i=0; i<numfdnlines; i+=half*2)
+		{
+			for(int j=i; j<i+half; j++)
+			{
+				float *a = lineblock[j];
+				float *b = lineblock[j+half];
+				for(n=0; n<numsamples; n++)
+				{
+					const float x = a[n], y = b[n];
+					a[n] = x + y;
+					b[n] = x - y;
+				}
+			}
+		}
+	}
+
+	// Apply each line's decay (which also normalises the matrix),
+	// add the input and write everything back into the lines
+	for(i=0; i<numfdnlines; i++)
+	{
+		float *line = lineblock[i];
+		const float g = linegain[i], s = inputsign[i];
+		for(n=0; n<numsamples; n++)
+			line[n] = line[n]*g + input[n]*s;
+
+		idx = bufidx[i];
+		first = bufsize[i] - idx;
+		if(first > numsamples) first = numsamples;
+
+		std::memcpy(buffer[i] + idx, line, first*sizeof(float));
+		std::memcpy(buffer[i], line + first, (numsamples-first)*sizeof(float));
+
+		idx += numsamples;
+		if(idx >= bufsize[i]) idx -= bufsize[i];
+		bufidx[i] = idx;
+	}
+
+	// Feed through allpasses in series
+	for(int c=0; c<numoutputs; c++)
+		for(i=0; i<numallpasses; i++)
+			allpasses[c][i].processblock(wet[c], numsamples);
+}
+
+float fdnmodel::gettailloop()
+{
+// The lines decay at the rate of the average revmodel comb (see
+// updatefeedback), so the tail is as long as one of those takes
+
+	return combaverage;
+}
+
+void fdnmodel::updatefeedback()
+{
+// roomsize is the feedback of a revmodel comb. Give every line the
+// gain which decays at the same rate as the average comb does with
+// that feedback, so both models have the same tail length
+
+	// 1/sqrt(N) keeps the Hadamard matrix orthonormal (and so lossless)
+	const float norm = 1/std::sqrt(float(numfdnlines));
+	for(int i=0; i<numfdnlines; i++)
+		linegain[i] = norm*std::pow(curroomsize, fdntuning[i]/combaverage);
+}
+
+void fdnmodel::setbuffers()
+{
+// Carve the line and allpass buffers out of the arena,
+// scaling each tuning to the current sample rate
+
+	float *buf = arena.data();
+	int size;
+
+	// Blocks can't be longer than the shortest line or filter
+	blocksize = maxblock;
+	holdsamples = 0;
+
+	for(int i=0; i<numfdnlines; i++)
+	{
+		size = scaletuning(fdntuning[i],samplerate);
+		buffer[i] = buf;
+		bufsize[i] = size;
+		bufidx[i] = 0;
+		buf += size;
+		if(size < blocksize) blocksize = size;
+		if(size > holdsamples) holdsamples = size;
+	}
+
+	for(int c=0; c<maxchannels; c++)
+	{
+		for(int i=0; i<numallpasses; i++)
+		{
+			size = scaletuning(allpasstuning(c,i),samplerate);
+			allpasses[c][i].setbuffer(buf,size);
+			buf += size;
+			if(size < blocksize) blocksize = size;
+		}
+	}
+}
+
+//ends
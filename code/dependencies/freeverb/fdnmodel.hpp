@@ -0,0 +1,66 @@
+// Feedback delay network reverb model declaration
+//
+// Part of the mdh modifications (see README.md)
+// http://theofficeofunspecifiedservices.com/
+// This code is (also) public domain
+
+#ifndef _fdnmodel_
+#define _fdnmodel_
+
+#include "reverbmodel.hpp"
+#include "allpass.hpp"
+#include "tuning.h"
+
+#include <vector>
+
+// An alternative to the Schroeder/Moorer topology of revmodel, with
+// the same interface and parameters so the plugins can switch between
+// the two.
+//
+// numfdnlines delay lines feed back into each other through a Hadamard
+// matrix. Each line has a one pole damping filter, and a gain scaled to
+// its length so every line decays at the same rate. The room size maps
+// onto the same feedback (and so tail length) as the revmodel combs.
+// The output is tapped from the lines with orthogonal sign patterns for
+// left and right and then smoothed by the same allpasses as revmodel.
+// The multichannel process methods (see reverbmodel) tap up to maxchannels
+// outputs the same way, each with its own allpasses.
+//
+// It's laid out for SIMD from the start: the lines live in one arena,
+// the damping recursion runs with one lane per line, and the mixing
+// matrix is applied as butterflies across whole blocks of each line.
+
+class fdnmodel : public reverbmodel
+{
+public:
+					fdnmodel();
+protected:
+			void	processwet(const float *input, float **wet, int numoutputs, int numsamples);
+			void	setbuffers();
+			void	mutefilters();
+			void	updatefeedback();
+			float	gettailloop();
+private:
+	// Per line state, one lane per line
+	alignas(32) float	linegain[numfdnlines];
+	alignas(32) float	filterstore[numfdnlines];
+	float	*buffer[numfdnlines];
+	int		bufsize[numfdnlines];
+	int		bufidx[numfdnlines];
+
+	// One allpass chain per output channel, 0 and 1 are left and right
+	allpass	allpasses[maxchannels][numallpasses];
+
+	// Block scratch, line major for the matrix and the
+	// buffers, sample major for the damping recursion
+	alignas(32) float	lineblock[numfdnlines][maxblock];
+	alignas(32) float	laneblock[maxblock][numfdnlines];
+
+	// The delay lines and allpasses share one arena, allocated
+	// once for maxsamplerate like revmodel
+	std::vector<float>	arena;
+};
+
+#endif//_fdnmodel_
+
+//ends
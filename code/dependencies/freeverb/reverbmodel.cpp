@@ -0,0 +1,538 @@
+// Reverb model base implementation
+//
+// Part of the mdh modifications (see README.md)
+// http://theofficeofunspecifiedservices.com/
+// This code is (also) public domain
+
+#include "reverbmodel.hpp"
+
+#include "denormals.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static const int allpasstuningL[numallpasses] = {allpasstuningL1,allpasstuningL2,allpasstuningL3,allpasstuningL4};
+
+// Move value towards target by coeff, snapping once close enough.
+// Returns whether the value changed
+static inline bool chase(float &value, float target, float coeff)
+{
+	if(value == target)
+		return false;
+
+	value += (target-value)*coeff;
+	if(std::fabs(target-value) < 1e-6f)
+		value = target;
+
+	return true;
+}
+
+reverbmodel::reverbmodel(float value)
+: predelayLine(maxpredelay)
+{
+// The engine ties its filters to their buffers and mutes them,
+// which can't be done from here as it isn't constructed yet
+
+	enginegain = value;
+
+	idle = false;
+	silentsamples = 0;
+	quietsamples = 0;
+
+	samplerate = tuningsamplerate;
+	smoothcoeff = 1 - std::exp(-1/(smoothtime*samplerate));
+	blocksize = maxblock;
+	holdsamples = 0;
+
+	// Set default values
+	setwet(initialwet);
+	setroomsize(initialroom);
+	setdry(initialdry);
+	setdamp(initialdamp);
+	setwidth(initialwidth);
+	setmode(initialmode);
+
+	predelayLine.setDelayTime(1000);
+}
+
+reverbmodel::~reverbmodel()
+{
+}
+
+int reverbmodel::scaletuning(int tuning, float rate)
+{
+	int size = int(tuning * (rate / tuningsamplerate) + 0.5f);
+	return size > 0 ? size : 1;
+}
+
+int reverbmodel::allpasstuning(int channel, int i)
+{
+	return allpasstuningL[i] + channel*stereospread;
+}
+
+void reverbmodel::mute()
+{
+	// Nothing to smooth from after a reset
+	snap();
+
+	if (getmode() >= freezemode)
+		return;
+
+	mutefilters();
+}
+
+void reverbmodel::predelay(float *input, int numsamples, float gainstart, float gaininc)
+{
+// Gain the mono input and pass it through the delay line, in place
+
+	for(int n=0; n<numsamples; n++)
+		input[n] = predelayLine.process(input[n] * (gainstart + gaininc*(n+1)));
+}
+
+void reverbmodel::processreplace(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip)
+{
+	float input[maxblock];
+	float outL[maxblock];
+	float outR[maxblock];
+	float *wet[2] = {outL, outR};
+	denormalguard guard;
+
+	while(numsamples > 0)
+	{
+		int block = numsamples < blocksize ? int(numsamples) : blocksize;
+
+		// Ramp linearly from where the smoothed values were to where they are now
+		const float gain0 = curgain, wet10 = curwet1, wet20 = curwet2, dry0 = curdry;
+		smooth(block);
+		const float scale = 1.0f/block;
+		const float gaininc = (curgain-gain0)*scale;
+		const float wet1inc = (curwet1-wet10)*scale;
+		const float wet2inc = (curwet2-wet20)*scale;
+		const float dryinc = (curdry-dry0)*scale;
+
+		for(int n=0; n<block; n++)
+			input[n] = inputL[n*skip] + inputR[n*skip];
+		predelay(input, block, gain0, gaininc);
+		processwet(input, wet, 2, block);
+
+		// Calculate output REPLACING anything already there
+		for(int n=0; n<block; n++)
+		{
+			const float inL = *inputL, inR = *inputR;
+			const float w1 = wet10 + wet1inc*(n+1);
+			const float w2 = wet20 + wet2inc*(n+1);
+			const float d = dry0 + dryinc*(n+1);
+			*outputL = outL[n]*w1 + outR[n]*w2 + inL*d;
+			*outputR = outR[n]*w1 + outL[n]*w2 + inR*d;
+
+			// Increment sample pointers, allowing for interleave (if any)
+			inputL += skip;
+			inputR += skip;
+			outputL += skip;
+			outputR += skip;
+		}
+
+		numsamples -= block;
+	}
+}
+
+void reverbmodel::processmix(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip)
+{
+	float input[maxblock];
+	float outL[maxblock];
+	float outR[maxblock];
+	float *wet[2] = {outL, outR};
+	denormalguard guard;
+
+	while(numsamples > 0)
+	{
+		int block = numsamples < blocksize ? int(numsamples) : blocksize;
+
+		// Ramp linearly from where the smoothed values were to where they are now
+		const float gain0 = curgain, wet10 = curwet1, wet20 = curwet2, dry0 = curdry;
+		smooth(block);
+		const float scale = 1.0f/block;
+		const float gaininc = (curgain-gain0)*scale;
+		const float wet1inc = (curwet1-wet10)*scale;
+		const float wet2inc = (curwet2-wet20)*scale;
+		const float dryinc = (curdry-dry0)*scale;
+
+		for(int n=0; n<block; n++)
+			input[n] = inputL[n*skip] + inputR[n*skip];
+		predelay(input, block, gain0, gaininc);
+		processwet(input, wet, 2, block);
+
+		// Calculate output MIXING with anything already there
+		for(int n=0; n<block; n++)
+		{
+			const float inL = *inputL, inR = *inputR;
+			const float w1 = wet10 + wet1inc*(n+1);
+			const float w2 = wet20 + wet2inc*(n+1);
+			const float d = dry0 + dryinc*(n+1);
+			*outputL += outL[n]*w1 + outR[n]*w2 + inL*d;
+			*outputR += outR[n]*w1 + outL[n]*w2 + inR*d;
+
+			// Increment sample pointers, allowing for interleave (if any)
+			inputL += skip;
+			inputR += skip;
+			outputL += skip;
+			outputR += skip;
+		}
+
+		numsamples -= block;
+	}
+}
+
+void reverbmodel::processreplace(float **inputs, int numinputs, float **outputs, int numoutputs, long numsamples)
+{
+	processchannels(inputs, numinputs, outputs, numoutputs, numsamples, true);
+}
+
+void reverbmodel::processmix(float **inputs, int numinputs, float **outputs, int numoutputs, long numsamples)
+{
+	processchannels(inputs, numinputs, outputs, numoutputs, numsamples, false);
+}
+
+void reverbmodel::processreplace(double **inputs, int numinputs, double **outputs, int numoutputs, long numsamples)
+{
+	processchannels(inputs, numinputs, outputs, numoutputs, numsamples, true);
+}
+
+void reverbmodel::processmix(double **inputs, int numinputs, double **outputs, int numoutputs, long numsamples)
+{
+	processchannels(inputs, numinputs, outputs, numoutputs, numsamples, false);
+}
+
+template <typename sample>
+void reverbmodel::processchannels(sample **inputs, int numinputs, sample **outputs, int numoutputs, long numsamples, bool replace)
+{
+// The reverb itself always runs in float. With double buffers the
+// samples are converted as they're read and written, and the dry
+// signal is mixed back in at full precision
+
+	float input[maxblock];
+	sample dryblock[maxchannels][maxblock];
+	float out[maxchannels][maxblock];
+	float *wet[maxchannels];
+	denormalguard guard;
+
+	if (numinputs <= 0 || numoutputs <= 0)
+		return;
+	if (numinputs > maxchannels) numinputs = maxchannels;
+	if (numoutputs > maxchannels) numoutputs = maxchannels;
+
+	for(int c=0; c<numoutputs; c++)
+		wet[c] = out[c];
+
+	const sample inputscale = sample(2)/numinputs;
+	long offset = 0;
+
+	while(offset < numsamples)
+	{
+		int block = numsamples-offset < blocksize ? int(numsamples-offset) : blocksize;
+
+		// Take a copy of the inputs before any output (which might be
+		// the same buffer) is written, and mix them down for the reverb
+		float inputpeak = 0;
+		for(int c=0; c<numinputs; c++)
+		{
+			for(int n=0; n<block; n++)
+			{
+				dryblock[c][n] = inputs[c][offset+n];
+				inputpeak = std::max(inputpeak, float(std::fabs(dryblock[c][n])));
+			}
+		}
+
+		if (idle && inputpeak > silencethreshold)
+			wake();
+
+		// Nothing to reverberate and the tail has died away,
+		// so there's nothing to do but pass the dry signal
+		if (idle)
+		{
+			for(int c=0; c<numoutputs; c++)
+			{
+				const sample *dryin = dryblock[c % numinputs];
+				sample *output = outputs[c] + offset;
+
+				for(int n=0; n<block; n++)
+				{
+					if (replace)
+						output[n] = dryin[n]*dry;
+					else
+						output[n] += dryin[n]*dry;
+				}
+			}
+
+			offset += block;
+			continue;
+		}
+
+		// Ramp linearly from where the smoothed values were to where they are now
+		const float gain0 = curgain, wet10 = curwet1, wet20 = curwet2, dry0 = curdry;
+		smooth(block);
+		const float scale = 1.0f/block;
+		const float gaininc = (curgain-gain0)*scale;
+		const float wet1inc = (curwet1-wet10)*scale;
+		const float wet2inc = (curwet2-wet20)*scale;
+		const float dryinc = (curdry-dry0)*scale;
+
+		for(int n=0; n<block; n++)
+		{
+			sample sum = dryblock[0][n];
+			for(int c=1; c<numinputs; c++)
+				sum += dryblock[c][n];
+			input[n] = float(sum*inputscale);
+		}
+
+		predelay(input, block, gain0, gaininc);
+		processwet(input, wet, numoutputs, block);
+
+		float wetpeak = 0;
+		for(int c=0; c<numoutputs; c++)
+			for(int n=0; n<block; n++)
+				wetpeak = std::max(wetpeak, std::fabs(out[c][n]));
+		updateidle(block, inputpeak, wetpeak);
+
+		for(int c=0; c<numoutputs; c++)
+		{
+			const float *own = out[c];
+			const float *other = out[(c^1) < numoutputs ? (c^1) : c];
+			const sample *dryin = dryblock[c % numinputs];
+			sample *output = outputs[c] + offset;
+
+			for(int n=0; n<block; n++)
+			{
+				const float w1 = wet10 + wet1inc*(n+1);
+				const float w2 = wet20 + wet2inc*(n+1);
+				const float d = dry0 + dryinc*(n+1);
+				const sample value = own[n]*w1 + other[n]*w2 + dryin[n]*d;
+
+				if (replace)
+					output[n] = value;
+				else
+					output[n] += value;
+			}
+		}
+
+		offset += block;
+	}
+}
+
+void reverbmodel::updateidle(int numsamples, float inputpeak, float wetpeak)
+{
+// Go idle once the input has been silent long enough to have left the
+// predelay, and the tail has then stayed below the threshold for the
+// length of the longest recursive filter (so nothing louder is still
+// going round)
+
+	// Saturating, so a long silence while frozen can't overflow them
+	const long maxcount = 1L<<30;
+	silentsamples = inputpeak <= silencethreshold ? std::min(silentsamples + numsamples, maxcount) : 0;
+	quietsamples = wetpeak <= silencethreshold ? std::min(quietsamples + numsamples, maxcount) : 0;
+
+	const long predelaysamples = long(getpredelaytime() * samplerate / 1000);
+	if (mode < freezemode && silentsamples > predelaysamples + holdsamples && quietsamples >= holdsamples)
+		idle = true;
+}
+
+void reverbmodel::wake()
+{
+// Clear what's left of the tail (all below the threshold)
+// and start from the current parameters
+
+	idle = false;
+	silentsamples = 0;
+	quietsamples = 0;
+	mute();
+}
+
+bool reverbmodel::isidle()
+{
+	return idle;
+}
+
+float reverbmodel::gettaillength()
+{
+// The time for the engine's loop to decay from full scale to the
+// silence threshold, after the predelay. Frozen tails never end
+
+	if (roomsize1 >= 1)
+		return std::numeric_limits<float>::infinity();
+
+	const float loops = std::log(silencethreshold) / std::log(roomsize1);
+	return loops * gettailloop() / tuningsamplerate + getpredelaytime() / 1000;
+}
+
+void reverbmodel::update()
+{
+// Recalculate internal values after parameter change
+
+	wet1 = wet*(width/2 + 0.5f);
+	wet2 = wet*((1-width)/2);
+
+	if (mode >= freezemode)
+	{
+		roomsize1 = 1;
+		damp1 = 0;
+		gain = muted;
+	}
+	else
+	{
+		roomsize1 = roomsize;
+		damp1 = damp;
+		gain = enginegain;
+	}
+
+	// The engine picks these up as they are smoothed, see smooth()
+}
+
+void reverbmodel::snap()
+{
+// Jump the smoothed values straight to their targets
+
+	curgain = gain;
+	curwet1 = wet1;
+	curwet2 = wet2;
+	curdry = dry;
+	curroomsize = roomsize1;
+	curdamp = damp1;
+
+	updatefeedback();
+	updatedamp();
+}
+
+bool reverbmodel::smooth(int numsamples)
+{
+// Advance the smoothed values by a block of numsamples.
+// Returns whether anything is still moving
+
+	if (curgain == gain && curwet1 == wet1 && curwet2 == wet2 && curdry == dry && curroomsize == roomsize1 && curdamp == damp1)
+		return false;
+
+	const float coeff = 1 - std::pow(1 - smoothcoeff, float(numsamples));
+
+	chase(curgain, gain, coeff);
+	chase(curwet1, wet1, coeff);
+	chase(curwet2, wet2, coeff);
+	chase(curdry, dry, coeff);
+
+	if (chase(curroomsize, roomsize1, coeff))
+		updatefeedback();
+	if (chase(curdamp, damp1, coeff))
+		updatedamp();
+
+	return true;
+}
+
+void reverbmodel::updatedamp()
+{
+// Nothing to do for engines which read curdamp as they process
+}
+
+// The following get/set functions are not inlined, because
+// speed is never an issue when calling them, and also
+// because as you develop the reverb model, you may
+// wish to take dynamic action when they are called.
+
+void reverbmodel::setroomsize(float value)
+{
+	roomsize = (value*scaleroom) + offsetroom;
+	update();
+}
+
+float reverbmodel::getroomsize()
+{
+	return (roomsize-offsetroom)/scaleroom;
+}
+
+void reverbmodel::setdamp(float value)
+{
+	damp = value*scaledamp;
+	update();
+}
+
+float reverbmodel::getdamp()
+{
+	return damp/scaledamp;
+}
+
+void reverbmodel::setwet(float value)
+{
+	wet = value*scalewet;
+	update();
+}
+
+float reverbmodel::getwet()
+{
+	return wet/scalewet;
+}
+
+void reverbmodel::setdry(float value)
+{
+	dry = value*scaledry;
+}
+
+float reverbmodel::getdry()
+{
+	return dry/scaledry;
+}
+
+void reverbmodel::setwidth(float value)
+{
+	width = value;
+	update();
+}
+
+float reverbmodel::getwidth()
+{
+	return width;
+}
+
+void reverbmodel::setmode(float value)
+{
+	mode = value;
+	update();
+}
+
+float reverbmodel::getmode()
+{
+	if (mode >= freezemode)
+		return 1;
+	else
+		return 0;
+}
+
+void reverbmodel::setpredelaytime(float value)
+{
+	// Safe to automate, the delay line crossfades rather than reallocating
+	predelayLine.setDelayTime(value);
+}
+
+float reverbmodel::getpredelaytime()
+{
+	return predelayLine.getDelayTime();
+}
+
+void reverbmodel::setsamplerate(float value)
+{
+	if (value <= 0)
+		return;
+
+	samplerate = value < maxsamplerate ? value : maxsamplerate;
+	smoothcoeff = 1 - std::exp(-1/(smoothtime*samplerate));
+	setbuffers();
+
+	predelayLine.setSampleRate(samplerate);
+
+	// The filters now point at stale (differently sized) data
+	mute();
+}
+
+float reverbmodel::getsamplerate()
+{
+	return samplerate;
+}
+
+//ends
@@ -0,0 +1,137 @@
+// Reverb model base declaration
+//
+// Part of the mdh modifications (see README.md)
+// http://theofficeofunspecifiedservices.com/
+// This code is (also) public domain
+
+#ifndef _reverbmodel_
+#define _reverbmodel_
+
+#include "delayline.hpp"
+#include "tuning.h"
+
+// What revmodel and fdnmodel have in common: the parameters, their
+// smoothing, the predelay, the block by block process methods and the
+// silence detection. Each engine supplies only its wet path (processwet),
+// the buffers it carves out of its arena (setbuffers), clearing them
+// (mutefilters), applying the smoothed room size and damping, and the
+// loop its tail length is measured from.
+
+class reverbmodel
+{
+public:
+	static const int	maxblock = 64;
+
+					reverbmodel(float enginegain);
+	virtual			~reverbmodel();
+			void	mute();
+			void	processmix(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip);
+			void	processreplace(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip);
+
+			// Multichannel versions of the above, for mono in / stereo out and
+			// surround buses. The inputs are summed into the combs (scaled so a
+			// mono input is as loud as the same signal on both stereo inputs) and
+			// up to maxchannels outputs are tapped from them. Outputs are paired
+			// off for the width (0/1, 2/3, ...), a last unpaired output takes the
+			// whole wet signal. Output n's dry signal is input n, wrapping round
+			// if there are fewer inputs. Inputs may be the same buffers as outputs.
+			// The double versions read and write double buffers directly (for
+			// 64 bit hosts) with the dry signal kept at double precision, the
+			// reverb itself runs in float either way.
+			void	processmix(float **inputs, int numinputs, float **outputs, int numoutputs, long numsamples);
+			void	processreplace(float **inputs, int numinputs, float **outputs, int numoutputs, long numsamples);
+			void	processmix(double **inputs, int numinputs, double **outputs, int numoutputs, long numsamples);
+			void	processreplace(double **inputs, int numinputs, double **outputs, int numoutputs, long numsamples);
+			void	setroomsize(float value);
+			float	getroomsize();
+			void	setdamp(float value);
+			float	getdamp();
+			void	setwet(float value);
+			float	getwet();
+			void	setdry(float value);
+			float	getdry();
+			void	setwidth(float value);
+			float	getwidth();
+			void	setmode(float value);
+			float	getmode();
+			void	setpredelaytime(float value);
+			float	getpredelaytime();
+			void	setsamplerate(float value);
+			float	getsamplerate();
+
+			// The multichannel methods stop running the reverb once the input has
+			// been silent and the tail has decayed below silencethreshold, until
+			// there's input again. isidle() is whether they are currently doing
+			// that, gettaillength() the seconds from the end of the input until
+			// the tail reaches the threshold (infinite when frozen)
+			bool	isidle();
+			float	gettaillength();
+protected:
+			// Run one block (of at most blocksize samples) of the mono input,
+			// already gained and predelayed, leaving numoutputs wet signals in wet
+	virtual	void	processwet(const float *input, float **wet, int numoutputs, int numsamples) = 0;
+
+			// Point the filters into the arena at the current samplerate,
+			// setting blocksize (no longer than the shortest filter or
+			// maxblock) and holdsamples (the longest recursive filter)
+	virtual	void	setbuffers() = 0;
+
+			// Clear the filters. mute() doesn't call it when frozen
+	virtual	void	mutefilters() = 0;
+
+			// Pick up curroomsize / curdamp once they have moved. Per block,
+			// which is short enough (<= 64 samples) not to be heard
+	virtual	void	updatefeedback() = 0;
+	virtual	void	updatedamp();
+
+			// Length of the loop, in samples at tuningsamplerate, whose
+			// decay gettaillength() measures
+	virtual	float	gettailloop() = 0;
+
+	// Length of a filter buffer once its tuning is scaled to the given rate
+	static	int		scaletuning(int tuning, float rate);
+
+	// Each further output channel's allpasses are spread by another
+	// stereospread, so channel 1 has the original right tunings
+	static	int		allpasstuning(int channel, int i);
+
+	float	samplerate;
+	int		blocksize;
+	int		holdsamples;
+
+	// The values the process methods actually use. These chase
+	// the targets below (set by update()) once per block, and are
+	// ramped within the block, so parameter changes don't zipper
+	float	curgain,curwet1,curwet2,curdry,curroomsize,curdamp;
+private:
+			void	update();
+			void	snap();
+			bool	smooth(int numsamples);
+			void	predelay(float *input, int numsamples, float gainstart, float gaininc);
+			void	updateidle(int numsamples, float inputpeak, float wetpeak);
+			void	wake();
+	template <typename sample>
+			void	processchannels(sample **inputs, int numinputs, sample **outputs, int numoutputs, long numsamples, bool replace);
+private:
+	float	gain;
+	float	roomsize,roomsize1;
+	float	damp,damp1;
+	float	wet,wet1,wet2;
+	float	dry;
+	float	width;
+	float	mode;
+	float	enginegain;
+	float	smoothcoeff;
+
+	// Silence detection, see isidle()
+	bool	idle;
+	long	silentsamples,quietsamples;
+
+	// Single Delay line for predelay, shared by all
+	// channels as the input to the engine is mono
+	delayline	predelayLine;
+};
+
+#endif//_reverbmodel_
+
+//ends
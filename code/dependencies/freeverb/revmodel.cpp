@@ -6,269 +6,132 @@
 
 #include "revmodel.hpp"
 
+// Tunings indexed by filter, in samples at tuningsamplerate
+static const int combtuningL[numcombs] = {combtuningL1,combtuningL2,combtuningL3,combtuningL4,combtuningL5,combtuningL6,combtuningL7,combtuningL8};
+static const int combtuningR[numcombs] = {combtuningR1,combtuningR2,combtuningR3,combtuningR4,combtuningR5,combtuningR6,combtuningR7,combtuningR8};
+
+// Blocks are split for the base's scratch buffers, the combs must take them whole
+static_assert(combbank::maxblock >= reverbmodel::maxblock, "combbank::maxblock is shorter than a block");
+
+// The weights each output channel takes the comb lanes with (see combbank).
+// Left and right are the left and right combs, as in the original. The other
+// channels take every comb, with the signs of a row of the 16 point Hadamard
+// matrix that sums to zero over each half, so they are decorrelated from left,
+// right and each other. 1/sqrt(2) as they sum twice as many combs
+#define H 0.70710678f
+static const float combtaps[maxchannels][combbank::numlanes] = {
+	{1,1,1,1,1,1,1,1, 0,0,0,0,0,0,0,0},
+	{0,0,0,0,0,0,0,0, 1,1,1,1,1,1,1,1},
+	{H,-H,H,-H,H,-H,H,-H, H,-H,H,-H,H,-H,H,-H},
+	{H,H,-H,-H,H,H,-H,-H, H,H,-H,-H,H,H,-H,-H},
+	{H,H,H,H,-H,-H,-H,-H, H,H,H,H,-H,-H,-H,-H},
+	{H,-H,-H,H,-H,H,H,-H, H,-H,-H,H,-H,H,H,-H}
+};
+#undef H
+
 revmodel::revmodel()
-{
+: reverbmodel(fixedgain)
+{
+	// Size the arena once for the highest rate we support so
+	// that setsamplerate() never needs to allocate
+	int arenasize = 0;
+	for(int i=0; i<numcombs; i++)
+		arenasize += scaletuning(combtuningL[i],maxsamplerate) + scaletuning(combtuningR[i],maxsamplerate);
+	for(int c=0; c<maxchannels; c++)
+		for(int i=0; i<numallpasses; i++)
+			arenasize += scaletuning(allpasstuning(c,i),maxsamplerate);
+	arena.assign(arenasize, 0.0f);
+
 	// Tie the components to their buffers
-	combL[0].setbuffer(bufcombL1,combtuningL1);
-	combR[0].setbuffer(bufcombR1,combtuningR1);
-	combL[1].setbuffer(bufcombL2,combtuningL2);
-	combR[1].setbuffer(bufcombR2,combtuningR2);
-	combL[2].setbuffer(bufcombL3,combtuningL3);
-	combR[2].setbuffer(bufcombR3,combtuningR3);
-	combL[3].setbuffer(bufcombL4,combtuningL4);
-	combR[3].setbuffer(bufcombR4,combtuningR4);
-	combL[4].setbuffer(bufcombL5,combtuningL5);
-	combR[4].setbuffer(bufcombR5,combtuningR5);
-	combL[5].setbuffer(bufcombL6,combtuningL6);
-	combR[5].setbuffer(bufcombR6,combtuningR6);
-	combL[6].setbuffer(bufcombL7,combtuningL7);
-	combR[6].setbuffer(bufcombR7,combtuningR7);
-	combL[7].setbuffer(bufcombL8,combtuningL8);
-	combR[7].setbuffer(bufcombR8,combtuningR8);
-	allpassL[0].setbuffer(bufallpassL1,allpasstuningL1);
-	allpassR[0].setbuffer(bufallpassR1,allpasstuningR1);
-	allpassL[1].setbuffer(bufallpassL2,allpasstuningL2);
-	allpassR[1].setbuffer(bufallpassR2,allpasstuningR2);
-	allpassL[2].setbuffer(bufallpassL3,allpasstuningL3);
-	allpassR[2].setbuffer(bufallpassR3,allpasstuningR3);
-	allpassL[3].setbuffer(bufallpassL4,allpasstuningL4);
-	allpassR[3].setbuffer(bufallpassR4,allpasstuningR4);
+	setbuffers();
 
-	// Set default values
-	allpassL[0].setfeedback(0.5f);
-	allpassR[0].setfeedback(0.5f);
-	allpassL[1].setfeedback(0.5f);
-	allpassR[1].setfeedback(0.5f);
-	allpassL[2].setfeedback(0.5f);
-	allpassR[2].setfeedback(0.5f);
-	allpassL[3].setfeedback(0.5f);
-	allpassR[3].setfeedback(0.5f);
-	setwet(initialwet);
-	setroomsize(initialroom);
-	setdry(initialdry);
-	setdamp(initialdamp);
-	setwidth(initialwidth);
-	setmode(initialmode);
-    
-    predelayLineL.setDelayTime(1000);
-    predelayLineR .setDelayTime(1000);
+	for(int c=0; c<maxchannels; c++)
+		for(int i=0; i<numallpasses; i++)
+			allpasses[c][i].setfeedback(0.5f);
 
 	// Buffer will be full of rubbish - so we MUST mute them
 	mute();
 }
 
-void revmodel::mute()
-{
-	if (getmode() >= freezemode)
-		return;
-
-	for (int i=0;i<numcombs;i++)
-	{
-		combL[i].mute();
-		combR[i].mute();
-	}
-	for (auto i=0;i<numallpasses;i++)
-	{
-		allpassL[i].mute();
-		allpassR[i].mute();
-	}
-}
-
-void revmodel::processreplace(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip)
-{
-	float outL,outR,input,delayedInputL, delayedInputR;
-
-	while(numsamples-- > 0)
-	{
-		outL = outR = 0;
-		input = (*inputL + *inputR) * gain;
-        
-        // Pass everything through the delay line first
-        delayedInputL = predelayLineL.process(input);
-        delayedInputR = predelayLineR.process(input);
-
-		// Accumulate comb filters in parallel
-		for(int i=0; i<numcombs; i++)
-		{
-			outL += combL[i].process(delayedInputL);
-			outR += combR[i].process(delayedInputR);
-		}
-
-		// Feed through allpasses in series
-		for(auto i=0; i<numallpasses; i++)
-		{
-			outL = allpassL[i].process(outL);
-			outR = allpassR[i].process(outR);
-		}
-
-		// Calculate output REPLACING anything already there
-		*outputL = outL*wet1 + outR*wet2 + *inputL*dry;
-		*outputR = outR*wet1 + outL*wet2 + *inputR*dry;
-
-		// Increment sample pointers, allowing for interleave (if any)
-		inputL += skip;
-		inputR += skip;
-		outputL += skip;
-		outputR += skip;
-	}
-}
-
-void revmodel::processmix(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip)
+void revmodel::mutefilters()
 {
-	float outL,outR,input, delayedInputL, delayedInputR;
-
-	while(numsamples-- > 0)
-	{
-		outL = outR = 0;
-		input = (*inputL + *inputR) * gain;
-        
-        // Pass everything through the delay line first
-        delayedInputL = predelayLineL.process(input);
-        delayedInputR = predelayLineR.process(input);
-
-		// Accumulate comb filters in parallel
-		for(int i=0; i<numcombs; i++)
-		{
-			outL += combL[i].process(delayedInputL);
-            outR += combR[i].process(delayedInputR);
-		}
-
-		// Feed through allpasses in series
-		for(auto i=0; i<numallpasses; i++)
-		{
-			outL = allpassL[i].process(outL);
-			outR = allpassR[i].process(outR);
-		}
-
-		// Calculate output MIXING with anything already there
-		*outputL += outL*wet1 + outR*wet2 + *inputL*dry;
-		*outputR += outR*wet1 + outL*wet2 + *inputR*dry;
-
-		// Increment sample pointers, allowing for interleave (if any)
-		inputL += skip;
-		inputR += skip;
-		outputL += skip;
-		outputR += skip;
-	}
+	combs.mute();
+	for (auto c=0;c<maxchannels;c++)
+		for (auto i=0;i<numallpasses;i++)
+			allpasses[c][i].mute();
 }
 
-void revmodel::update()
+void revmodel::processwet(const float *input, float **wet, int numoutputs, int numsamples)
 {
-// Recalculate internal values after parameter change
-
-	int i;
-
-	wet1 = wet*(width/2 + 0.5f);
-	wet2 = wet*((1-width)/2);
+// Run one block of the (predelayed) mono input through
+// the combs and allpasses, leaving numoutputs wet signals in wet
 
-	if (mode >= freezemode)
-	{
-		roomsize1 = 1;
-		damp1 = 0;
-		gain = muted;
-	}
+	// Accumulate comb filters in parallel. Stereo has
+	// its own (cheaper) path as only it has no shared taps
+	if(numoutputs == 2)
+		combs.processblock(input, input, wet[0], wet[1], numsamples);
 	else
-	{
-		roomsize1 = roomsize;
-		damp1 = damp;
-		gain = fixedgain;
-	}
-
-	for(i=0; i<numcombs; i++)
-	{
-		combL[i].setfeedback(roomsize1);
-		combR[i].setfeedback(roomsize1);
-	}
-
-	for(i=0; i<numcombs; i++)
-	{
-		combL[i].setdamp(damp1);
-		combR[i].setdamp(damp1);
-	}
-}
-
-// The following get/set functions are not inlined, because
-// speed is never an issue when calling them, and also
-// because as you develop the reverb model, you may
-// wish to take dynamic action when they are called.
-
-void revmodel::setroomsize(float value)
-{
-	roomsize = (value*scaleroom) + offsetroom;
-	update();
-}
-
-float revmodel::getroomsize()
-{
-	return (roomsize-offsetroom)/scaleroom;
-}
-
-void revmodel::setdamp(float value)
-{
-	damp = value*scaledamp;
-	update();
-}
-
-float revmodel::getdamp()
-{
-	return damp/scaledamp;
-}
+		combs.processblock(input, &combtaps[0][0], wet, numoutputs, numsamples);
 
-void revmodel::setwet(float value)
-{
-	wet = value*scalewet;
-	update();
+	// Feed through allpasses in series
+	for(int c=0; c<numoutputs; c++)
+		for(int i=0; i<numallpasses; i++)
+			allpasses[c][i].processblock(wet[c], numsamples);
 }
 
-float revmodel::getwet()
+float revmodel::gettailloop()
 {
-	return wet/scalewet;
-}
+// The longest comb
 
-void revmodel::setdry(float value)
-{
-	dry = value*scaledry;
+	return combtuningR8;
 }
 
-float revmodel::getdry()
+void revmodel::updatefeedback()
 {
-	return dry/scaledry;
+	combs.setfeedback(curroomsize);
 }
 
-void revmodel::setwidth(float value)
+void revmodel::updatedamp()
 {
-	width = value;
-	update();
+	combs.setdamp(curdamp);
 }
 
-float revmodel::getwidth()
+void revmodel::setbuffers()
 {
-	return width;
-}
+// Carve the comb and allpass buffers out of the arena,
+// scaling each tuning to the current sample rate
 
-void revmodel::setmode(float value)
-{
-	mode = value;
-	update();
-}
+	float *buf = arena.data();
+	int size;
 
-float revmodel::getmode()
-{
-	if (mode >= freezemode)
-		return 1;
-	else
-		return 0;
-}
+	// Blocks can't be longer than the shortest filter
+	blocksize = maxblock;
+	holdsamples = 0;
 
-void revmodel::setpredelaytime(float value)
-{
-    predelayLineL.setDelayTime(value);
-    predelayLineR.setDelayTime(value);
-}
+	for(int i=0; i<numcombs; i++)
+	{
+		size = scaletuning(combtuningL[i],samplerate);
+		combs.setbuffer(i,buf,size);
+		buf += size;
+		if(size < blocksize) blocksize = size;
+
+		size = scaletuning(combtuningR[i],samplerate);
+		combs.setbuffer(numcombs+i,buf,size);
+		buf += size;
+		if(size < blocksize) blocksize = size;
+		if(size > holdsamples) holdsamples = size;
+	}
 
-float revmodel::getpredelaytime()
-{
-    return predelayLineL.getDelayTime();
+	for(int c=0; c<maxchannels; c++)
+	{
+		for(int i=0; i<numallpasses; i++)
+		{
+			size = scaletuning(allpasstuning(c,i),samplerate);
+			allpasses[c][i].setbuffer(buf,size);
+			buf += size;
+			if(size < blocksize) blocksize = size;
+		}
+	}
 }
 
 //ends
@@ -7,86 +7,42 @@
 #ifndef _revmodel_
 #define _revmodel_
 
-#include "comb.hpp"
+#include "reverbmodel.hpp"
+#include "combbank.hpp"
 #include "allpass.hpp"
 #include "tuning.h"
-#include "delayline.hpp"
 
-class revmodel
+#include <vector>
+
+// The original Schroeder/Moorer engine. Everything but the
+// filters themselves is shared with fdnmodel, see reverbmodel
+
+class revmodel : public reverbmodel
 {
 public:
 					revmodel();
-			void	mute();
-			void	processmix(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip);
-			void	processreplace(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip);
-			void	setroomsize(float value);
-			float	getroomsize();
-			void	setdamp(float value);
-			float	getdamp();
-			void	setwet(float value);
-			float	getwet();
-			void	setdry(float value);
-			float	getdry();
-			void	setwidth(float value);
-			float	getwidth();
-			void	setmode(float value);
-			float	getmode();
-            void    setpredelaytime(float value);
-            float   getpredelaytime();
-private:
-			void	update();
+protected:
+			void	processwet(const float *input, float **wet, int numoutputs, int numsamples);
+			void	setbuffers();
+			void	mutefilters();
+			void	updatefeedback();
+			void	updatedamp();
+			float	gettailloop();
 private:
-	float	gain;
-	float	roomsize,roomsize1;
-	float	damp,damp1;
-	float	wet,wet1,wet2;
-	float	dry;
-	float	width;
-	float	mode;
-
-	// The following are all declared inline 
-	// to remove the need for dynamic allocation
-	// with its subsequent error-checking messiness
-    
-    // Single Delay line for predelay in each channel
-    delayline predelayLineL;
-    delayline predelayLineR;
-
-	// Comb filters
-	comb	combL[numcombs];
-	comb	combR[numcombs];
+	// The filters are declared inline; their buffers
+	// are carved out of the arena below
 
-	// Allpass filters
-	allpass	allpassL[numallpasses];
-	allpass	allpassR[numallpasses];
+	// Comb filters, left and right processed together
+	combbank	combs;
 
-	// Buffers for the combs
-	float	bufcombL1[combtuningL1];
-	float	bufcombR1[combtuningR1];
-	float	bufcombL2[combtuningL2];
-	float	bufcombR2[combtuningR2];
-	float	bufcombL3[combtuningL3];
-	float	bufcombR3[combtuningR3];
-	float	bufcombL4[combtuningL4];
-	float	bufcombR4[combtuningR4];
-	float	bufcombL5[combtuningL5];
-	float	bufcombR5[combtuningR5];
-	float	bufcombL6[combtuningL6];
-	float	bufcombR6[combtuningR6];
-	float	bufcombL7[combtuningL7];
-	float	bufcombR7[combtuningR7];
-	float	bufcombL8[combtuningL8];
-	float	bufcombR8[combtuningR8];
+	// Allpass filters, one chain per output channel.
+	// Channels 0 and 1 are the original left and right
+	allpass	allpasses[maxchannels][numallpasses];
 
-	// Buffers for the allpasses
-	float	bufallpassL1[allpasstuningL1];
-	float	bufallpassR1[allpasstuningR1];
-	float	bufallpassL2[allpasstuningL2];
-	float	bufallpassR2[allpasstuningR2];
-	float	bufallpassL3[allpasstuningL3];
-	float	bufallpassR3[allpasstuningR3];
-	float	bufallpassL4[allpasstuningL4];
-	float	bufallpassR4[allpasstuningR4];
+	// Buffers for the combs and allpasses all live in a single
+	// arena allocated once for maxsamplerate, so changing the
+	// sample rate just re-points the filters into it
+	std::vector<float>	arena;
 };
 
 #endif//_revmodel_
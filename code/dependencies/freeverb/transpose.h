@@ -0,0 +1,77 @@
+// Block transpose used by the filter banks
+//
+// Part of the mdh modifications (see README.md)
+// http://theofficeofunspecifiedservices.com/
+// This code is (also) public domain
+
+#ifndef _transpose_
+#define _transpose_
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define _transpose_sse_
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define _transpose_neon_
+#endif
+
+// Transpose a rows x cols block of floats (src has srcstride floats
+// per row, dst has dststride). Done in 4x4 tiles where the platform
+// has a vector unit, since moving between the per line delay buffers
+// and the lane per line layout used for the recursions is most of the
+// cost of the banks.
+inline void transpose(const float *src, long srcstride, float *dst, long dststride, int rows, int cols)
+{
+	int r = 0, c = 0;
+
+#if defined(_transpose_sse_) || defined(_transpose_neon_)
+	for(r=0; r+4<=rows; r+=4)
+	{
+		for(c=0; c+4<=cols; c+=4)
+		{
+			const float *s = src + r*srcstride + c;
+			float *d = dst + c*dststride + r;
+#if defined(_transpose_sse_)
+			__m128 r0 = _mm_loadu_ps(s);
+			__m128 r1 = _mm_loadu_ps(s + srcstride);
+			__m128 r2 = _mm_loadu_ps(s + 2*srcstride);
+			__m128 r3 = _mm_loadu_ps(s + 3*srcstride);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(d, r0);
+			_mm_storeu_ps(d + dststride, r1);
+			_mm_storeu_ps(d + 2*dststride, r2);
+			_mm_storeu_ps(d + 3*dststride, r3);
+#else
+			float32x4x2_t t01 = vtrnq_f32(vld1q_f32(s), vld1q_f32(s + srcstride));
+			float32x4x2_t t23 = vtrnq_f32(vld1q_f32(s + 2*srcstride), vld1q_f32(s + 3*srcstride));
+			vst1q_f32(d, vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0])));
+			vst1q_f32(d + dststride, vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1])));
+			vst1q_f32(d + 2*dststride, vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0])));
+			vst1q_f32(d + 3*dststride, vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1])));
+#endif
+		}
+
+		// Ragged columns
+		for(int i=r; i<r+4; i++)
+		{
+			const float *s = src + i*srcstride;
+			float *d = dst + c*dststride + i;
+			for(int j=c; j<cols; j++, d+=dststride)
+				*d = s[j];
+		}
+	}
+#endif
+
+	// Ragged rows (or everything, without a vector unit)
+	for(; r<rows; r++)
+	{
+		const float *s = src + r*srcstride;
+		float *d = dst + r;
+		for(c=0; c<cols; c++, d+=dststride)
+			*d = s[c];
+	}
+}
+
+#endif//_transpose_
+
+//ends
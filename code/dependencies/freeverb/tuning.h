@@ -24,10 +24,19 @@ const float initialwidth	= 1;
 const float initialmode		= 0;
 const float freezemode		= 0.5f;
 const int	stereospread	= 23;
+const float	maxpredelay		= 10000; // ms
+const float	smoothtime		= 0.01f; // parameter smoothing time constant, seconds
+const int	maxchannels		= 6;	 // most outputs the multichannel process methods produce
+const float	silencethreshold	= 1e-5f; // -100dB, below which input and tail count as silent
+
+// The tunings below are given at this rate and scaled
+// at runtime by revmodel::setsamplerate(). Buffers are
+// allocated once up front for the maximum supported rate.
+const float	tuningsamplerate	= 44100.0f;
+const float	maxsamplerate		= 192000.0f;
 
 // These values assume 44.1KHz sample rate
-// they will probably be OK for 48KHz sample rate
-// but would need scaling for 96KHz (or other) sample rates.
+// (see tuningsamplerate above) and are scaled for others.
 // The values were obtained by listening tests.
 const int combtuningL1		= 1116;
 const int combtuningR1		= 1116+stereospread;
@@ -54,6 +63,19 @@ const int allpasstuningR3	= 341+stereospread;
 const int allpasstuningL4	= 225;
 const int allpasstuningR4	= 225+stereospread;
 
+// Feedback delay network (fdnmodel) line lengths, also at 44.1KHz.
+// Mutually prime and spread over the same range as the combs above.
+const int	numfdnlines		= 8;
+const float	fdnfixedgain	= 0.015f;
+const int fdntuning1		= 1087;
+const int fdntuning2		= 1187;
+const int fdntuning3		= 1283;
+const int fdntuning4		= 1361;
+const int fdntuning5		= 1447;
+const int fdntuning6		= 1549;
+const int fdntuning7		= 1613;
+const int fdntuning8		= 1733;
+
 #endif//_tuning_
 
 //ends
@@ -0,0 +1,227 @@
+#include "ConvolutionReverbProcessor.h"
+
+using namespace OUS;
+
+AudioProcessor* JUCE_CALLTYPE createPluginFilter()
+{
+    return new ConvolutionReverbProcessor();
+}
+
+ConvolutionReverbProcessor::ConvolutionReverbProcessor()
+: juce::AudioProcessor(BusesProperties().withInput("Input", juce::AudioChannelSet::stereo()).withOutput("Output", juce::AudioChannelSet::stereo()))
+, juce::Thread("Impulse Response Loader")
+, mState(*this, nullptr, "state",
+         {std::make_unique<juce::AudioParameterFloat>("wetdry", "Wet/Dry Mix", 0.0f, 1.0f, 0.5f)})
+{
+    mFormatManager.registerBasicFormats();
+    mDescription = "No impulse response loaded";
+
+    mState.state.addChild({"uiState", {{"width", 400}, {"height", 300}}, {}}, -1, nullptr);
+
+    startThread();
+}
+
+ConvolutionReverbProcessor::~ConvolutionReverbProcessor()
+{
+    stopThread(4000);
+}
+
+//==============================================================================
+bool ConvolutionReverbProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
+{
+    auto const& mainInput = layouts.getMainInputChannelSet();
+    return mainInput == layouts.getMainOutputChannelSet() && (mainInput == juce::AudioChannelSet::mono() || mainInput == juce::AudioChannelSet::stereo());
+}
+
+//==============================================================================
+void ConvolutionReverbProcessor::prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock)
+{
+    auto const sampleRateChanged = sampleRate != mSampleRate.load();
+    mSampleRate.store(sampleRate);
+
+    mDryBuffer.setSize(PartitionedConvolution::maxChannels, maximumExpectedSamplesPerBlock);
+    mWetDryMix.reset(sampleRate, 0.05);
+    mWetDryMix.setCurrentAndTargetValue(static_cast<float>(*mState.getRawParameterValue("wetdry")));
+
+    // The impulse response is resampled to the host rate on loading, so it has to be reloaded (or fetched from the cache)
+    auto const path = mState.state.getProperty("impulseResponse").toString();
+    if(sampleRateChanged && path.isNotEmpty())
+    {
+        loadImpulseResponse(juce::File(path));
+    }
+}
+
+void ConvolutionReverbProcessor::releaseResources()
+{
+}
+
+void ConvolutionReverbProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
+{
+    juce::ScopedNoDenormals noDenormals;
+
+    {
+        // If the loader is in the middle of swapping just carry on with the one we had
+        juce::SpinLock::ScopedTryLockType lock(mConvolutionLock);
+        if(lock.isLocked())
+        {
+            mActiveConvolution = mConvolution;
+        }
+    }
+
+    if(mActiveConvolution == nullptr)
+    {
+        return;
+    }
+
+    auto const numChannels = std::min(buffer.getNumChannels(), PartitionedConvolution::maxChannels);
+    auto const numSamples = buffer.getNumSamples();
+
+    mWetDryMix.setTargetValue(static_cast<float>(*mState.getRawParameterValue("wetdry")));
+    mActiveConvolution->setNonRealtime(isNonRealtime());
+
+    // In case the host exceeds the block size it promised, work through the block in pieces the dry buffer can hold
+    auto const maxBlock = std::max(1, mDryBuffer.getNumSamples());
+    for(int offset = 0; offset < numSamples; offset += maxBlock)
+    {
+        auto const blockSize = std::min(maxBlock, numSamples - offset);
+
+        float* channels[PartitionedConvolution::maxChannels] = {};
+        for(int ch = 0; ch < numChannels; ++ch)
+        {
+            channels[ch] = buffer.getWritePointer(ch, offset);
+            mDryBuffer.copyFrom(ch, 0, channels[ch], blockSize);
+        }
+
+        mActiveConvolution->process(channels, channels, numChannels, blockSize);
+
+        for(int i = 0; i < blockSize; ++i)
+        {
+            auto const mix = mWetDryMix.getNextValue();
+            for(int ch = 0; ch < numChannels; ++ch)
+            {
+                channels[ch][i] = (1.0f - mix) * mDryBuffer.getSample(ch, i) + mix * channels[ch][i];
+            }
+        }
+    }
+}
+
+//==============================================================================
+void ConvolutionReverbProcessor::loadImpulseResponse(juce::File const& file)
+{
+    mState.state.setProperty("impulseResponse", file.getFullPathName(), nullptr);
+
+    {
+        juce::ScopedLock lock(mPendingLock);
+        mPendingPath = file.getFullPathName();
+    }
+
+    notify();
+}
+
+juce::String ConvolutionReverbProcessor::getImpulseResponseDescription() const
+{
+    juce::ScopedLock lock(mPendingLock);
+    return mDescription;
+}
+
+double ConvolutionReverbProcessor::getTailLengthSeconds() const
+{
+    juce::SpinLock::ScopedLockType lock(mConvolutionLock);
+    if(mConvolution == nullptr)
+    {
+        return 0.0;
+    }
+
+    auto const& impulseResponse = mConvolution->getImpulseResponse();
+    return impulseResponse.getNumSamples() / impulseResponse.getSampleRate();
+}
+
+//==============================================================================
+void ConvolutionReverbProcessor::run()
+{
+    while(!threadShouldExit())
+    {
+        checkForImpulseResponseToLoad();
+        clearFreeConvolutions();
+        wait(500);
+    }
+}
+
+void ConvolutionReverbProcessor::checkForImpulseResponseToLoad()
+{
+    juce::String path;
+    {
+        juce::ScopedLock lock(mPendingLock);
+        path.swapWith(mPendingPath);
+    }
+
+    if(path.isEmpty())
+    {
+        return;
+    }
+
+    juce::String error;
+    auto impulseResponse = ImpulseResponse::load(juce::File(path), mFormatManager, mSampleRate.load(), error);
+
+    juce::String description;
+    if(impulseResponse != nullptr)
+    {
+        description = impulseResponse->getName();
+
+        PartitionedConvolution::Ptr convolution = new PartitionedConvolution(std::move(impulseResponse));
+        mConvolutions.add(convolution);
+
+        juce::SpinLock::ScopedLockType lock(mConvolutionLock);
+        mConvolution = convolution;
+    }
+    else
+    {
+        description = error;
+    }
+
+    {
+        juce::ScopedLock lock(mPendingLock);
+        mDescription = description;
+    }
+
+    sendChangeMessage();
+}
+
+void ConvolutionReverbProcessor::clearFreeConvolutions()
+{
+    // Only the array still holds it once neither the loader nor the audio thread use it
+    for(auto i = mConvolutions.size(); --i >= 0;)
+    {
+        PartitionedConvolution::Ptr convolution(mConvolutions.getUnchecked(i));
+        if(convolution->getReferenceCount() == 2)
+        {
+            mConvolutions.remove(i);
+        }
+    }
+}
+
+//==============================================================================
+void ConvolutionReverbProcessor::getStateInformation(MemoryBlock& destData)
+{
+    if(auto xml = mState.copyState().createXml())
+    {
+        copyXmlToBinary(*xml, destData);
+    }
+}
+
+void ConvolutionReverbProcessor::setStateInformation(const void* data, int sizeInBytes)
+{
+    auto xml = getXmlFromBinary(data, sizeInBytes);
+    if(xml == nullptr || !xml->hasTagName(mState.state.getType()))
+    {
+        return;
+    }
+
+    mState.replaceState(juce::ValueTree::fromXml(*xml));
+
+    auto const path = mState.state.getProperty("impulseResponse").toString();
+    if(path.isNotEmpty())
+    {
+        loadImpulseResponse(juce::File(path));
+    }
+}
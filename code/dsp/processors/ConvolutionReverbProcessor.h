@@ -0,0 +1,186 @@
+#pragma once
+
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+#include "../../ui/CustomLookAndFeel.h"
+#include "PartitionedConvolution.h"
+
+namespace OUS
+{
+    //==============================================================================
+    /*
+    ConvolutionReverbProcessor
+
+    The sampled counterpart to the algorithmic (revmodel) reverbs: convolves the input
+    with an impulse response captured in a real space, using PartitionedConvolution
+    so there is no latency and multi second responses run in real time.
+
+    Impulse responses are loaded (and resampled / transformed, or read back from the
+    cache) on a background thread. The new PartitionedConvolution is then swapped in
+    by reference, and the old one freed on the same background thread once the audio
+    thread has let go of it (the same approach as the SampleManager buffers).
+    */
+    class ConvolutionReverbProcessor
+    : public juce::AudioProcessor
+    , public juce::ChangeBroadcaster
+    , private juce::Thread
+    {
+    public:
+        //==============================================================================
+        ConvolutionReverbProcessor();
+        ~ConvolutionReverbProcessor() override;
+
+        //==============================================================================
+        bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
+
+        //==============================================================================
+        void prepareToPlay(double, int) override;
+        void releaseResources() override;
+        void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&) override;
+
+        //==============================================================================
+        /** Loads the impulse response asynchronously, sends a change message once it's in use (or failed) */
+        void loadImpulseResponse(juce::File const& file);
+
+        /** The name of the impulse response in use, or the error from the last load */
+        juce::String getImpulseResponseDescription() const;
+
+        //==============================================================================
+        juce::AudioProcessorEditor* createEditor() override { return new ConvolutionReverbPluginProcessorEditor(*this); }
+        bool hasEditor() const override { return true; }
+        const String getName() const override { return "ConvolutionReverb"; }
+        bool acceptsMidi() const override { return false; }
+        bool producesMidi() const override { return false; }
+        double getTailLengthSeconds() const override;
+        int getNumPrograms() override { return 1; }
+        int getCurrentProgram() override { return 0; }
+        void setCurrentProgram(int) override {}
+        const String getProgramName(int) override { return "None"; }
+        void changeProgramName(int, const String&) override {}
+        bool isVST2() const noexcept { return (wrapperType == wrapperType_VST); }
+
+        juce::AudioProcessorValueTreeState& getState() { return mState; }
+
+        //==============================================================================
+        void getStateInformation(MemoryBlock& destData) override;
+        void setStateInformation(const void* data, int sizeInBytes) override;
+
+    private:
+        //==============================================================================
+        class ConvolutionReverbPluginProcessorEditor
+        : public juce::AudioProcessorEditor
+        , private juce::ChangeListener
+        {
+        public:
+            ConvolutionReverbPluginProcessorEditor(ConvolutionReverbProcessor& owner)
+            : juce::AudioProcessorEditor(owner)
+            , mOwner(owner)
+            , mWetDrySlider("Mix", "")
+            , mWetDryAttachment(owner.getState(), "wetdry", mWetDrySlider)
+            {
+                addAndMakeVisible(mLoadButton);
+                mLoadButton.onClick = [this]()
+                {
+                    chooseImpulseResponse();
+                };
+
+                addAndMakeVisible(mNameLabel);
+                mNameLabel.setJustificationType(juce::Justification::centred);
+                mNameLabel.setText(mOwner.getImpulseResponseDescription(), juce::dontSendNotification);
+
+                addAndMakeVisible(&mWetDrySlider);
+                mWetDrySlider.mLabels.add({0.0f, "Dry"});
+                mWetDrySlider.mLabels.add({1.0f, "Wet"});
+
+                mOwner.addChangeListener(this);
+
+                setSize(400, 300);
+            }
+
+            ~ConvolutionReverbPluginProcessorEditor() override
+            {
+                mOwner.removeChangeListener(this);
+            }
+
+            void paint(juce::Graphics& g) override
+            {
+                g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
+            }
+
+            void resized() override
+            {
+                auto bounds = getLocalBounds().reduced(20, 20);
+
+                mLoadButton.setBounds(bounds.removeFromTop(30));
+                mNameLabel.setBounds(bounds.removeFromTop(30));
+                bounds.removeFromTop(10);
+                mWetDrySlider.setBounds(bounds);
+            }
+
+        private:
+            void chooseImpulseResponse()
+            {
+                mFileChooser = std::make_unique<juce::FileChooser>("Select an impulse response...",
+                                                                   juce::File::getSpecialLocation(juce::File::userHomeDirectory),
+                                                                   "*.wav;*.aif;*.aiff;*.flac");
+
+                auto const chooserFlags = juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles;
+                mFileChooser->launchAsync(chooserFlags, [this](juce::FileChooser const& chooser)
+                                          {
+                                              auto const file = chooser.getResult();
+                                              if(file != juce::File{})
+                                              {
+                                                  mNameLabel.setText("Loading " + file.getFileName() + "...", juce::dontSendNotification);
+                                                  mOwner.loadImpulseResponse(file);
+                                              }
+                                          });
+            }
+
+            // juce::ChangeListener
+            void changeListenerCallback(juce::ChangeBroadcaster*) override
+            {
+                mNameLabel.setText(mOwner.getImpulseResponseDescription(), juce::dontSendNotification);
+            }
+
+            ConvolutionReverbProcessor& mOwner;
+
+            juce::TextButton mLoadButton{"Load Impulse Response..."};
+            juce::Label mNameLabel;
+            RotarySliderWithLabels mWetDrySlider;
+
+            juce::AudioProcessorValueTreeState::SliderAttachment mWetDryAttachment;
+
+            std::unique_ptr<juce::FileChooser> mFileChooser = nullptr;
+        };
+
+        //==============================================================================
+        // juce::Thread
+        void run() override;
+
+        void checkForImpulseResponseToLoad();
+        void clearFreeConvolutions();
+
+        //==============================================================================
+        juce::AudioProcessorValueTreeState mState;
+        juce::AudioFormatManager mFormatManager;
+        std::atomic<double> mSampleRate{44100.0};
+
+        juce::CriticalSection mPendingLock;
+        juce::String mPendingPath;
+        juce::String mDescription;
+
+        // mConvolution is set by the loading thread, mActiveConvolution is the audio thread's copy of it
+        juce::SpinLock mConvolutionLock;
+        PartitionedConvolution::Ptr mConvolution;
+        PartitionedConvolution::Ptr mActiveConvolution;
+        juce::ReferenceCountedArray<PartitionedConvolution> mConvolutions;
+
+        juce::AudioSampleBuffer mDryBuffer;
+        juce::SmoothedValue<float> mWetDryMix;
+
+        //==============================================================================
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ConvolutionReverbProcessor)
+    };
+} // namespace OUS
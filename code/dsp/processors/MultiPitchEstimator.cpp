@@ -0,0 +1,230 @@
+#include "MultiPitchEstimator.h"
+
+using namespace OUS;
+
+namespace
+{
+    // Candidates a quarter semitone apart, each harmonic's peak looked for within an eighth
+    // of a semitone (or the nearest bin) either side
+    double const candidateRatio = std::pow(2.0, 1.0 / 48.0);
+    double const searchRatio = std::pow(2.0, 1.0 / 96.0);
+
+    // Once a pitch is found nothing within a semitone (or the main lobe) of it is, its
+    // remains are only residue
+    float const exclusionRatio = static_cast<float>(std::pow(2.0, 1.0 / 12.0) - 1.0);
+
+    int constexpr maxHarmonics = 20;
+
+    // Klapuri's harmonic weights, g(h) = (f0 + alpha) / (h f0 + beta)
+    float constexpr alpha = 52.0f;
+    float constexpr beta = 320.0f;
+
+    // Below this (scaled by the window size, about a -40dB sine) there's nothing to find
+    float constexpr silence = 1.0e-3f;
+
+    float getWeight(float frequency, int harmonic)
+    {
+        return (frequency + alpha) / (static_cast<float>(harmonic) * frequency + beta);
+    }
+
+    int getOrder(int windowSize)
+    {
+        int order = 0;
+        while((1 << order) < windowSize)
+        {
+            ++order;
+        }
+
+        return order;
+    }
+} // namespace
+
+MultiPitchEstimator::MultiPitchEstimator(int windowSize, double sampleRate, float minFrequency, float maxFrequency)
+: mWindowSize(windowSize)
+, mFFT(getOrder(windowSize))
+, mFFTSize(mFFT.getSize())
+, mSampleRate(sampleRate)
+, mNumBins(mFFTSize / 2 + 1)
+, mBinWidth(static_cast<float>(sampleRate / mFFTSize))
+, mLobeBins(static_cast<int>(std::ceil(2.0 * mFFTSize / windowSize)))
+{
+    // Periodic, as for spectral analysis
+    mWindow.resize(static_cast<size_t>(windowSize));
+    for(int i = 0; i < windowSize; ++i)
+    {
+        mWindow[static_cast<size_t>(i)] = 0.5f - 0.5f * static_cast<float>(std::cos(juce::MathConstants<double>::twoPi * i / windowSize));
+    }
+
+    auto const binWidth = static_cast<double>(mBinWidth);
+    auto const nyquist = sampleRate / 2.0;
+    for(auto frequency = static_cast<double>(minFrequency); frequency <= maxFrequency; frequency *= candidateRatio)
+    {
+        mCandidates.push_back(static_cast<float>(frequency));
+        mHarmonicStarts.push_back(static_cast<int>(mHarmonics.size()));
+
+        // Where each harmonic's peak is looked for doesn't change, only what's there
+        for(int harmonic = 1; harmonic <= maxHarmonics && harmonic * frequency < nyquist; ++harmonic)
+        {
+            auto const centre = harmonic * frequency;
+            auto const spread = centre * (searchRatio - 1.0);
+            auto const first = std::max(0, static_cast<int>(std::floor((centre - spread) / binWidth + 0.5)));
+            auto const last = std::min(mNumBins - 1, static_cast<int>(std::floor((centre + spread) / binWidth + 0.5)));
+            mHarmonics.push_back({first, last, getWeight(static_cast<float>(frequency), harmonic)});
+        }
+    }
+
+    mHarmonicStarts.push_back(static_cast<int>(mHarmonics.size()));
+    mSaliences.assign(mCandidates.size(), 0.0f);
+    mMagnitudes.assign(static_cast<size_t>(2 * mFFTSize), 0.0f);
+}
+
+MultiPitchEstimator::Result MultiPitchEstimator::estimate(float const* window)
+{
+    juce::FloatVectorOperations::multiply(mMagnitudes.data(), window, mWindow.data(), mWindowSize);
+    std::fill(mMagnitudes.begin() + mWindowSize, mMagnitudes.end(), 0.0f);
+    mFFT.performFrequencyOnlyForwardTransform(mMagnitudes.data(), true);
+
+    Result result;
+    auto strongest = 0.0f;
+    while(result.numPitches < maxPitches)
+    {
+        // Cancelling only ever takes away, so a candidate already under the threshold stays there
+        auto const floor = relativeThreshold * strongest;
+        for(size_t candidate = 0; candidate < mCandidates.size(); ++candidate)
+        {
+            auto const frequency = mCandidates[candidate];
+            auto const excluded = std::any_of(result.pitches.begin(), result.pitches.begin() + result.numPitches, [this, frequency](float pitch)
+                                              { return std::abs(frequency - pitch) < std::max(exclusionRatio * std::min(frequency, pitch), static_cast<float>(mLobeBins) * mBinWidth); });
+            mSaliences[candidate] = excluded || (result.numPitches > 0 && mSaliences[candidate] < floor) ? 0.0f : getSalience(static_cast<int>(candidate));
+        }
+
+        auto const best = static_cast<int>(std::distance(mSaliences.begin(), std::max_element(mSaliences.begin(), mSaliences.end())));
+        auto const salience = mSaliences[static_cast<size_t>(best)];
+        if(result.numPitches == 0)
+        {
+            if(salience < silence * static_cast<float>(mWindowSize))
+            {
+                break;
+            }
+
+            strongest = salience;
+        }
+        else if(salience < relativeThreshold * strongest)
+        {
+            break;
+        }
+
+        result.pitches[static_cast<size_t>(result.numPitches)] = refine(best);
+        result.saliences[static_cast<size_t>(result.numPitches)] = salience / strongest;
+        ++result.numPitches;
+
+        cancel(best);
+    }
+
+    return result;
+}
+
+float MultiPitchEstimator::refine(int candidate) const
+{
+    auto const start = mHarmonicStarts[static_cast<size_t>(candidate)];
+    auto const end = mHarmonicStarts[static_cast<size_t>(candidate + 1)];
+
+    // Each harmonic's peak, between bins by parabolic interpolation of the log magnitudes,
+    // is a measure of the pitch, weighted by how much that harmonic counted
+    auto sum = 0.0f;
+    auto totalWeight = 0.0f;
+    for(auto index = start; index < end; ++index)
+    {
+        int bin = 0;
+        auto const peak = getPeak(mHarmonics[static_cast<size_t>(index)], bin);
+        if(bin <= 0 || bin >= mNumBins - 1)
+        {
+            continue;
+        }
+
+        auto const previous = mMagnitudes[static_cast<size_t>(bin - 1)];
+        auto const next = mMagnitudes[static_cast<size_t>(bin + 1)];
+        if(peak <= 0.0f || previous <= 0.0f || next <= 0.0f || peak < previous || peak < next)
+        {
+            continue;
+        }
+
+        auto const logPrevious = std::log(previous);
+        auto const logPeak = std::log(peak);
+        auto const logNext = std::log(next);
+        auto const curvature = logPrevious - 2.0f * logPeak + logNext;
+        auto const offset = curvature < 0.0f ? juce::jlimit(-0.5f, 0.5f, 0.5f * (logPrevious - logNext) / curvature) : 0.0f;
+
+        auto const harmonic = static_cast<float>(index - start + 1);
+        auto const weight = mHarmonics[static_cast<size_t>(index)].weight * peak;
+        sum += weight * (static_cast<float>(bin) + offset) * mBinWidth / harmonic;
+        totalWeight += weight;
+    }
+
+    return totalWeight > 0.0f ? sum / totalWeight : mCandidates[static_cast<size_t>(candidate)];
+}
+
+float MultiPitchEstimator::getSalience(int candidate) const
+{
+    auto salience = 0.0f;
+    for(auto index = mHarmonicStarts[static_cast<size_t>(candidate)]; index < mHarmonicStarts[static_cast<size_t>(candidate + 1)]; ++index)
+    {
+        auto const& harmonic = mHarmonics[static_cast<size_t>(index)];
+        int bin = 0;
+        salience += harmonic.weight * getPeak(harmonic, bin);
+    }
+
+    return salience;
+}
+
+void MultiPitchEstimator::cancel(int candidate)
+{
+    auto const start = mHarmonicStarts[static_cast<size_t>(candidate)];
+    auto const numHarmonics = mHarmonicStarts[static_cast<size_t>(candidate + 1)] - start;
+
+    // 1 based, with room for a 0 either side
+    std::array<float, maxHarmonics + 2> amplitudes{};
+    std::array<int, maxHarmonics + 2> bins{};
+    for(int harmonic = 1; harmonic <= numHarmonics; ++harmonic)
+    {
+        amplitudes[static_cast<size_t>(harmonic)] = getPeak(mHarmonics[static_cast<size_t>(start + harmonic - 1)], bins[static_cast<size_t>(harmonic)]);
+    }
+
+    // A note's harmonics fall off smoothly, so any one much above its neighbours is mostly
+    // someone else's, only the smoothed amplitude is taken out. Bar the fundamental, which
+    // goes completely (it'd otherwise be found again)
+    for(int harmonic = 1; harmonic <= numHarmonics; ++harmonic)
+    {
+        auto const amplitude = amplitudes[static_cast<size_t>(harmonic)];
+        if(amplitude <= 0.0f)
+        {
+            continue;
+        }
+
+        auto const neighbours = amplitudes[static_cast<size_t>(harmonic - 1)] + amplitudes[static_cast<size_t>(harmonic + 1)];
+        auto const smoothed = harmonic == 1 ? amplitude : std::min(amplitude, (amplitude + neighbours) / 3.0f);
+        auto const remaining = 1.0f - smoothed / amplitude;
+
+        auto const bin = bins[static_cast<size_t>(harmonic)];
+        for(int k = std::max(0, bin - mLobeBins); k <= std::min(mNumBins - 1, bin + mLobeBins); ++k)
+        {
+            mMagnitudes[static_cast<size_t>(k)] *= remaining;
+        }
+    }
+}
+
+float MultiPitchEstimator::getPeak(Harmonic const& harmonic, int& bin) const
+{
+    bin = harmonic.first;
+    auto peak = 0.0f;
+    for(int k = harmonic.first; k <= harmonic.last; ++k)
+    {
+        if(mMagnitudes[static_cast<size_t>(k)] > peak)
+        {
+            peak = mMagnitudes[static_cast<size_t>(k)];
+            bin = k;
+        }
+    }
+
+    return peak;
+}
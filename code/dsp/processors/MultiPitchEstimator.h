@@ -0,0 +1,93 @@
+#pragma once
+
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+#include <array>
+#include <vector>
+
+namespace OUS
+{
+    //==============================================================================
+    /*
+    MultiPitchEstimator
+
+    Several pitches at once (chords, overlapping notes) in a window of samples.
+
+    Harmonic summation with iterative cancellation (after Klapuri 2006): every
+    candidate pitch, a quarter semitone apart, scores the weighted sum of the
+    spectrum's peaks at its harmonics. The best is taken, its harmonics are
+    taken out of the spectrum (only as much of each as its neighbours have, so a
+    harmonic shared with another note keeps the rest), and it goes again (passing
+    over anything within a semitone of a pitch already found), until the best
+    left is under relativeThreshold of the first or there are maxPitches. Each
+    pitch found is refined from its harmonics' peaks, interpolated between bins.
+
+    The window is Hann windowed (its own length, in the time domain) and zero
+    padded to a power of two. That's an FFT of its own, YinPitchDetector's is of
+    the plain window and a Hann that isn't the transform's length can't be
+    applied to it afterwards. The main lobe is then 2 * fftSize / windowSize bins
+    either side of a peak.
+
+    Everything is allocated up front, estimate() can run on the audio thread.
+    */
+    class MultiPitchEstimator
+    {
+    public:
+        static constexpr int maxPitches = 6;
+        static constexpr float relativeThreshold = 0.3f;
+
+        struct Result
+        {
+            int numPitches = 0;
+            std::array<float, maxPitches> pitches{};   // Hz, strongest first
+            std::array<float, maxPitches> saliences{}; // relative to the strongest
+        };
+
+        /** Pitches from minFrequency to maxFrequency, in windows of windowSize samples */
+        MultiPitchEstimator(int windowSize, double sampleRate, float minFrequency, float maxFrequency);
+
+        /** The pitches in the windowSize samples in window */
+        Result estimate(float const* window);
+
+    private:
+        // Where a candidate's harmonic is looked for (bins, inclusive) and its weight
+        struct Harmonic
+        {
+            int first = 0;
+            int last = 0;
+            float weight = 0.0f;
+        };
+
+        /** The weighted sum of the peaks at candidate's harmonics */
+        float getSalience(int candidate) const;
+
+        /** candidate's pitch, from where its harmonics' peaks are */
+        float refine(int candidate) const;
+
+        /** Takes candidate's harmonics out of mMagnitudes */
+        void cancel(int candidate);
+
+        /** The largest magnitude where harmonic's looked for, and where it is */
+        float getPeak(Harmonic const& harmonic, int& bin) const;
+
+        int const mWindowSize;
+        juce::dsp::FFT mFFT;
+        int const mFFTSize;
+        double const mSampleRate;
+        int const mNumBins;
+        float const mBinWidth; // Hz
+        int const mLobeBins; // the Hann main lobe, either side of a peak's bin
+
+        std::vector<float> mWindow; // Hann, mWindowSize long
+
+        std::vector<float> mCandidates; // Hz
+        std::vector<Harmonic> mHarmonics;
+        std::vector<int> mHarmonicStarts; // each candidate's first in mHarmonics, and the end
+        std::vector<float> mSaliences;
+        std::vector<float> mMagnitudes; // the windowed samples, transformed in place
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MultiPitchEstimator)
+    };
+} // namespace OUS
@@ -1,201 +1,362 @@
 #include "OfflineStretcher.h"
 
+#include <cmath>
+
 using namespace OUS;
 
-OfflineStretchProcessor::OfflineStretchProcessor(TemporaryFile& file, juce::AudioSampleBuffer& stretchSrc, float stretchFactor, float pitchFactor, double sampleRate, std::function<void()> onThreadComplete)
-: juce::ThreadWithProgressWindow("Offline stretcher", true, false)
-, mFile(file)
-, mStretchSrc(stretchSrc)
+SegmentedStretch::SegmentedStretch(juce::AudioSampleBuffer const& source, double sampleRate, float stretchFactor, float pitchFactor, int numThreads)
+: mSource(&source)
+, mSampleRate(sampleRate)
 , mStretchFactor(stretchFactor)
 , mPitchShiftFactor(pitchFactor)
-, mOnThreadComplete(onThreadComplete)
+, mNumThreads(std::max(1, numThreads))
 {
-    std::unique_ptr<RubberBand::RubberBandStretcher> newBand(new RubberBand::RubberBandStretcher(static_cast<size_t>(sampleRate), static_cast<size_t>(2)));
-    mRubberBandStretcher.reset(newBand.release());
-}
+    auto const length = static_cast<juce::int64>(source.getNumSamples());
+    auto const minSegment = static_cast<juce::int64>(minSegmentSeconds * sampleRate);
 
-void OfflineStretchProcessor::run()
-{
-    auto const srcBufferLength = static_cast<size_t>(mStretchSrc.getNumSamples());
-    auto const srcChannels = static_cast<size_t>(mStretchSrc.getNumChannels());
-    if(!mRubberBandStretcher || srcBufferLength <= 0 || srcChannels <= 0)
+    auto numSegments = static_cast<juce::int64>(1);
+    if(mNumThreads > 1 && minSegment > 0 && length >= 2 * minSegment)
     {
-        return;
+        numSegments = std::min(length / minSegment, static_cast<juce::int64>(mNumThreads * 2));
     }
 
-    mRubberBandStretcher->reset();
-    mRubberBandStretcher->setTimeRatio(mStretchFactor);
-    mRubberBandStretcher->setPitchScale(mPitchShiftFactor);
+    auto const margin = numSegments > 1 ? static_cast<int>(marginSeconds * sampleRate) : 0;
+    mSegments.resize(static_cast<size_t>(numSegments));
+    for(juce::int64 i = 0; i < numSegments; ++i)
+    {
+        auto& segment = mSegments[static_cast<size_t>(i)];
+        segment.start = static_cast<int>(length * i / numSegments);
+        segment.end = static_cast<int>(length * (i + 1) / numSegments);
+        segment.readStart = std::max(0, segment.start - margin);
+        segment.readEnd = static_cast<int>(std::min(length, static_cast<juce::int64>(segment.end + margin)));
 
-    // 1. phase 1 is study
-    size_t sample = 0;
-    size_t percent = 0;
+        mTotalWork += 2 * static_cast<juce::int64>(segment.readEnd - segment.readStart);
+    }
+
+    mFinished.resize(mSegments.size(), false);
+    mOffsets.resize(mSegments.size(), 0);
+    mHalfFade = std::max(1, static_cast<int>(crossfadeSeconds * sampleRate * stretchFactor / 2.0));
+    mResult.setSize(source.getNumChannels(), toOutput(source.getNumSamples()), false, true);
+}
 
-    std::cout << "Phase 1: Studying " << srcBufferLength << " samples\n";
+SegmentedStretch::SegmentedStretch(juce::AudioSampleBuffer&& result, double sampleRate)
+: mSource(nullptr)
+, mSampleRate(sampleRate)
+, mStretchFactor(1.0f)
+, mPitchShiftFactor(1.0f)
+, mNumThreads(1)
+, mResult(std::move(result))
+{
+    mNumStitched = mSegments.size();
+    mNumReady = mResult.getNumSamples();
+}
 
-    auto constexpr bufferSize = static_cast<size_t>(1024);
-    while(sample < srcBufferLength)
+bool SegmentedStretch::run(std::function<bool()> const& shouldExit, std::function<void(double)> const& progress)
+{
+    if(mSource == nullptr || mSource->getNumSamples() <= 0 || mSource->getNumChannels() <= 0)
     {
-        auto const samplesThisTime = std::min(bufferSize, srcBufferLength - (sample));
+        return false;
+    }
 
-        juce::AudioSampleBuffer readBuffer(static_cast<int>(srcChannels), static_cast<int>(samplesThisTime));
-        for(size_t ch = 0; ch < srcChannels; ++ch)
-        {
-            readBuffer.copyFrom(static_cast<int>(ch), 0, mStretchSrc, static_cast<int>(ch), static_cast<int>(sample), static_cast<int>(samplesThisTime));
-        }
+    mSamplesDone = 0;
+    mCancelled = false;
 
-        auto const finalSamples = sample + bufferSize >= srcBufferLength;
+    // The segments are already stretched in parallel, so RubberBand's own
+    // threads would only compete with them. With one segment let it use them
+    auto const numSegments = static_cast<int>(mSegments.size());
+    auto const threading = numSegments == 1 && mNumThreads > 1 ? RubberBand::RubberBandStretcher::OptionThreadingAuto : RubberBand::RubberBandStretcher::OptionThreadingNever;
+    auto const options = RubberBand::RubberBandStretcher::OptionProcessOffline | threading;
 
-        std::cout << "Studying " << samplesThisTime << " samples\n";
-        if(finalSamples)
+    {
+        juce::ThreadPool pool(std::min(mNumThreads, numSegments));
+        for(size_t i = 0; i < mSegments.size(); ++i)
         {
-            std::cout << " final frames\n";
+            pool.addJob([this, i, options]()
+                        {
+                            if(stretchSegment(mSegments[i], options))
+                            {
+                                segmentFinished(i);
+                            }
+                        });
         }
-        mRubberBandStretcher->study(readBuffer.getArrayOfReadPointers(), samplesThisTime, finalSamples);
 
-        auto const p = static_cast<size_t>(static_cast<double>(sample) * 100.0 / static_cast<double>(srcBufferLength));
-        if(p > percent || sample == 0)
+        while(pool.getNumJobs() > 0)
         {
-            percent = p;
-            std::cout << "\r" << percent << "%\n";
-            setProgress(0.5 * static_cast<double>(percent)); // this is the first half of the overall
-        }
-
-        sample += samplesThisTime;
-    }
+            if(shouldExit != nullptr && shouldExit())
+            {
+                mCancelled = true;
+            }
 
-    std::cout << "Phase 1: Studying finished\n";
+            if(progress != nullptr)
+            {
+                progress(static_cast<double>(mSamplesDone.load()) / static_cast<double>(std::max(mTotalWork, static_cast<juce::int64>(1))));
+            }
 
-    // 2. phase 2 is stretch
-    sample = 0;
-    percent = 0;
+            juce::Thread::sleep(50);
+        }
+    }
 
-    std::cout << "Phase 2: Stretch Armstrong " << srcBufferLength << " samples\n";
+    return !mCancelled;
+}
 
-    // Create buffer based on estimated size...
-    auto stretchedBufferSize = static_cast<int>(srcBufferLength * mStretchFactor);
-    std::cout << "Estimated output buffer size: " << stretchedBufferSize << "\n";
-    mStretchedBuffer.setSize(static_cast<int>(srcChannels), stretchedBufferSize, false, true);
-    auto sampleOut = 0;
+bool SegmentedStretch::stretchSegment(Segment& segment, RubberBand::RubberBandStretcher::Options options)
+{
+    auto const numChannels = mSource->getNumChannels();
+    auto const length = static_cast<size_t>(segment.readEnd - segment.readStart);
+
+    RubberBand::RubberBandStretcher stretcher(static_cast<size_t>(mSampleRate), static_cast<size_t>(numChannels), options);
+    stretcher.setTimeRatio(mStretchFactor);
+    stretcher.setPitchScale(mPitchShiftFactor);
+    stretcher.setExpectedInputDuration(length);
+
+    // RubberBand reads straight from the source and writes straight into the output, no copies
+    std::vector<float const*> input(static_cast<size_t>(numChannels));
+    std::vector<float*> output(static_cast<size_t>(numChannels));
+    auto const pointInputAt = [&](size_t position)
+    {
+        for(int ch = 0; ch < numChannels; ++ch)
+        {
+            input[static_cast<size_t>(ch)] = mSource->getReadPointer(ch, segment.readStart + static_cast<int>(position));
+        }
+    };
 
-    while(sample < srcBufferLength)
+    // 1. phase 1 is study
+    for(size_t position = 0; position < length; position += chunkSize)
     {
-        auto const samplesThisTime = std::min(bufferSize, srcBufferLength - sample);
-        std::cout << "Reading file position: " << sample << ", to " << sample + samplesThisTime << "\n";
-        juce::AudioSampleBuffer readBuffer(static_cast<int>(srcChannels), static_cast<int>(samplesThisTime));
-        for(size_t ch = 0; ch < srcChannels; ++ch)
+        auto const samplesThisTime = std::min(chunkSize, length - position);
+        pointInputAt(position);
+        stretcher.study(input.data(), samplesThisTime, position + samplesThisTime >= length);
+
+        mSamplesDone += static_cast<juce::int64>(samplesThisTime);
+        if(mCancelled)
         {
-            readBuffer.copyFrom(static_cast<int>(ch), 0, mStretchSrc, static_cast<int>(ch), static_cast<int>(sample), static_cast<int>(samplesThisTime));
+            return false;
         }
+    }
 
-        std::cout << "Processing " << samplesThisTime << " samples\n";
-        auto const finalSamples = sample + bufferSize >= srcBufferLength;
-        mRubberBandStretcher->process(readBuffer.getArrayOfReadPointers(), samplesThisTime, finalSamples);
+    // Sized for what should come out, it then only grows if the estimate falls (a little) short
+    auto capacity = static_cast<int>(std::ceil(static_cast<double>(length) * stretcher.getTimeRatio())) + static_cast<int>(stretcher.getLatency() + chunkSize);
+    segment.output.setSize(numChannels, capacity, false, false, true);
+    auto written = 0;
 
-        auto const available = mRubberBandStretcher->available();
-        std::cout << "File buffer length: " << srcBufferLength << ", availableSamples: " << available << "\n";
-        if(available > 0)
+    // Returns what's available once it's all retrieved, -1 when the stretcher has finished
+    auto const retrieveAvailable = [&]()
+    {
+        auto available = stretcher.available();
+        while(available > 0)
         {
-            auto stretchedBuffer = juce::AudioBuffer<float>(static_cast<int>(srcChannels), available);
-            mRubberBandStretcher->retrieve(stretchedBuffer.getArrayOfWritePointers(), static_cast<size_t>(available));
+            if(written + available > capacity)
+            {
+                capacity = written + available + capacity / 8;
+                segment.output.setSize(numChannels, capacity, true, false, true);
+            }
 
-            if(sampleOut + available > stretchedBufferSize)
+            for(int ch = 0; ch < numChannels; ++ch)
             {
-                // we need to grow the buffer a bit
-                std::cout << "Increasing buffer size: " << stretchedBufferSize << " (orig) to " << (stretchedBufferSize + sampleOut + available) << "\n";
-                mStretchedBuffer.setSize(static_cast<int>(srcChannels), (stretchedBufferSize + sampleOut + available), true);
+                output[static_cast<size_t>(ch)] = segment.output.getWritePointer(ch, written);
             }
 
-            std::cout << "Writing to stretched buffer from position " << sampleOut << ", to " << sampleOut + available << "\n";
-            for(size_t ch = 0; ch < srcChannels; ++ch)
+            auto const retrieved = static_cast<int>(stretcher.retrieve(output.data(), static_cast<size_t>(available)));
+            for(int ch = 0; ch < numChannels; ++ch)
             {
-                for(int i = 0; i < available; ++i)
-                {
-                    auto value = std::max(-1.0f, std::min(1.0f, stretchedBuffer.getSample(static_cast<int>(ch), i)));
-                    mStretchedBuffer.addSample(static_cast<int>(ch), sampleOut + i, value);
-                }
+                juce::FloatVectorOperations::clip(output[static_cast<size_t>(ch)], output[static_cast<size_t>(ch)], -1.0f, 1.0f, retrieved);
             }
 
-            sampleOut += available;
+            written += retrieved;
+            available = stretcher.available();
         }
 
-        auto const p = static_cast<size_t>(static_cast<double>(sample) * 100.0 / static_cast<double>(srcBufferLength));
-        if(p > percent || sample == 0)
+        return available;
+    };
+
+    // 2. phase 2 is stretch
+    for(size_t position = 0; position < length; position += chunkSize)
+    {
+        auto const samplesThisTime = std::min(chunkSize, length - position);
+        pointInputAt(position);
+        stretcher.process(input.data(), samplesThisTime, position + samplesThisTime >= length);
+        retrieveAvailable();
+
+        mSamplesDone += static_cast<juce::int64>(samplesThisTime);
+        if(mCancelled)
         {
-            percent = static_cast<size_t>(p);
-            std::cout << "\r" << percent << "%\n";
+            return false;
+        }
+    }
 
-            setProgress(0.5 + 0.5 * static_cast<double>(percent)); // this is second half of the overall
+    // 3. phase 3 is whatever is still to come out (if RubberBand is threading it may not all be there yet)
+    while(retrieveAvailable() >= 0)
+    {
+        if(mCancelled)
+        {
+            return false;
         }
 
-        sample += samplesThisTime;
+        juce::Thread::yield();
     }
 
-    std::cout << "Phase 2: Stretch Armstrong finished\n";
+    segment.output.setSize(numChannels, written, true, false, true);
+    return true;
+}
+
+void SegmentedStretch::segmentFinished(size_t index)
+{
+    juce::ScopedLock lock(mStitchLock);
 
-    std::cout << "Phase 3: Remaining samples\n";
-    std::cout << "Num" << mRubberBandStretcher->available() << "\n";
-    while(mRubberBandStretcher->available() >= 0)
+    mFinished[index] = true;
+    while(mNumStitched < mSegments.size() && mFinished[mNumStitched])
     {
-        auto const availableSamples = mRubberBandStretcher->available();
+        stitchSegment(mNumStitched);
+        ++mNumStitched;
+    }
 
-        jassert(availableSamples >= 0);
+    // Everything up to where the next segment fades in is final
+    auto const outputLength = mResult.getNumSamples();
+    mNumReady = mNumStitched == mSegments.size() ? outputLength : juce::jlimit(0, outputLength, toOutput(mSegments[mNumStitched].start) - mHalfFade);
+}
 
-        std::cout << "Completing: number remaining: " << availableSamples << "\n";
-        auto stretchedBuffer = juce::AudioBuffer<float>(static_cast<int>(srcChannels), availableSamples);
-        mRubberBandStretcher->retrieve(stretchedBuffer.getArrayOfWritePointers(), static_cast<size_t>(availableSamples));
+void SegmentedStretch::stitchSegment(size_t index)
+{
+    auto& segment = mSegments[index];
+    auto const numChannels = mResult.getNumChannels();
+    auto const outputLength = mResult.getNumSamples();
 
-        if(sampleOut + availableSamples > stretchedBufferSize)
+    if(mSegments.size() == 1)
+    {
+        for(int ch = 0; ch < numChannels; ++ch)
         {
-            // we need to grow the buffer a bit
-            std::cout << "Increasing buffer size: " << stretchedBufferSize << " (orig) to " << (stretchedBufferSize + sampleOut + availableSamples) << "\n";
-            mStretchedBuffer.setSize(static_cast<int>(srcChannels), (stretchedBufferSize + sampleOut + availableSamples), true);
+            mResult.copyFrom(ch, 0, segment.output, ch, 0, std::min(outputLength, segment.output.getNumSamples()));
         }
 
-        std::cout << "Writing to stretched buffer from position " << sampleOut << ", to " << sampleOut + availableSamples << "\n";
-        for(size_t ch = 0; ch < srcChannels; ++ch)
+        segment.output = {};
+        return;
+    }
+
+    auto const first = index == 0;
+    auto const last = index + 1 == mSegments.size();
+    auto const fadeLength = 2 * mHalfFade;
+
+    // Each boundary is faded across, centred on where it falls in the output
+    auto const fadeInStart = toOutput(segment.start) - mHalfFade;
+    auto const fadeOutStart = toOutput(segment.end) - mHalfFade;
+
+    // The stretchers don't agree on the phase of what they output, so each segment is
+    // nudged to line up with the one before it over the crossfade (or they could cancel)
+    auto const nominal = toOutput(segment.readStart);
+    auto const maxShift = static_cast<int>(maxShiftSeconds * mSampleRate);
+    auto const offset = first ? nominal : nominal + findShift(mSegments[index - 1], mOffsets[index - 1], segment, nominal, fadeInStart, fadeLength, maxShift);
+    mOffsets[index] = offset;
+
+    auto const from = std::max(0, first ? 0 : fadeInStart);
+    auto const to = std::min(outputLength, last ? outputLength : fadeOutStart + fadeLength);
+
+    // The segment output may be a little shorter or longer than its share of the source
+    auto const begin = std::max(from, offset);
+    auto const end = std::min(to, offset + segment.output.getNumSamples());
+
+    for(int ch = 0; ch < numChannels; ++ch)
+    {
+        auto const* input = segment.output.getReadPointer(ch);
+        auto* output = mResult.getWritePointer(ch);
+        for(int q = begin; q < end; ++q)
         {
-            for(int i = 0; i < availableSamples; ++i)
+            // Once aligned the segments are coherent, so the gains sum to one (rather than their powers)
+            auto gain = 1.0;
+            if(!first && q < fadeInStart + fadeLength)
             {
-                auto value = std::max(-1.0f, std::min(1.0f, stretchedBuffer.getSample(static_cast<int>(ch), i)));
-                mStretchedBuffer.addSample(static_cast<int>(ch), sampleOut + i, value);
+                gain *= std::pow(std::sin(juce::MathConstants<double>::halfPi * (q - fadeInStart + 0.5) / fadeLength), 2.0);
             }
+            if(!last && q >= fadeOutStart)
+            {
+                gain *= std::pow(std::cos(juce::MathConstants<double>::halfPi * (q - fadeOutStart + 0.5) / fadeLength), 2.0);
+            }
+
+            output[q] += static_cast<float>(gain) * input[q - offset];
         }
+    }
+
+    // The one before is only needed to line this one up
+    if(!first)
+    {
+        mSegments[index - 1].output = {};
+    }
+    if(last)
+    {
+        segment.output = {};
+    }
+}
 
-        sampleOut += availableSamples;
+int SegmentedStretch::toOutput(int sourcePosition) const
+{
+    // Where a position in the source ends up in the output
+    return static_cast<int>(std::round(sourcePosition * static_cast<double>(mStretchFactor)));
+}
+
+int SegmentedStretch::findShift(Segment const& previous, int previousOffset, Segment const& next, int nextOffset, int fadeStart, int fadeLength, int maxShift) const
+{
+    // Only shifts which keep the whole fade inside both outputs are considered
+    auto const fadeEnd = fadeStart + fadeLength;
+    if(fadeStart < previousOffset || fadeEnd > previousOffset + previous.output.getNumSamples())
+    {
+        return 0;
     }
-    std::cout << "Phase 3: Remaining samples complete\n";
 
-    // save to temp file.
-    // assume wav for now
-    juce::WavAudioFormat format;
-    std::unique_ptr<juce::AudioFormatWriter> writer;
+    auto const minShift = std::max(-maxShift, fadeEnd - nextOffset - next.output.getNumSamples());
+    auto const maxAllowed = std::min(maxShift, fadeStart - nextOffset);
 
-    if(auto fileStream = std::unique_ptr<FileOutputStream>(mFile.getFile().createOutputStream()))
+    auto bestShift = 0;
+    auto bestScore = 0.0;
+    for(auto shift = minShift; shift <= maxAllowed; ++shift)
     {
-        if(fileStream->openedOk())
+        auto correlation = 0.0;
+        auto energy = 0.0;
+        for(int ch = 0; ch < mSource->getNumChannels(); ++ch)
         {
-            fileStream->setPosition(0);
-            fileStream->truncate();
+            auto const* a = previous.output.getReadPointer(ch, fadeStart - previousOffset);
+            auto const* b = next.output.getReadPointer(ch, fadeStart - nextOffset - shift);
+            for(int i = 0; i < fadeLength; ++i)
+            {
+                correlation += static_cast<double>(a[i]) * b[i];
+                energy += static_cast<double>(b[i]) * b[i];
+            }
         }
 
-        writer.reset(format.createWriterFor(fileStream.release(),
-                                            44100.0,
-                                            static_cast<unsigned int>(mStretchedBuffer.getNumChannels()),
-                                            24,
-                                            {},
-                                            0));
-        if(writer != nullptr)
+        auto const score = energy > 0.0 ? correlation / std::sqrt(energy) : 0.0;
+        if(score > bestScore)
         {
-            writer->writeFromAudioSampleBuffer(mStretchedBuffer, 0, mStretchedBuffer.getNumSamples());
+            bestScore = score;
+            bestShift = shift;
         }
     }
+
+    return bestShift;
 }
 
-void OfflineStretchProcessor::threadComplete(bool userPressedCancel)
+bool SegmentedStretch::writeToFile(juce::File const& file) const
 {
-    if(mOnThreadComplete != nullptr)
+    auto fileStream = std::unique_ptr<juce::FileOutputStream>(file.createOutputStream());
+    if(fileStream == nullptr || !fileStream->openedOk())
     {
-        mOnThreadComplete();
+        return false;
     }
+
+    fileStream->setPosition(0);
+    fileStream->truncate();
+
+    // assume wav for now
+    juce::WavAudioFormat format;
+    std::unique_ptr<juce::AudioFormatWriter> writer(format.createWriterFor(fileStream.get(),
+                                                                           mSampleRate,
+                                                                           static_cast<unsigned int>(mResult.getNumChannels()),
+                                                                           24,
+                                                                           {},
+                                                                           0));
+    if(writer == nullptr)
+    {
+        return false;
+    }
+
+    // the writer owns the stream now
+    fileStream.release();
+    return writer->writeFromAudioSampleBuffer(mResult, 0, mResult.getNumSamples());
 }
@@ -7,26 +7,110 @@
 #include "../../core/RingBuffer.h"
 #include "../../dependencies/rubberband/rubberband/RubberBandStretcher.h"
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
 namespace OUS
 {
-    class OfflineStretchProcessor : public juce::ThreadWithProgressWindow
+    //==============================================================================
+    /*
+    SegmentedStretch
+
+    Stretches a whole buffer with RubberBand, using every core. Rather than one
+    stretcher working through the file from start to end, the file is split into
+    segments, each stretched by its own RubberBandStretcher on a thread pool. Each
+    segment reads a margin either side of its own part of the file so it is warmed
+    up by the time it gets there. The results are lined up (by cross correlation,
+    as the segments' phases don't otherwise agree) and crossfaded across the
+    boundaries.
+
+    A file too short to be worth splitting is stretched in one go, with
+    RubberBand's own threading (one thread per channel) instead.
+
+    The result is allocated at its full length up front and each segment is
+    stitched in as soon as it (and the ones before it) are done, so the start of
+    the result can be used (e.g. played) while the rest is still being stretched,
+    see getNumReady.
+
+    Doesn't depend on the UI, so it can also be run headless (see playground/stretch).
+    */
+    class SegmentedStretch
     {
     public:
-        OfflineStretchProcessor(TemporaryFile& file, juce::AudioSampleBuffer& stretchSrc, float stretchFactor, float pitchFactor, double sampleRate, std::function<void()> onThreadComplete = nullptr);
-        void run() override;
+        // Shared read only once it's running (previewed, cached...)
+        using Ptr = std::shared_ptr<SegmentedStretch const>;
+
+        // What the stretchers are created with (plus the threading, which doesn't change the result)
+        static constexpr int options = RubberBand::RubberBandStretcher::OptionProcessOffline;
+
+        // Segments are at least this long, and otherwise sized so each thread gets a couple of them
+        static constexpr double minSegmentSeconds = 10.0;
+        static constexpr double marginSeconds = 1.0;
+        static constexpr double crossfadeSeconds = 0.2;
+        static constexpr double maxShiftSeconds = 0.01;
+        static constexpr size_t chunkSize = 1024;
 
-        void threadComplete(bool userPressedCancel) override;
+        /** The source is only read by run, it has to outlive that but not the stretch */
+        SegmentedStretch(juce::AudioSampleBuffer const& source, double sampleRate, float stretchFactor, float pitchFactor, int numThreads = juce::SystemStats::getNumCpus());
+
+        /** A stretch that's already done (e.g. read back from a cache), there is nothing to run */
+        SegmentedStretch(juce::AudioSampleBuffer&& result, double sampleRate);
+
+        /** Stretches the source, blocking until it's done. progress (0 to 1, summed over all the
+            segments) is called and shouldExit checked on the calling thread every so often.
+            Returns false if it was cancelled by shouldExit */
+        bool run(std::function<bool()> const& shouldExit, std::function<void(double)> const& progress);
+
+        juce::AudioSampleBuffer& getResult() { return mResult; }
+        juce::AudioSampleBuffer const& getResult() const { return mResult; }
+        double getSampleRate() const { return mSampleRate; }
+        int getNumSegments() const { return static_cast<int>(mSegments.size()); }
+
+        /** How many samples at the start of the result are final. Safe to call (and to read
+            that many samples of the result) from any thread while it's running */
+        int getNumReady() const { return mNumReady.load(); }
+
+        /** Writes the result to a 24 bit WAV file */
+        bool writeToFile(juce::File const& file) const;
 
     private:
-        juce::TemporaryFile& mFile;
+        struct Segment
+        {
+            int start = 0; // the part of the source this segment provides the output for
+            int end = 0;
+            int readStart = 0; // the part it actually stretches, including the margins
+            int readEnd = 0;
+            juce::AudioSampleBuffer output;
+        };
+
+        bool stretchSegment(Segment& segment, RubberBand::RubberBandStretcher::Options options);
+        void segmentFinished(size_t index);
+        void stitchSegment(size_t index);
+        int toOutput(int sourcePosition) const;
+        int findShift(Segment const& previous, int previousOffset, Segment const& next, int nextOffset, int fadeStart, int fadeLength, int maxShift) const;
+
+        juce::AudioSampleBuffer const* mSource;
+        double mSampleRate;
+        float mStretchFactor;
+        float mPitchShiftFactor;
+        int mNumThreads;
 
-        juce::AudioSampleBuffer mStretchSrc;
-        float mStretchFactor = 1.0f;
-        float mPitchShiftFactor = 1.0f;
+        std::vector<Segment> mSegments;
+        juce::AudioSampleBuffer mResult;
+        int mHalfFade = 1;
 
-        std::unique_ptr<RubberBand::RubberBandStretcher> mRubberBandStretcher;
-        juce::AudioSampleBuffer mStretchedBuffer;
+        // Segments are stitched in order, by whichever worker finishes the one that's next
+        juce::CriticalSection mStitchLock;
+        std::vector<bool> mFinished;
+        std::vector<int> mOffsets;
+        size_t mNumStitched = 0;
+        std::atomic<int> mNumReady{0};
 
-        std::function<void()> mOnThreadComplete;
+        // Summed over the workers, in source samples (each is studied then processed, so counts twice)
+        std::atomic<juce::int64> mSamplesDone{0};
+        juce::int64 mTotalWork = 0;
+        std::atomic<bool> mCancelled{false};
     };
 } // namespace OUS
@@ -0,0 +1,588 @@
+#include "PartitionedConvolution.h"
+
+#define MAX_IMPULSE_RESPONSE_LENGTH 30.0 // seconds
+
+using namespace OUS;
+
+namespace
+{
+    // Bump whenever the partitioning or cache layout changes
+    constexpr int cacheMagic = 0x5249554f; // "OUIR"
+    constexpr int cacheVersion = 1;
+
+    int getOrder(int fftSize)
+    {
+        int order = 0;
+        while((1 << order) < fftSize)
+        {
+            ++order;
+        }
+
+        return order;
+    }
+
+    // Band limited (windowed sinc) resampling by ratio = output rate / input rate.
+    // This only runs once per impulse response (and then comes from the cache) so
+    // it favours quality, and unlike the juce interpolators it adds no latency
+    std::vector<float> resample(float const* input, int numInput, double ratio)
+    {
+        if(ratio == 1.0)
+        {
+            return std::vector<float>(input, input + numInput);
+        }
+
+        constexpr int zeroCrossings = 32;
+        constexpr int tableResolution = 512;
+
+        // The windowed (Blackman) sinc, tabulated from 0 to zeroCrossings
+        static std::vector<float> const table = []()
+        {
+            std::vector<float> t(zeroCrossings * tableResolution + 2, 0.0f);
+            for(size_t i = 0; i < t.size() - 1; ++i)
+            {
+                auto const x = static_cast<double>(i) / tableResolution;
+                auto const u = x / zeroCrossings;
+                auto const sinc = x == 0.0 ? 1.0 : std::sin(juce::MathConstants<double>::pi * x) / (juce::MathConstants<double>::pi * x);
+                auto const window = 0.42 + 0.5 * std::cos(juce::MathConstants<double>::pi * u) + 0.08 * std::cos(2.0 * juce::MathConstants<double>::pi * u);
+                t[i] = static_cast<float>(sinc * window);
+            }
+
+            return t;
+        }();
+
+        // When downsampling the cutoff has to drop to the new Nyquist
+        auto const cutoff = std::min(1.0, ratio);
+        auto const halfWidth = zeroCrossings / cutoff;
+        auto const numOutput = static_cast<int>(std::ceil(numInput * ratio));
+
+        std::vector<float> output(static_cast<size_t>(numOutput), 0.0f);
+        for(int n = 0; n < numOutput; ++n)
+        {
+            auto const centre = n / ratio;
+            auto const first = std::max(0, static_cast<int>(std::ceil(centre - halfWidth)));
+            auto const last = std::min(numInput - 1, static_cast<int>(std::floor(centre + halfWidth)));
+
+            double sum = 0.0;
+            for(int k = first; k <= last; ++k)
+            {
+                auto const position = std::abs(centre - k) * cutoff * tableResolution;
+                auto const index = static_cast<size_t>(position);
+                auto const frac = static_cast<float>(position - static_cast<double>(index));
+                auto const tap = table[index] + frac * (table[index + 1] - table[index]);
+                sum += input[k] * tap;
+            }
+
+            output[static_cast<size_t>(n)] = static_cast<float>(sum * cutoff);
+        }
+
+        return output;
+    }
+} // namespace
+
+//==============================================================================
+std::unique_ptr<ImpulseResponse> ImpulseResponse::load(juce::File const& file, juce::AudioFormatManager& formatManager, double sampleRate, juce::String& error)
+{
+    error = juce::String();
+
+    if(!file.existsAsFile())
+    {
+        error = "The file " + file.getFullPathName() + " doesn't exist";
+        return nullptr;
+    }
+
+    // The cache is keyed on everything that changes the prepared impulse response
+    auto const key = file.getFullPathName() + ":" + juce::String(file.getSize()) + ":" + juce::String(file.getLastModificationTime().toMilliseconds()) + ":" + juce::String(sampleRate) + ":" + juce::String(headSize) + ":" + juce::String(tailPartitionSize);
+    auto const cacheFile = getCacheDirectory().getChildFile(juce::String::toHexString(key.hashCode64()) + ".ir");
+
+    std::unique_ptr<ImpulseResponse> impulseResponse(new ImpulseResponse());
+    if(cacheFile.existsAsFile() && impulseResponse->readFromCache(cacheFile))
+    {
+        return impulseResponse;
+    }
+
+    std::unique_ptr<juce::AudioFormatReader> reader{formatManager.createReaderFor(file)};
+    if(reader == nullptr)
+    {
+        error = "Failed to initialise file reader";
+        return nullptr;
+    }
+
+    auto const duration = static_cast<double>(reader->lengthInSamples) / reader->sampleRate;
+    if(duration > MAX_IMPULSE_RESPONSE_LENGTH)
+    {
+        error = juce::translate("The file is ") + juce::String(duration) + juce::translate("seconds long. ") +
+                juce::String(MAX_IMPULSE_RESPONSE_LENGTH) + "Second limit!";
+        return nullptr;
+    }
+
+    auto const numChannels = std::min(static_cast<int>(reader->numChannels), 2);
+    auto const numSamples = static_cast<int>(reader->lengthInSamples);
+    juce::AudioSampleBuffer samples(numChannels, numSamples);
+    reader->read(&samples, 0, numSamples, 0, true, numChannels > 1);
+
+    impulseResponse->mName = file.getFileName();
+    impulseResponse->prepare(samples, reader->sampleRate, sampleRate);
+
+    // Not being able to cache just means preparing it again next time
+    impulseResponse->writeToCache(cacheFile);
+
+    return impulseResponse;
+}
+
+//==============================================================================
+juce::File ImpulseResponse::getCacheDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("TheOfficeOfUnspecifiedServices")
+        .getChildFile("ImpulseResponseCache");
+}
+
+//==============================================================================
+float const* ImpulseResponse::getHead(int channel) const
+{
+    return mHead[static_cast<size_t>(channel)].data();
+}
+
+float const* ImpulseResponse::getBodyPartition(int channel, int partition) const
+{
+    return mBody[static_cast<size_t>(channel)].data() + partition * bodySpectrumSize;
+}
+
+float const* ImpulseResponse::getTailPartition(int channel, int partition) const
+{
+    return mTail[static_cast<size_t>(channel)].data() + partition * tailSpectrumSize;
+}
+
+//==============================================================================
+void ImpulseResponse::prepare(juce::AudioSampleBuffer const& samples, double fileSampleRate, double sampleRate)
+{
+    mSampleRate = sampleRate;
+    mNumChannels = samples.getNumChannels();
+
+    std::vector<std::vector<float>> resampled;
+    for(int channel = 0; channel < mNumChannels; ++channel)
+    {
+        resampled.push_back(resample(samples.getReadPointer(channel), samples.getNumSamples(), sampleRate / fileSampleRate));
+    }
+
+    mNumSamples = mNumChannels > 0 ? static_cast<int>(resampled[0].size()) : 0;
+
+    // Normalise to unit energy (of the loudest channel), so the wet signal is
+    // about as loud as the dry regardless of the length of the response
+    double energy = 0.0;
+    for(auto const& channel : resampled)
+    {
+        double channelEnergy = 0.0;
+        for(auto const sample : channel)
+        {
+            channelEnergy += static_cast<double>(sample) * sample;
+        }
+
+        energy = std::max(energy, channelEnergy);
+    }
+
+    auto const gain = energy > 0.0 ? static_cast<float>(1.0 / std::sqrt(energy)) : 0.0f;
+    for(auto& channel : resampled)
+    {
+        juce::FloatVectorOperations::multiply(channel.data(), gain, static_cast<int>(channel.size()));
+    }
+
+    mNumBodyPartitions = juce::jlimit(0, maxBodyPartitions, (mNumSamples - headSize + headSize - 1) / headSize);
+    mNumTailPartitions = std::max(0, (mNumSamples - tailStart + tailPartitionSize - 1) / tailPartitionSize);
+
+    // Transforms a partitionSize long segment of channel starting at start, zero
+    // padded to twice its length for overlap-save, into spectrum
+    auto const transform = [](std::vector<float> const& channel, int start, int partitionSize, juce::dsp::FFT& fft, std::vector<float>& scratch, float* spectrum)
+    {
+        std::fill(scratch.begin(), scratch.end(), 0.0f);
+        auto const end = std::min(start + partitionSize, static_cast<int>(channel.size()));
+        if(start < end)
+        {
+            std::copy(channel.begin() + start, channel.begin() + end, scratch.begin());
+        }
+
+        fft.performRealOnlyForwardTransform(scratch.data(), true);
+        std::copy(scratch.begin(), scratch.begin() + 2 * (partitionSize + 1), spectrum);
+    };
+
+    juce::dsp::FFT bodyFFT(getOrder(2 * headSize));
+    juce::dsp::FFT tailFFT(getOrder(2 * tailPartitionSize));
+    std::vector<float> bodyScratch(static_cast<size_t>(4 * headSize));
+    std::vector<float> tailScratch(static_cast<size_t>(4 * tailPartitionSize));
+
+    mHead.assign(static_cast<size_t>(mNumChannels), std::vector<float>(static_cast<size_t>(headSize), 0.0f));
+    mBody.assign(static_cast<size_t>(mNumChannels), std::vector<float>(static_cast<size_t>(mNumBodyPartitions * bodySpectrumSize), 0.0f));
+    mTail.assign(static_cast<size_t>(mNumChannels), std::vector<float>(static_cast<size_t>(mNumTailPartitions * tailSpectrumSize), 0.0f));
+
+    for(size_t channel = 0; channel < resampled.size(); ++channel)
+    {
+        auto const& ir = resampled[channel];
+        std::copy(ir.begin(), ir.begin() + std::min(headSize, mNumSamples), mHead[channel].begin());
+
+        for(int partition = 0; partition < mNumBodyPartitions; ++partition)
+        {
+            transform(ir, headSize + partition * headSize, headSize, bodyFFT, bodyScratch, mBody[channel].data() + partition * bodySpectrumSize);
+        }
+
+        for(int partition = 0; partition < mNumTailPartitions; ++partition)
+        {
+            transform(ir, tailStart + partition * tailPartitionSize, tailPartitionSize, tailFFT, tailScratch, mTail[channel].data() + partition * tailSpectrumSize);
+        }
+    }
+}
+
+//==============================================================================
+bool ImpulseResponse::readFromCache(juce::File const& cacheFile)
+{
+    juce::FileInputStream stream(cacheFile);
+    if(!stream.openedOk() || stream.readInt() != cacheMagic || stream.readInt() != cacheVersion)
+    {
+        return false;
+    }
+
+    mSampleRate = stream.readDouble();
+    mNumChannels = stream.readInt();
+    mNumSamples = stream.readInt();
+    mNumBodyPartitions = stream.readInt();
+    mNumTailPartitions = stream.readInt();
+    mName = stream.readString();
+
+    if(mNumChannels < 1 || mNumChannels > 2 || mNumBodyPartitions < 0 || mNumBodyPartitions > maxBodyPartitions || mNumTailPartitions < 0)
+    {
+        return false;
+    }
+
+    auto const read = [&stream](std::vector<float>& data, int size)
+    {
+        data.resize(static_cast<size_t>(size));
+        auto const numBytes = static_cast<int>(static_cast<size_t>(size) * sizeof(float));
+        return stream.read(data.data(), numBytes) == numBytes;
+    };
+
+    mHead.resize(static_cast<size_t>(mNumChannels));
+    mBody.resize(static_cast<size_t>(mNumChannels));
+    mTail.resize(static_cast<size_t>(mNumChannels));
+    for(size_t channel = 0; channel < static_cast<size_t>(mNumChannels); ++channel)
+    {
+        if(!read(mHead[channel], headSize) || !read(mBody[channel], mNumBodyPartitions * bodySpectrumSize) || !read(mTail[channel], mNumTailPartitions * tailSpectrumSize))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ImpulseResponse::writeToCache(juce::File const& cacheFile) const
+{
+    if(!cacheFile.getParentDirectory().createDirectory())
+    {
+        return;
+    }
+
+    // Write to a temporary file first so a half written cache is never read
+    juce::TemporaryFile temporaryFile(cacheFile);
+    {
+        juce::FileOutputStream stream(temporaryFile.getFile());
+        if(!stream.openedOk())
+        {
+            return;
+        }
+
+        stream.writeInt(cacheMagic);
+        stream.writeInt(cacheVersion);
+        stream.writeDouble(mSampleRate);
+        stream.writeInt(mNumChannels);
+        stream.writeInt(mNumSamples);
+        stream.writeInt(mNumBodyPartitions);
+        stream.writeInt(mNumTailPartitions);
+        stream.writeString(mName);
+
+        for(size_t channel = 0; channel < static_cast<size_t>(mNumChannels); ++channel)
+        {
+            for(auto const* data : {&mHead[channel], &mBody[channel], &mTail[channel]})
+            {
+                stream.write(data->data(), data->size() * sizeof(float));
+            }
+        }
+
+        stream.flush();
+        if(stream.getStatus().failed())
+        {
+            return;
+        }
+    }
+
+    temporaryFile.overwriteTargetFileWithTemporary();
+}
+
+//==============================================================================
+PartitionedConvolution::PartitionedConvolution(std::unique_ptr<ImpulseResponse> impulseResponse)
+: juce::Thread("Convolution Tail")
+, mImpulseResponse(std::move(impulseResponse))
+, mChannels(maxChannels)
+, mBodyFFT(getOrder(2 * headSize))
+, mTailFFT(getOrder(2 * tailPartitionSize))
+{
+    jassert(mImpulseResponse != nullptr && mImpulseResponse->getNumChannels() > 0);
+
+    auto const numBodyPartitions = static_cast<size_t>(mImpulseResponse->getNumBodyPartitions());
+    auto const numTailPartitions = static_cast<size_t>(mImpulseResponse->getNumTailPartitions());
+
+    for(auto& channel : mChannels)
+    {
+        channel.input.assign(2 * headSize, 0.0f);
+        channel.bodyOutput.assign(headSize, 0.0f);
+        channel.bodySpectra.assign(numBodyPartitions * ImpulseResponse::bodySpectrumSize, 0.0f);
+        channel.bodyScratch.assign(4 * headSize, 0.0f);
+
+        if(numTailPartitions > 0)
+        {
+            channel.tailInput.assign(numTailSlots * tailPartitionSize, 0.0f);
+            channel.tailOutput.assign(numTailSlots * tailPartitionSize, 0.0f);
+            channel.tailHistory.assign(2 * tailPartitionSize, 0.0f);
+            channel.tailSpectra.assign(numTailPartitions * ImpulseResponse::tailSpectrumSize, 0.0f);
+            channel.tailScratch.assign(4 * tailPartitionSize, 0.0f);
+        }
+    }
+
+    for(auto& block : mTailSlotBlocks)
+    {
+        block.store(-1);
+    }
+
+    if(numTailPartitions > 0)
+    {
+        startThread();
+    }
+}
+
+PartitionedConvolution::~PartitionedConvolution()
+{
+    stopThread(1000);
+}
+
+//==============================================================================
+void PartitionedConvolution::process(float const* const* input, float* const* output, int numChannels, int numSamples)
+{
+    auto const& ir = *mImpulseResponse;
+    auto const hasTail = ir.getNumTailPartitions() > 0;
+    numChannels = std::min(numChannels, maxChannels);
+    mNumChannels.store(numChannels, std::memory_order_relaxed);
+
+    int offset = 0;
+    while(offset < numSamples)
+    {
+        // Never cross a head chunk (and so a tail block) boundary
+        auto const n = std::min(numSamples - offset, headSize - mChunkPosition);
+        auto const tailBlock = mPosition / tailPartitionSize - 2;
+
+        if(hasTail && mPosition % tailPartitionSize == 0)
+        {
+            // Offline there's no deadline, the thread is given the time it needs
+            while(mNonRealtime && mTailProcessed.load(std::memory_order_acquire) <= tailBlock)
+            {
+                mTailDone.wait(1);
+            }
+
+            // The tail block starting now is the output of the input block handed over two blocks ago
+            mTailReadable = tailBlock >= 0 && mTailProcessed.load(std::memory_order_acquire) > tailBlock;
+            if(tailBlock >= 0 && !mTailReadable)
+            {
+                ++mTailUnderruns;
+            }
+
+            // The input block starting now goes in the slot of the one numTailSlots before it,
+            // which the thread may still be reading
+            auto const inputBlock = mPosition / tailPartitionSize;
+            mTailWritable = mTailProcessed.load(std::memory_order_acquire) > inputBlock - numTailSlots;
+            if(!mTailWritable)
+            {
+                ++mTailUnderruns;
+            }
+        }
+
+        for(int c = 0; c < numChannels; ++c)
+        {
+            auto& channel = mChannels[static_cast<size_t>(c)];
+            auto const irChannel = c % ir.getNumChannels();
+
+            // Copy the input first as it may be the same buffer as the output
+            auto* x = channel.input.data() + headSize + mChunkPosition;
+            std::copy(input[c] + offset, input[c] + offset + n, x);
+
+            auto* y = output[c] + offset;
+            std::copy(channel.bodyOutput.data() + mChunkPosition, channel.bodyOutput.data() + mChunkPosition + n, y);
+
+            if(hasTail && mTailReadable)
+            {
+                auto const* tail = channel.tailOutput.data() + (tailBlock % numTailSlots) * tailPartitionSize + mPosition % tailPartitionSize;
+                juce::FloatVectorOperations::add(y, tail, n);
+            }
+
+            // Direct convolution with the head, one tap at a time over the whole segment
+            auto const* head = ir.getHead(irChannel);
+            for(int k = 0; k < headSize; ++k)
+            {
+                if(head[k] != 0.0f)
+                {
+                    juce::FloatVectorOperations::addWithMultiply(y, x - k, head[k], n);
+                }
+            }
+        }
+
+        mChunkPosition += n;
+        mPosition += n;
+        offset += n;
+
+        if(mChunkPosition == headSize)
+        {
+            auto const chunkStart = mPosition - headSize;
+            for(int c = 0; c < numChannels; ++c)
+            {
+                auto& channel = mChannels[static_cast<size_t>(c)];
+                processBody(channel, c % ir.getNumChannels());
+
+                if(hasTail && mTailWritable)
+                {
+                    auto* tailInput = channel.tailInput.data() + ((chunkStart / tailPartitionSize) % numTailSlots) * tailPartitionSize + chunkStart % tailPartitionSize;
+                    std::copy(channel.input.begin() + headSize, channel.input.end(), tailInput);
+                }
+
+                std::copy(channel.input.begin() + headSize, channel.input.end(), channel.input.begin());
+            }
+
+            if(ir.getNumBodyPartitions() > 0)
+            {
+                mBodyPosition = (mBodyPosition + 1) % ir.getNumBodyPartitions();
+            }
+            mChunkPosition = 0;
+
+            if(hasTail && mPosition % tailPartitionSize == 0)
+            {
+                auto const block = mPosition / tailPartitionSize - 1;
+                if(mTailWritable)
+                {
+                    mTailSlotBlocks[static_cast<size_t>(block % numTailSlots)].store(block, std::memory_order_release);
+                }
+
+                mTailSubmitted.store(block + 1, std::memory_order_release);
+                notify();
+            }
+        }
+    }
+}
+
+//==============================================================================
+void PartitionedConvolution::run()
+{
+    auto const numTailPartitions = mImpulseResponse->getNumTailPartitions();
+
+    while(!threadShouldExit())
+    {
+        auto const block = mTailProcessed.load(std::memory_order_relaxed);
+        if(block == mTailSubmitted.load(std::memory_order_acquire))
+        {
+            wait(-1);
+            continue;
+        }
+
+        juce::ScopedNoDenormals noDenormals;
+
+        auto const numChannels = mNumChannels.load(std::memory_order_relaxed);
+        auto const hasInput = mTailSlotBlocks[static_cast<size_t>(block % numTailSlots)].load(std::memory_order_acquire) == block;
+        for(int c = 0; c < numChannels; ++c)
+        {
+            processTail(mChannels[static_cast<size_t>(c)], c % mImpulseResponse->getNumChannels(), block, hasInput);
+        }
+
+        mTailPosition = (mTailPosition + 1) % numTailPartitions;
+        mTailProcessed.store(block + 1, std::memory_order_release);
+        mTailDone.signal();
+    }
+}
+
+//==============================================================================
+void PartitionedConvolution::processBody(Channel& channel, int irChannel)
+{
+    auto const& ir = *mImpulseResponse;
+    auto const numPartitions = ir.getNumBodyPartitions();
+    if(numPartitions == 0)
+    {
+        return;
+    }
+
+    // Overlap-save: transform the last two chunks of input, and keep the second half of the result
+    auto* scratch = channel.bodyScratch.data();
+    std::copy(channel.input.begin(), channel.input.end(), scratch);
+    std::fill(scratch + 2 * headSize, scratch + 4 * headSize, 0.0f);
+    mBodyFFT.performRealOnlyForwardTransform(scratch, true);
+
+    std::copy(scratch, scratch + ImpulseResponse::bodySpectrumSize, channel.bodySpectra.data() + mBodyPosition * ImpulseResponse::bodySpectrumSize);
+    multiplyAccumulate(scratch, channel.bodySpectra.data(), mBodyPosition, ir.getBodyPartition(irChannel, 0), numPartitions, ImpulseResponse::bodySpectrumSize);
+    inverseTransform(mBodyFFT, scratch, 2 * headSize);
+
+    std::copy(scratch + headSize, scratch + 2 * headSize, channel.bodyOutput.begin());
+}
+
+void PartitionedConvolution::processTail(Channel& channel, int irChannel, juce::int64 block, bool hasInput)
+{
+    auto const& ir = *mImpulseResponse;
+    auto const slot = static_cast<int>(block % numTailSlots) * tailPartitionSize;
+
+    // A block that was never written to its slot is silence, rather than what's left there
+    auto* history = channel.tailHistory.data();
+    std::copy(history + tailPartitionSize, history + 2 * tailPartitionSize, history);
+    if(hasInput)
+    {
+        std::copy(channel.tailInput.data() + slot, channel.tailInput.data() + slot + tailPartitionSize, history + tailPartitionSize);
+    }
+    else
+    {
+        std::fill(history + tailPartitionSize, history + 2 * tailPartitionSize, 0.0f);
+    }
+
+    auto* scratch = channel.tailScratch.data();
+    std::copy(history, history + 2 * tailPartitionSize, scratch);
+    std::fill(scratch + 2 * tailPartitionSize, scratch + 4 * tailPartitionSize, 0.0f);
+    mTailFFT.performRealOnlyForwardTransform(scratch, true);
+
+    std::copy(scratch, scratch + ImpulseResponse::tailSpectrumSize, channel.tailSpectra.data() + mTailPosition * ImpulseResponse::tailSpectrumSize);
+    multiplyAccumulate(scratch, channel.tailSpectra.data(), mTailPosition, ir.getTailPartition(irChannel, 0), ir.getNumTailPartitions(), ImpulseResponse::tailSpectrumSize);
+    inverseTransform(mTailFFT, scratch, 2 * tailPartitionSize);
+
+    std::copy(scratch + tailPartitionSize, scratch + 2 * tailPartitionSize, channel.tailOutput.data() + slot);
+}
+
+//==============================================================================
+void PartitionedConvolution::multiplyAccumulate(float* accumulator, float const* spectra, int position, float const* impulseResponse, int numPartitions, int spectrumSize)
+{
+    // Sum the spectra of the last numPartitions blocks of input, newest first, each
+    // multiplied by the matching partition of the impulse response
+    std::fill(accumulator, accumulator + spectrumSize, 0.0f);
+
+    for(int partition = 0; partition < numPartitions; ++partition)
+    {
+        auto const* x = spectra + ((position - partition + numPartitions) % numPartitions) * spectrumSize;
+        auto const* h = impulseResponse + partition * spectrumSize;
+
+        for(int i = 0; i < spectrumSize; i += 2)
+        {
+            accumulator[i] += x[i] * h[i] - x[i + 1] * h[i + 1];
+            accumulator[i + 1] += x[i] * h[i + 1] + x[i + 1] * h[i];
+        }
+    }
+}
+
+void PartitionedConvolution::inverseTransform(juce::dsp::FFT& fft, float* data, int fftSize)
+{
+    // Only the non negative frequencies are kept, fill in the rest (the conjugates)
+    // as not every juce FFT engine assumes them for a real only inverse
+    for(int i = 1; i < fftSize / 2; ++i)
+    {
+        data[2 * (fftSize - i)] = data[2 * i];
+        data[2 * (fftSize - i) + 1] = -data[2 * i + 1];
+    }
+
+    fft.performRealOnlyInverseTransform(data);
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+#include <array>
+#include <atomic>
+
+namespace OUS
+{
+    //==============================================================================
+    /*
+    ImpulseResponse
+
+    An impulse response resampled to the host rate and split into the partitions
+    used by PartitionedConvolution, with every partition but the head already
+    transformed. Preparing a long file is slow (reading, resampling and hundreds of
+    FFTs) so the result is cached on disk, keyed on the file and the sample rate,
+    and later loads of the same file just read the spectra back.
+
+    Create on a background thread, never the audio thread.
+    */
+    class ImpulseResponse
+    {
+    public:
+        // Partition sizes in samples. The head is convolved directly, the body on the
+        // audio thread in headSize partitions and the tail on a background thread in
+        // tailPartitionSize partitions, starting at tailStart
+        static constexpr int headSize = 128;
+        static constexpr int tailPartitionSize = 2048;
+        static constexpr int tailStart = 2 * tailPartitionSize;
+        static constexpr int maxBodyPartitions = (tailStart - headSize) / headSize;
+
+        static std::unique_ptr<ImpulseResponse> load(juce::File const& file, juce::AudioFormatManager& formatManager, double sampleRate, juce::String& error);
+
+        static juce::File getCacheDirectory();
+
+        juce::String const& getName() const { return mName; }
+        double getSampleRate() const { return mSampleRate; }
+        int getNumChannels() const { return mNumChannels; }
+        int getNumSamples() const { return mNumSamples; }
+        int getNumBodyPartitions() const { return mNumBodyPartitions; }
+        int getNumTailPartitions() const { return mNumTailPartitions; }
+
+        float const* getHead(int channel) const;
+        float const* getBodyPartition(int channel, int partition) const;
+        float const* getTailPartition(int channel, int partition) const;
+
+        // Size in floats of one transformed partition (complex, non negative frequencies only)
+        static constexpr int bodySpectrumSize = 2 * (headSize + 1);
+        static constexpr int tailSpectrumSize = 2 * (tailPartitionSize + 1);
+
+    private:
+        ImpulseResponse() = default;
+
+        void prepare(juce::AudioSampleBuffer const& samples, double fileSampleRate, double sampleRate);
+
+        bool readFromCache(juce::File const& cacheFile);
+        void writeToCache(juce::File const& cacheFile) const;
+
+        juce::String mName;
+        double mSampleRate = 0.0;
+        int mNumChannels = 0;
+        int mNumSamples = 0;
+        int mNumBodyPartitions = 0;
+        int mNumTailPartitions = 0;
+
+        // Per channel
+        std::vector<std::vector<float>> mHead;
+        std::vector<std::vector<float>> mBody;
+        std::vector<std::vector<float>> mTail;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ImpulseResponse)
+    };
+
+    //==============================================================================
+    /*
+    PartitionedConvolution
+
+    Non uniformly partitioned convolution of up to maxChannels channels with an
+    ImpulseResponse, with no latency.
+
+    - The first headSize samples of the impulse response are convolved directly, so
+      the output doesn't wait on an FFT.
+    - Up to tailStart they are uniformly partitioned at headSize (overlap-save with a
+      frequency domain delay line), computed on the audio thread every headSize samples.
+    - The rest are partitioned at tailPartitionSize and computed on a background thread
+      owned by this object. Each tail partition of input is handed over once it is
+      complete, and its output isn't needed for another tailPartitionSize samples, which
+      is how long the thread has to do the (by far largest) part of the work.
+
+    In real time a tail block the thread hasn't finished by then is dropped (and
+    counted), and a block of input is only written to a slot the thread has finished
+    reading (if it's too far behind the block is counted and heard as silence). Non
+    real time (a bounce, usually faster than real time) process() waits for the thread
+    instead, so nothing is lost.
+
+    All the state is allocated up front so process() doesn't allocate. A new impulse
+    response means a new PartitionedConvolution, built on a background thread and
+    swapped in by reference (see ConvolutionReverbProcessor).
+    */
+    class PartitionedConvolution
+    : public juce::ReferenceCountedObject
+    , private juce::Thread
+    {
+    public:
+        typedef juce::ReferenceCountedObjectPtr<PartitionedConvolution> Ptr;
+
+        static constexpr int maxChannels = 2;
+
+        PartitionedConvolution(std::unique_ptr<ImpulseResponse> impulseResponse);
+        ~PartitionedConvolution() override;
+
+        ImpulseResponse const& getImpulseResponse() const { return *mImpulseResponse; }
+
+        /** Convolves numChannels (<= maxChannels) channels. Input and output may be the same buffers.
+            Channel n uses channel n of the impulse response, wrapping if it has fewer */
+        void process(float const* const* input, float* const* output, int numChannels, int numSamples);
+
+        /** Audio thread, before process(). Whether to wait for the background thread rather
+            than drop what it hasn't done in time (see AudioProcessor::isNonRealtime) */
+        void setNonRealtime(bool nonRealtime) { mNonRealtime = nonRealtime; }
+
+        /** Number of tail blocks the background thread didn't finish in time (and were dropped),
+            or was too far behind to be given */
+        int getNumTailUnderruns() const { return mTailUnderruns.load(); }
+
+    private:
+        static constexpr int headSize = ImpulseResponse::headSize;
+        static constexpr int tailPartitionSize = ImpulseResponse::tailPartitionSize;
+
+        // Tail input and output are handed between the threads in a ring of blocks,
+        // which gives the background thread some slack before the audio thread reuses one
+        static constexpr int numTailSlots = 3;
+
+        struct Channel
+        {
+            // Audio thread
+            std::vector<float> input;      // previous and current headSize chunk of input
+            std::vector<float> bodyOutput; // body output for the current chunk
+            std::vector<float> bodySpectra;
+            std::vector<float> bodyScratch;
+
+            // Shared, see numTailSlots
+            std::vector<float> tailInput;
+            std::vector<float> tailOutput;
+
+            // Background thread
+            std::vector<float> tailHistory;
+            std::vector<float> tailSpectra;
+            std::vector<float> tailScratch;
+        };
+
+        // juce::Thread
+        void run() override;
+
+        void processBody(Channel& channel, int irChannel);
+        void processTail(Channel& channel, int irChannel, juce::int64 block, bool hasInput);
+
+        static void multiplyAccumulate(float* accumulator, float const* spectra, int position, float const* impulseResponse, int numPartitions, int spectrumSize);
+        static void inverseTransform(juce::dsp::FFT& fft, float* data, int fftSize);
+
+        std::unique_ptr<ImpulseResponse> mImpulseResponse;
+        std::vector<Channel> mChannels;
+
+        juce::dsp::FFT mBodyFFT;
+        juce::dsp::FFT mTailFFT;
+
+        // Audio thread
+        juce::int64 mPosition = 0;
+        int mChunkPosition = 0;
+        int mBodyPosition = 0;
+        bool mTailReadable = false;
+        bool mTailWritable = false;
+        bool mNonRealtime = false;
+
+        // Background thread
+        int mTailPosition = 0;
+
+        std::atomic<int> mNumChannels{0};
+        std::atomic<juce::int64> mTailSubmitted{0};
+        std::atomic<juce::int64> mTailProcessed{0};
+        std::atomic<int> mTailUnderruns{0};
+
+        // The block whose input is in each slot (a block that couldn't be written isn't)
+        std::array<std::atomic<juce::int64>, numTailSlots> mTailSlotBlocks;
+
+        // Signalled each time the background thread finishes a block, for non real time
+        juce::WaitableEvent mTailDone;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PartitionedConvolution)
+    };
+} // namespace OUS
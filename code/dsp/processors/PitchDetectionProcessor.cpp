@@ -6,6 +6,9 @@
     #define MIN_DETECTABLE_FREQUENCY 220.0f // This is larger purely to speed up VST tests
 #endif
 
+// The highest pitch multi-pitch estimation looks for (about C7)
+#define MAX_MULTI_PITCH_FREQUENCY 2000.0f
+
 using namespace OUS;
 
 static float getMinBlockSizeToDetectFrequency(float frequency, float sampleRate)
@@ -16,15 +19,36 @@ static float getMinBlockSizeToDetectFrequency(float frequency, float sampleRate)
 PitchDetectionProcessor::PitchDetectionProcessor()
 : juce::AudioProcessor(BusesProperties().withInput("Input", juce::AudioChannelSet::stereo()))
 , mState(*this, nullptr, "pitchdetectionprocessorstate",
-         {std::make_unique<juce::AudioParameterFloat>("detectedpitch", "Detected Pitch", 0.0f, 22050.0f, 0.0f)})
+         {std::make_unique<juce::AudioParameterChoice>("method", "Method", juce::StringArray{"FFT YIN", "aubio YIN"}, Method::FFTYin),
+          std::make_unique<juce::AudioParameterBool>("multipitch", "Multi-pitch", false),
+          std::make_unique<juce::AudioParameterBool>("midi", "MIDI", false),
+          std::make_unique<juce::AudioParameterFloat>("hysteresis", "Hysteresis", 0.0f, 1.0f, 0.25f),
+          std::make_unique<juce::AudioParameterFloat>("bendrange", "Bend Range", 0.0f, 24.0f, 2.0f),
+          std::make_unique<juce::AudioParameterFloat>("gate", "Gate", -80.0f, 0.0f, -50.0f)})
 {
     mOutputVector = new_fvec(1);
     assert(mOutputVector != nullptr);
 }
 
-float PitchDetectionProcessor::getMostRecentPitch() const
+PitchDetectionProcessor::~PitchDetectionProcessor()
+{
+    releaseResources();
+    del_fvec(mOutputVector);
+}
+
+void PitchDetectionProcessor::setHopSize(int hopSize)
+{
+    mRequestedHopSize = std::max(1, hopSize);
+}
+
+void PitchDetectionProcessor::setNumChannels(int numChannels)
+{
+    mRequestedNumChannels = std::max(0, numChannels);
+}
+
+int PitchDetectionProcessor::readFrames(PitchFrame* frames, int maxFrames)
 {
-    return static_cast<juce::AudioParameterFloat*>(mState.getParameter("detectedpitch"))->get();
+    return mFrames.read(frames, maxFrames);
 }
 
 //==============================================================================
@@ -40,19 +64,38 @@ void PitchDetectionProcessor::prepareToPlay(double sampleRate,
     mBlockSize = maximumExpectedSamplesPerBlock;
     mSampleRate = static_cast<int>(sampleRate);
 
-    if(mInputSamples != nullptr)
+    releaseResources();
+
+    mWindowSize = static_cast<int>(std::ceil(getMinBlockSizeToDetectFrequency(MIN_DETECTABLE_FREQUENCY, static_cast<float>(sampleRate))));
+    mHopSize = std::min(mRequestedHopSize, mWindowSize);
+
+    // Each channel starts a different way into its hop, so they don't all analyse at once
+    auto const numChannels = std::max(1, mRequestedNumChannels > 0 ? mRequestedNumChannels : getTotalNumInputChannels());
+    mChannels.resize(static_cast<size_t>(numChannels));
+    for(int index = 0; index < numChannels; ++index)
     {
-        del_fvec(mInputSamples);
-        mInputSamples = nullptr;
+        auto& channel = mChannels[static_cast<size_t>(index)];
+        channel.ring.assign(static_cast<size_t>(mWindowSize), 0.0f);
+        channel.writeIndex = 0;
+        channel.hopPosition = index * mHopSize / numChannels;
+        channel.toMidi.prepare(sampleRate, index % maxMidiChannels + 1);
     }
 
-    auto const pitchProcessorBlockSize = static_cast<int>(std::ceil(getMinBlockSizeToDetectFrequency(MIN_DETECTABLE_FREQUENCY, static_cast<float>(sampleRate))));
-    setLatencySamples(pitchProcessorBlockSize);
-    mInputSamples = new_fvec(static_cast<uint_t>(pitchProcessorBlockSize));
-    mCircularBuffer.createCircularBuffer(static_cast<uint_t>(pitchProcessorBlockSize));
+    mPosition = 0;
+    mMidiWasOn = false;
+    mFrames.reset();
 
-    mAudioPitch = new_aubio_pitch("yin", static_cast<uint_t>(pitchProcessorBlockSize), static_cast<uint_t>(pitchProcessorBlockSize), static_cast<uint_t>(sampleRate));
+    // A pitch describes the middle of its window, and comes out up to a hop after that
+    // window's complete
+    setLatencySamples(mWindowSize / 2 + mHopSize);
+
+    // aubio's given the whole window each time (it doesn't need to keep its own)
+    mInputSamples = new_fvec(static_cast<uint_t>(mWindowSize));
+    mAudioPitch = new_aubio_pitch("yin", static_cast<uint_t>(mWindowSize), static_cast<uint_t>(mWindowSize), static_cast<uint_t>(sampleRate));
     assert(mAudioPitch != nullptr);
+
+    mYin = std::make_unique<YinPitchDetector>(mWindowSize, sampleRate);
+    mMultiPitch = std::make_unique<MultiPitchEstimator>(mWindowSize, sampleRate, MIN_DETECTABLE_FREQUENCY, MAX_MULTI_PITCH_FREQUENCY);
 }
 
 void PitchDetectionProcessor::releaseResources()
@@ -68,30 +111,116 @@ void PitchDetectionProcessor::releaseResources()
         del_aubio_pitch(mAudioPitch);
         mAudioPitch = nullptr;
     }
+
+    mYin.reset();
+    mMultiPitch.reset();
 }
 
-void PitchDetectionProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
+void PitchDetectionProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midi)
 {
-    // TODO: Stereo ?
-
+    auto const numChannels = std::min(buffer.getNumChannels(), static_cast<int>(mChannels.size()));
     auto const numSamples = buffer.getNumSamples();
 
-    // Copy new samples into buffer
-    for(int i = 0; i < numSamples; ++i)
+    // Nothing comes in, anything that's in the buffer is what goes out
+    midi.clear();
+
+    auto const midiOn = *mState.getRawParameterValue("midi") >= 0.5f;
+    auto const midiSettings = getMidiSettings();
+    if(mMidiWasOn && !midiOn)
+    {
+        for(auto& channel : mChannels)
+        {
+            channel.toMidi.stop(0, midi);
+        }
+    }
+
+    mMidiWasOn = midiOn;
+
+    for(int index = 0; index < numChannels; ++index)
+    {
+        auto& channel = mChannels[static_cast<size_t>(index)];
+        auto const* input = buffer.getReadPointer(index);
+        auto const toMidi = midiOn && index < maxMidiChannels;
+
+        // A block can finish any number of hops (or none)
+        for(int position = 0; position < numSamples;)
+        {
+            auto const numToWrite = std::min(numSamples - position, mHopSize - channel.hopPosition);
+            write(channel, input + position, numToWrite);
+            if(toMidi)
+            {
+                channel.toMidi.process(input + position, numToWrite, position, midiSettings, midi);
+            }
+
+            position += numToWrite;
+            channel.hopPosition += numToWrite;
+
+            if(channel.hopPosition == mHopSize)
+            {
+                channel.hopPosition = 0;
+                auto const frame = analyse(channel, index, mPosition + position);
+                if(toMidi)
+                {
+                    channel.toMidi.addFrame(frame.pitch, frame.confidence, position - 1, midiSettings, midi);
+                }
+            }
+        }
+    }
+
+    mPosition += numSamples;
+}
+
+void PitchDetectionProcessor::write(Channel& channel, float const* samples, int numSamples)
+{
+    auto const beforeWrap = std::min(numSamples, mWindowSize - channel.writeIndex);
+    std::copy(samples, samples + beforeWrap, channel.ring.begin() + channel.writeIndex);
+    std::copy(samples + beforeWrap, samples + numSamples, channel.ring.begin());
+    channel.writeIndex = (channel.writeIndex + numSamples) % mWindowSize;
+}
+
+PitchFrame PitchDetectionProcessor::analyse(Channel& channel, int index, juce::int64 time)
+{
+    auto* window = mInputSamples->data;
+    auto const numOldest = mWindowSize - channel.writeIndex;
+    std::copy(channel.ring.begin() + channel.writeIndex, channel.ring.end(), window);
+    std::copy(channel.ring.begin(), channel.ring.begin() + channel.writeIndex, window + numOldest);
+
+    PitchFrame frame;
+    frame.time = time;
+    frame.channel = index;
+
+    auto const useAubio = static_cast<int>(*mState.getRawParameterValue("method")) == Method::AubioYin;
+    auto const multiPitch = *mState.getRawParameterValue("multipitch") >= 0.5f;
+    if(useAubio)
     {
-        mCircularBuffer.writeBuffer(buffer.getSample(0, i));
+        aubio_pitch_do(mAudioPitch, mInputSamples, mOutputVector);
+        frame.pitch = *mOutputVector->data;
+        frame.confidence = aubio_pitch_get_confidence(mAudioPitch);
+    }
+    else
+    {
+        frame.pitch = mYin->detect(window, frame.confidence);
     }
 
-    auto const latency = getLatencySamples();
-    for(int i = 0; i < static_cast<int>(mInputSamples->length); ++i)
+    if(multiPitch)
     {
-        fvec_set_sample(mInputSamples, mCircularBuffer.readBuffer(latency - i), static_cast<uint_t>(i));
+        auto const result = mMultiPitch->estimate(window);
+        frame.numPitches = result.numPitches;
+        frame.pitches = result.pitches;
+        frame.saliences = result.saliences;
     }
 
-    aubio_pitch_do(mAudioPitch, mInputSamples, mOutputVector);
+    mFrames.push(frame);
+    return frame;
+}
 
-    auto lastDetectedPitchPtr = static_cast<juce::AudioParameterFloat*>(mState.getParameter("detectedpitch"));
-    *lastDetectedPitchPtr = *mOutputVector->data;
+PitchToMidi::Settings PitchDetectionProcessor::getMidiSettings() const
+{
+    PitchToMidi::Settings settings;
+    settings.hysteresis = *mState.getRawParameterValue("hysteresis");
+    settings.bendRange = *mState.getRawParameterValue("bendrange");
+    settings.gate = *mState.getRawParameterValue("gate");
+    return settings;
 }
 
 void PitchDetectionProcessor::getStateInformation(MemoryBlock& destData)
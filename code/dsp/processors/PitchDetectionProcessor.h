@@ -4,9 +4,15 @@
 #include "JuceHeader.h"
 // clang-format on
 
-#include "../../core/CircularBuffer.h"
+#include "MultiPitchEstimator.h"
+#include "PitchFrameQueue.h"
+#include "PitchToMidi.h"
+#include "YinPitchDetector.h"
 #include "aubio.h"
 
+#include <memory>
+#include <vector>
+
 // 1. prepare audio thread
 //      create aubio objects before entering the audio processing thread
 //      delete these objects when the audio thread exits
@@ -18,15 +24,75 @@
 namespace OUS
 {
     //==============================================================================
+    /*
+    PitchDetectionProcessor
+
+    Tracks the pitch of every input channel (as many as it's told there are with
+    setNumChannels, e.g. the tracks of a multitrack session) with YIN. The window is long enough to see
+    MIN_DETECTABLE_FREQUENCY, but it's only analysed once every hop (hop samples
+    in), so the hop sets how often there's a new pitch and the CPU it takes. Each
+    channel copies its new samples into its own ring a block at a time, and the
+    ring out to the window (oldest first) in two copies, either side of the wrap.
+    The channels' hops are staggered so their analyses are spread across blocks
+    rather than all landing in the same one. The detectors (and the window) are
+    shared, they keep nothing between windows.
+
+    Each pitch comes with YIN's confidence in it (0 - 1, how periodic the window
+    is), low for noise / silence / unpitched sounds. Results are PitchFrames
+    (timestamped, per channel) read with readFrames(), rather than parameters.
+
+    With the "multipitch" parameter on, each window is also given to a
+    MultiPitchEstimator for every pitch in it (chords, overlapping notes).
+
+    With the "midi" parameter on, each channel (the first 16, on MIDI channels 1 -
+    16) also plays its pitch as MIDI notes (see PitchToMidi), added to the block's
+    MidiBuffer at the sample each note's decided on. Onsets gate the notes, the
+    "hysteresis" parameter keeps a note through vibrato, "bendrange" sets the pitch
+    bend (0 for none) and "gate" the level that ends a note.
+
+    The "method" parameter picks the YIN: the in tree one (YinPitchDetector, the
+    difference function through an FFT) or aubio's (summed directly). They find the
+    same pitches, the FFT one in a fraction of the time at these window sizes (see
+    PitchBenchmark).
+    */
     class PitchDetectionProcessor
     : public juce::AudioProcessor
     {
     public:
+        static constexpr int defaultHopSize = 512;
+
+        // The "method" parameter's choices
+        enum Method
+        {
+            FFTYin,
+            AubioYin
+        };
+
         //==============================================================================
         PitchDetectionProcessor();
+        ~PitchDetectionProcessor() override;
+
+        //==============================================================================
+        /** Not while playing, takes effect from the next prepareToPlay. Clamped to the window */
+        void setHopSize(int hopSize);
+        int getHopSize() const { return mHopSize; }
+
+        /** Not while playing, takes effect from the next prepareToPlay. How many channels it's
+            given (all of them are tracked), by whatever it's part of. 0 (the default) for as
+            many as its input bus has */
+        void setNumChannels(int numChannels);
+        int getWindowSize() const { return mWindowSize; }
 
         //==============================================================================
-        float getMostRecentPitch() const;
+        /** One other thread (e.g. the message thread). Takes up to maxFrames analysed since
+            last time, oldest first, returning how many */
+        int readFrames(PitchFrame* frames, int maxFrames);
+
+        /** Frames lost since prepareToPlay because readFrames() wasn't called often enough */
+        int getNumDroppedFrames() const { return mFrames.getNumDropped(); }
+
+        /** For attaching controls to the parameters */
+        juce::AudioProcessorValueTreeState& getState() { return mState; }
 
         //==============================================================================
         bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
@@ -41,7 +107,7 @@ namespace OUS
         bool hasEditor() const override { return false; }
         const String getName() const override { return "PitchDetection"; }
         bool acceptsMidi() const override { return false; }
-        bool producesMidi() const override { return false; }
+        bool producesMidi() const override { return true; }
         double getTailLengthSeconds() const override { return 0.0; }
         int getNumPrograms() override { return 1; }
         int getCurrentProgram() override { return 0; }
@@ -55,19 +121,55 @@ namespace OUS
         void setStateInformation(const void* data, int sizeInBytes) override;
 
     private:
+        //==============================================================================
+        struct Channel
+        {
+            // The last mWindowSize samples, the oldest at writeIndex
+            std::vector<float> ring;
+            int writeIndex = 0;
+
+            // How far into the current hop
+            int hopPosition = 0;
+
+            PitchToMidi toMidi;
+        };
+
+        /** Copies numSamples (no more than a hop) into channel's ring */
+        void write(Channel& channel, float const* samples, int numSamples);
+
+        /** Detects the pitch of channel's window (ending with the last sample written) and
+            queues the frame, which it returns */
+        PitchFrame analyse(Channel& channel, int index, juce::int64 time);
+
+        PitchToMidi::Settings getMidiSettings() const;
+
         //==============================================================================
         int mBlockSize;
         int mSampleRate;
 
         juce::AudioProcessorValueTreeState mState;
         aubio_pitch_t* mAudioPitch = nullptr;
+        std::unique_ptr<YinPitchDetector> mYin;
+        std::unique_ptr<MultiPitchEstimator> mMultiPitch;
 
         fvec_t* mInputSamples = nullptr;
         fvec_t* mOutputVector = nullptr;
 
-        // TODO: Maybe just wrap fvec_t* in a circular buffer wrapper to avoid having
-        // to use this separate buffer at all
-        CircularBuffer<float> mCircularBuffer;
+        int mWindowSize = 0;
+        int mHopSize = defaultHopSize;
+        int mRequestedHopSize = defaultHopSize;
+        int mRequestedNumChannels = 0;
+
+        std::vector<Channel> mChannels;
+
+        // Samples processed since prepareToPlay, up to the start of the block
+        juce::int64 mPosition = 0;
+
+        PitchFrameQueue mFrames;
+
+        // MIDI's only for as many channels as there are MIDI channels
+        static constexpr int maxMidiChannels = 16;
+        bool mMidiWasOn = false;
 
         //==============================================================================
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PitchDetectionProcessor)
@@ -0,0 +1,93 @@
+#pragma once
+
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+#include "MultiPitchEstimator.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+
+namespace OUS
+{
+    //==============================================================================
+    /** One analysed window of one channel */
+    struct PitchFrame
+    {
+        juce::int64 time = 0; // the sample after the window's last, counted from prepareToPlay
+        int channel = 0;
+        float pitch = 0.0f; // Hz, 0 if there isn't one
+        float confidence = 0.0f;
+
+        // With multi-pitch estimation on, all the pitches found, strongest first
+        int numPitches = 0;
+        std::array<float, MultiPitchEstimator::maxPitches> pitches{};
+        std::array<float, MultiPitchEstimator::maxPitches> saliences{};
+    };
+
+    //==============================================================================
+    /*
+    PitchFrameQueue
+
+    Gets PitchFrames from the audio thread to one other thread (e.g. the message
+    thread's timer) without locking, so any number of channels can be analysed
+    without each needing a parameter.
+
+    A lock free single producer / single consumer queue: the audio thread pushes
+    each frame as it's analysed, the reader takes everything since it last
+    looked. If the reader falls a whole queue behind the newest frames are
+    dropped (and counted), never blocking the audio thread.
+    */
+    class PitchFrameQueue
+    {
+    public:
+        static constexpr int capacity = 1024;
+
+        PitchFrameQueue()
+        : mFrames(static_cast<size_t>(capacity))
+        {
+        }
+
+        /** Before processing starts. Drops anything queued */
+        void reset()
+        {
+            mFifo.reset();
+            mNumDropped = 0;
+        }
+
+        /** Audio thread. Returns false (and counts it) if the queue is full */
+        bool push(PitchFrame const& frame)
+        {
+            auto const scope = mFifo.write(1);
+            if(scope.blockSize1 == 0)
+            {
+                ++mNumDropped;
+                return false;
+            }
+
+            mFrames[static_cast<size_t>(scope.startIndex1)] = frame;
+            return true;
+        }
+
+        /** The one reader thread. Takes up to maxFrames, oldest first, returning how many */
+        int read(PitchFrame* frames, int maxFrames)
+        {
+            auto const scope = mFifo.read(std::min(maxFrames, mFifo.getNumReady()));
+            auto const* source = mFrames.data();
+            std::copy(source + scope.startIndex1, source + scope.startIndex1 + scope.blockSize1, frames);
+            std::copy(source + scope.startIndex2, source + scope.startIndex2 + scope.blockSize2, frames + scope.blockSize1);
+            return scope.blockSize1 + scope.blockSize2;
+        }
+
+        /** Frames dropped since reset() because the reader wasn't keeping up */
+        int getNumDropped() const { return mNumDropped; }
+
+    private:
+        juce::AbstractFifo mFifo{capacity};
+        std::vector<PitchFrame> mFrames;
+        std::atomic<int> mNumDropped{0};
+    };
+} // namespace OUS
@@ -0,0 +1,160 @@
+#include "PitchToMidi.h"
+
+using namespace OUS;
+
+namespace
+{
+    // Envelope times (seconds)
+    double constexpr attack = 0.001;
+    double constexpr release = 0.02;
+    double constexpr floorRise = 0.15;
+    double constexpr refractory = 0.05;
+
+    // The envelope this far above the floor is an onset (+6dB), and there isn't another until
+    // it's back within rearmRatio (+2dB) of it
+    float constexpr onsetRatio = 2.0f;
+    float constexpr rearmRatio = 1.25f;
+
+    // Frames a new note has to last before a held one changes to it
+    int constexpr framesToChange = 2;
+
+    // Bends smaller than this (of 8192 each way) aren't worth sending
+    int constexpr minBendChange = 16;
+
+    float getCoefficient(double seconds, double sampleRate)
+    {
+        return static_cast<float>(std::exp(-1.0 / (seconds * sampleRate)));
+    }
+
+    float getMidiPitch(float frequency)
+    {
+        return 69.0f + 12.0f * std::log2(frequency / 440.0f);
+    }
+} // namespace
+
+void PitchToMidi::prepare(double sampleRate, int midiChannel)
+{
+    mMidiChannel = midiChannel;
+    mAttack = getCoefficient(attack, sampleRate);
+    mRelease = getCoefficient(release, sampleRate);
+    mFloorRise = getCoefficient(floorRise, sampleRate);
+    mRefractory = static_cast<int>(refractory * sampleRate);
+
+    mLevel = 0.0f;
+    mFloor = 0.0f;
+    mSinceOnset = mRefractory;
+    mArmed = true;
+    mGateOpen = false;
+    mOnsetPending = false;
+    mNote = -1;
+    mBend = 8192;
+    mNextNote = -1;
+    mNextNoteFrames = 0;
+}
+
+void PitchToMidi::process(float const* samples, int numSamples, int startSample, Settings const& settings, juce::MidiBuffer& midi)
+{
+    auto const gate = juce::Decibels::decibelsToGain(settings.gate);
+    for(int i = 0; i < numSamples; ++i)
+    {
+        auto const level = std::abs(samples[i]);
+        mLevel = level + (level > mLevel ? mAttack : mRelease) * (mLevel - level);
+        mFloor = mLevel < mFloor ? mLevel : mLevel + mFloorRise * (mFloor - mLevel);
+        ++mSinceOnset;
+
+        if(mGateOpen && mLevel < gate)
+        {
+            mGateOpen = false;
+            mOnsetPending = false;
+            stop(startSample + i, midi);
+            continue;
+        }
+
+        auto const opening = !mGateOpen && mLevel >= gate;
+        auto const jumped = mLevel > onsetRatio * mFloor;
+        mGateOpen = mGateOpen || opening;
+        mArmed = mArmed || mLevel < rearmRatio * mFloor;
+        if(mGateOpen && mSinceOnset >= mRefractory && (opening || (mArmed && jumped)))
+        {
+            mOnsetPending = true;
+            mSinceOnset = 0;
+            mArmed = false;
+        }
+    }
+}
+
+void PitchToMidi::addFrame(float pitch, float confidence, int sample, Settings const& settings, juce::MidiBuffer& midi)
+{
+    if(pitch <= 0.0f || confidence < settings.confidence || !mGateOpen)
+    {
+        return;
+    }
+
+    auto const midiPitch = getMidiPitch(pitch);
+    auto const nearest = juce::jlimit(0, 127, juce::roundToInt(midiPitch));
+    if(mOnsetPending)
+    {
+        mOnsetPending = false;
+        startNote(nearest, midiPitch, sample, settings, midi);
+        return;
+    }
+
+    if(mNote < 0)
+    {
+        return;
+    }
+
+    if(std::abs(midiPitch - static_cast<float>(mNote)) <= 0.5f + settings.hysteresis)
+    {
+        mNextNoteFrames = 0;
+        bend(midiPitch, sample, settings, midi);
+        return;
+    }
+
+    mNextNoteFrames = nearest == mNextNote ? mNextNoteFrames + 1 : 1;
+    mNextNote = nearest;
+    if(mNextNoteFrames >= framesToChange)
+    {
+        startNote(nearest, midiPitch, sample, settings, midi);
+    }
+}
+
+void PitchToMidi::stop(int sample, juce::MidiBuffer& midi)
+{
+    if(mNote >= 0)
+    {
+        midi.addEvent(juce::MidiMessage::noteOff(mMidiChannel, mNote), sample);
+        mNote = -1;
+    }
+}
+
+void PitchToMidi::startNote(int note, float midiPitch, int sample, Settings const& settings, juce::MidiBuffer& midi)
+{
+    stop(sample, midi);
+    mNextNoteFrames = 0;
+
+    // The bend's for the new note, so it goes first
+    mNote = note;
+    bend(midiPitch, sample, settings, midi);
+
+    // Velocity from the level (by now, the onset's often only just through the gate), -60dB - 0dB
+    auto const decibels = juce::Decibels::gainToDecibels(mLevel, -60.0f);
+    auto const velocity = static_cast<juce::uint8>(juce::jlimit(1, 127, juce::roundToInt(127.0f * (decibels + 60.0f) / 60.0f)));
+    midi.addEvent(juce::MidiMessage::noteOn(mMidiChannel, mNote, velocity), sample);
+}
+
+void PitchToMidi::bend(float midiPitch, int sample, Settings const& settings, juce::MidiBuffer& midi)
+{
+    if(settings.bendRange <= 0.0f)
+    {
+        return;
+    }
+
+    auto const offset = (midiPitch - static_cast<float>(mNote)) / settings.bendRange;
+    auto const value = juce::jlimit(0, 16383, 8192 + juce::roundToInt(offset * 8192.0f));
+    if(std::abs(value - mBend) >= minBendChange || (value == 8192 && mBend != 8192))
+    {
+        midi.addEvent(juce::MidiMessage::pitchWheel(mMidiChannel, value), sample);
+        mBend = value;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+namespace OUS
+{
+    //==============================================================================
+    /*
+    PitchToMidi
+
+    Turns one channel's detected pitch into MIDI notes, on the audio thread, so
+    they land in the block being processed (at the sample they're decided on)
+    rather than a host or another plugin working them out later.
+
+    process() runs an envelope over the audio, and a floor under it (that falls
+    with it straight away but only rises slowly). An onset is the envelope coming
+    up through the gate, or jumping 6dB above the floor (so a note played again
+    after a short dip counts, as well as one after silence). The gate closing ends
+    the note, at the sample it closes.
+
+    addFrame() gets each analysed pitch. Notes only start at onsets, a confident
+    pitch after one starts (or restarts, for a repeated note) the nearest note.
+    While it's held the note changes (legato, no onset needed) once the pitch is
+    more than half a semitone plus the hysteresis away for two frames running,
+    so vibrato, drift and the frames straddling a change stay on it. What it's
+    off by goes out as pitch bend, if there's a bend range. Frames that aren't
+    confident leave the note as it is.
+    */
+    class PitchToMidi
+    {
+    public:
+        struct Settings
+        {
+            float confidence = 0.8f; // below this a pitch is ignored
+            float hysteresis = 0.25f; // semitones past half way to the next note before changing
+            float bendRange = 2.0f; // semitones, as the synth's set to. 0 for no bends
+            float gate = -50.0f; // dB
+        };
+
+        /** Before processing starts, or to start over */
+        void prepare(double sampleRate, int midiChannel);
+
+        /** The audio thread, each stretch of samples in turn (startSample is where they start
+            in the block). Watches for onsets, and ends the note if the gate closes */
+        void process(float const* samples, int numSamples, int startSample, Settings const& settings, juce::MidiBuffer& midi);
+
+        /** The audio thread, after process() has had the samples up to sample (in the block)
+            that the frame was analysed to */
+        void addFrame(float pitch, float confidence, int sample, Settings const& settings, juce::MidiBuffer& midi);
+
+        /** Ends the note (if there is one) at sample */
+        void stop(int sample, juce::MidiBuffer& midi);
+
+    private:
+        void startNote(int note, float midiPitch, int sample, Settings const& settings, juce::MidiBuffer& midi);
+        void bend(float midiPitch, int sample, Settings const& settings, juce::MidiBuffer& midi);
+
+        int mMidiChannel = 1;
+
+        // Envelope coefficients, and the envelope and its floor
+        float mAttack = 0.0f;
+        float mRelease = 0.0f;
+        float mFloorRise = 0.0f;
+        float mLevel = 0.0f;
+        float mFloor = 0.0f;
+
+        // Onsets closer together than this (samples) are one onset, and there isn't another
+        // until the envelope's back near the floor
+        int mRefractory = 0;
+        int mSinceOnset = 0;
+        bool mArmed = true;
+
+        bool mGateOpen = false;
+        bool mOnsetPending = false;
+
+        int mNote = -1; // the note playing, -1 if none
+        int mBend = 8192;
+
+        // The note it's been changing to, and for how many frames
+        int mNextNote = -1;
+        int mNextNoteFrames = 0;
+    };
+} // namespace OUS
@@ -5,8 +5,8 @@ using namespace OUS;
 RealTimeStretchProcessor::RealTimeStretchProcessor()
 : juce::AudioProcessor(BusesProperties().withInput("Input", juce::AudioChannelSet::stereo()).withOutput("Output", juce::AudioChannelSet::stereo()).withInput("Sidechain", juce::AudioChannelSet::stereo()))
 {
-    addParameter(mStretchFactor = new AudioParameterFloat("stretchfactor", "Stretch Factor", 0.1f, 4.0f, 0.1f));
-    addParameter(mPitchShift = new AudioParameterFloat("pitchshift", "Pitch Shift", 0.0f, 4.0f, 0.1f));
+    addParameter(mStretchFactor = new AudioParameterFloat("stretchfactor", "Stretch Factor", 0.1f, 4.0f, 1.0f));
+    addParameter(mPitchShift = new AudioParameterFloat("pitchshift", "Pitch Shift", 0.1f, 4.0f, 1.0f));
 }
 
 //==============================================================================
@@ -21,117 +21,191 @@ void RealTimeStretchProcessor::prepareToPlay(double sampleRate,
 {
     mBlockSize = maximumExpectedSamplesPerBlock;
     mSampleRate = static_cast<int>(sampleRate);
+    mNumChannels = std::max(1, getMainBusNumOutputChannels());
 
-    mInput.setSize(2, maximumExpectedSamplesPerBlock);
+    RubberBand::RubberBandStretcher::Options ops = RubberBand::RubberBandStretcher::OptionProcessRealTime | RubberBand::RubberBandStretcher::OptionPitchHighConsistency;
+    mRubberBand = std::make_unique<RubberBand::RubberBandStretcher>(static_cast<size_t>(sampleRate), static_cast<size_t>(mNumChannels), ops);
+    mRubberBand->setMaxProcessSize(chunkSize);
 
-    mOutputBuffer = new RubberBand::RingBuffer<float>*[2];
-    auto bufferSize = maximumExpectedSamplesPerBlock + 1024 + 8192;
-    mOutputBuffer[0] = new RubberBand::RingBuffer<float>(bufferSize);
-    mOutputBuffer[1] = new RubberBand::RingBuffer<float>(bufferSize);
+    // Changes queued while nothing was playing are already in the parameters
+    mRatios.prepare(sampleRate, mStretchFactor->get(), mPitchShift->get());
+    mRatios.apply(*mRubberBand, 0);
 
-    mScratchBuffer.setSize(2, bufferSize);
+    mScratchBuffer.setSize(mNumChannels, chunkSize);
+    mReadPointers.resize(static_cast<size_t>(mNumChannels));
+    mWritePointers.resize(static_cast<size_t>(mNumChannels));
+    for(int ch = 0; ch < mNumChannels; ++ch)
+    {
+        mReadPointers[static_cast<size_t>(ch)] = mScratchBuffer.getReadPointer(ch);
+        mWritePointers[static_cast<size_t>(ch)] = mScratchBuffer.getWritePointer(ch);
+    }
 
-    RubberBand::RubberBandStretcher::Options ops = RubberBand::RubberBandStretcher::OptionProcessRealTime | RubberBand::RubberBandStretcher::OptionPitchHighConsistency;
-    std::unique_ptr<RubberBand::RubberBandStretcher> newBand(new RubberBand::RubberBandStretcher(static_cast<size_t>(sampleRate), static_cast<size_t>(2), ops));
-    mRubberBand.reset(newBand.release());
-    mRubberBand->setTimeRatio(1.0);
+    // RubberBand wants a couple of windows of input before it gives anything back. Give it
+    // silence for that now, rather than letting the output run dry while the input builds up
+    auto const primed = prime();
+
+    // From here on the output comes in chunks of up to a window, the pre-roll covers the wait for one
+    mPreRoll = chunkSize;
+
+    auto const backlogSize = static_cast<int>(maxBacklogSeconds * sampleRate) + maximumExpectedSamplesPerBlock;
+    auto const outputSize = mPreRoll + maximumExpectedSamplesPerBlock + chunkSize;
+
+    mInputBuffer.resize(static_cast<size_t>(mNumChannels));
+    mOutputBuffer.resize(static_cast<size_t>(mNumChannels));
+    for(size_t ch = 0; ch < static_cast<size_t>(mNumChannels); ++ch)
+    {
+        mInputBuffer[ch] = std::make_unique<RubberBand::RingBuffer<float>>(backlogSize);
+        mOutputBuffer[ch] = std::make_unique<RubberBand::RingBuffer<float>>(outputSize);
+        mOutputBuffer[ch]->zero(mPreRoll);
+    }
+
+    mNumUnderruns = 0;
+    setLatencySamples(primed + mPreRoll);
+}
+
+int RealTimeStretchProcessor::prime()
+{
+    mScratchBuffer.clear();
+
+    auto numIn = 0;
+    while(mRubberBand->available() <= 0)
+    {
+        auto const required = std::max(1, static_cast<int>(mRubberBand->getSamplesRequired()));
+        auto const inChunk = std::min(required, chunkSize);
+        mRubberBand->process(mReadPointers.data(), static_cast<size_t>(inChunk), false);
+        numIn += inChunk;
+    }
+
+    auto numOut = 0;
+    while(auto const available = std::min(static_cast<int>(mRubberBand->available()), chunkSize))
+    {
+        numOut += static_cast<int>(mRubberBand->retrieve(mWritePointers.data(), static_cast<size_t>(available)));
+    }
+
+    // The silence still to come out ahead of the input. RubberBand pads its own start by its
+    // latency (getLatency) which is then part of this, so it isn't added on top
+    return numIn - numOut;
 }
 
 void RealTimeStretchProcessor::releaseResources()
 {
+    mRubberBand.reset();
+    mInputBuffer.clear();
+    mOutputBuffer.clear();
+    mScratchBuffer.setSize(0, 0);
 }
 
 void RealTimeStretchProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
 {
-    auto const samples = buffer.getNumSamples();
-    auto processedSamples = 0;
+    juce::ScopedNoDenormals noDenormals;
 
-    mInput.clear();
-
-    while(processedSamples < samples)
+    if(mRubberBand == nullptr)
     {
-        // Provide new samples and process
-        auto required = mRubberBand->getSamplesRequired();
-        auto inChunk = std::min(samples - processedSamples, static_cast<int>(required));
-
-        const float* readPtrs[2] = {mInput.getReadPointer(0, processedSamples), mInput.getReadPointer(1, processedSamples)};
-        mRubberBand->process(readPtrs, static_cast<size_t>(inChunk), false);
-        processedSamples += inChunk;
+        return;
+    }
 
-        // write into output buffer
-        auto availableSamples = mRubberBand->available();
-        auto writableSamples = mOutputBuffer[0]->getWriteSpace();
+    auto const numSamples = buffer.getNumSamples();
+    auto const numChannels = std::min(mNumChannels, buffer.getNumChannels());
 
-        if(writableSamples == 0)
+    // Changes from the setters, then from the host (which only changes the parameters)
+    mRatios.drain();
+    auto const follow = [this](RatioCommandQueue::Ratio ratio, AudioParameterFloat const& parameter)
+    {
+        if(static_cast<double>(parameter.get()) != mRatios.getTarget(ratio))
         {
-            std::cout << "OutputBuffer is full! - no space left to write"
-                      << "\n";
+            mRatios.rampTo(ratio, parameter.get());
         }
+    };
+    follow(RatioCommandQueue::Ratio::Time, *mStretchFactor);
+    follow(RatioCommandQueue::Ratio::Pitch, *mPitchShift);
 
-        auto outChunk = std::min(availableSamples, writableSamples);
-
-        float* writePtrs[2] = {mScratchBuffer.getWritePointer(0, 0), mScratchBuffer.getWritePointer(1, 0)};
-        auto retrieved = mRubberBand->retrieve(writePtrs, static_cast<size_t>(outChunk));
-
-        std::cout << "available: " << availableSamples << ", outChunk: " << outChunk;
-        if(retrieved != static_cast<unsigned int>(outChunk))
+    // Queue the input, making room for it by dropping the oldest of the backlog
+    auto const space = mInputBuffer[0]->getWriteSpace();
+    for(size_t ch = 0; ch < mInputBuffer.size(); ++ch)
+    {
+        if(space < numSamples)
         {
-            std::cout << " (" << retrieved << ")";
+            mInputBuffer[ch]->skip(numSamples - space);
         }
-        std::cout << "\n";
 
-        outChunk = static_cast<int>(retrieved);
+        // (a mono host buffer feeds every channel)
+        auto const source = std::min(static_cast<int>(ch), buffer.getNumChannels() - 1);
+        mInputBuffer[ch]->write(buffer.getReadPointer(source), numSamples);
+    }
 
-        for(size_t c = 0; c < 2; ++c)
+    // Pull it through the stretcher until this block (and the pre-roll behind it) is ready
+    while(mOutputBuffer[0]->getReadSpace() < mPreRoll + numSamples)
+    {
+        auto const available = static_cast<int>(mRubberBand->available());
+        if(available > 0)
         {
-            if(mOutputBuffer[c]->getWriteSpace() < outChunk)
+            auto const outChunk = std::min({available, chunkSize, mOutputBuffer[0]->getWriteSpace()});
+            if(outChunk == 0)
             {
-                std::cerr << "RubberBandPitchShifter::runImpl: buffer overrun: chunk = "
-                          << outChunk << ", space = " << mOutputBuffer[c]->getWriteSpace() << std::endl;
+                break;
             }
-            mOutputBuffer[c]->write(mScratchBuffer.getReadPointer(static_cast<int>(c)), outChunk);
+
+            auto const retrieved = static_cast<int>(mRubberBand->retrieve(mWritePointers.data(), static_cast<size_t>(outChunk)));
+            for(size_t ch = 0; ch < mOutputBuffer.size(); ++ch)
+            {
+                mOutputBuffer[ch]->write(mWritePointers[ch], retrieved);
+            }
+
+            continue;
         }
+
+        auto const backlog = mInputBuffer[0]->getReadSpace();
+        if(backlog == 0)
+        {
+            break;
+        }
+
+        auto const required = std::max(1, static_cast<int>(mRubberBand->getSamplesRequired()));
+        auto const inChunk = std::min({required, backlog, chunkSize});
+        for(size_t ch = 0; ch < mInputBuffer.size(); ++ch)
+        {
+            mInputBuffer[ch]->read(mWritePointers[ch], inChunk);
+        }
+
+        mRatios.apply(*mRubberBand, inChunk);
+        mRubberBand->process(mReadPointers.data(), static_cast<size_t>(inChunk), false);
     }
 
     // Finally read back the data from the output buffer
-    for(size_t c = 0; c < 2; ++c)
+    auto const ready = std::min(mOutputBuffer[0]->getReadSpace(), numSamples);
+    if(ready < numSamples)
     {
-        auto const toRead = mOutputBuffer[c]->getReadSpace();
-        if(toRead < samples && c == 0)
-        {
-            std::cerr << "RubberBandPitchShifter::runImpl: buffer underrun: required = " << samples << ", available = " << toRead << std::endl;
-        }
+        ++mNumUnderruns;
+    }
+
+    for(int ch = 0; ch < numChannels; ++ch)
+    {
+        mOutputBuffer[static_cast<size_t>(ch)]->read(buffer.getWritePointer(ch), ready);
+        buffer.clear(ch, ready, numSamples - ready);
+    }
 
-        auto chunk = std::min(toRead, samples);
-        mOutputBuffer[c]->read(buffer.getWritePointer(static_cast<int>(c)), chunk);
+    for(int ch = numChannels; ch < buffer.getNumChannels(); ++ch)
+    {
+        buffer.clear(ch, 0, numSamples);
     }
 
-    //    if (mMinfill == 0)
-    //    {
-    //        mMinfill = mOutputBuffer[0]->getReadSpace();
-    //    }
+    // Channels the host buffer doesn't have are kept in step
+    for(size_t ch = static_cast<size_t>(numChannels); ch < mOutputBuffer.size(); ++ch)
+    {
+        mOutputBuffer[ch]->skip(ready);
+    }
 }
 
 void RealTimeStretchProcessor::setStretchFactor(float newValue)
 {
-    if(mRubberBand == nullptr)
-    {
-        return;
-    }
-
     *mStretchFactor = std::max(0.1f, std::min(newValue, 4.0f));
-    mRubberBand->setTimeRatio(newValue);
+    mRatios.push(RatioCommandQueue::Ratio::Time, mStretchFactor->get());
 }
 
 void RealTimeStretchProcessor::setPitchShift(float newValue)
 {
-    if(mRubberBand == nullptr)
-    {
-        return;
-    }
-
-    *mPitchShift = std::max(0.0f, std::min(newValue, 4.0f));
-    mRubberBand->setPitchScale(newValue);
+    *mPitchShift = std::max(0.1f, std::min(newValue, 4.0f));
+    mRatios.push(RatioCommandQueue::Ratio::Pitch, mPitchShift->get());
 }
 
 void RealTimeStretchProcessor::getStateInformation(MemoryBlock& destData)
@@ -4,12 +4,37 @@
 #include "JuceHeader.h"
 // clang-format on
 
+#include "../../core/RatioCommandQueue.h"
 #include "../../core/RingBuffer.h"
 #include "../../dependencies/rubberband/rubberband/RubberBandStretcher.h"
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 namespace OUS
 {
     //==============================================================================
+    /*
+    RealTimeStretchProcessor
+
+    Time stretches / pitch shifts its input live, with RubberBand's real time mode.
+
+    RubberBand takes and gives audio in chunks of its own size, so the input and
+    output both go through FIFOs (allocated in prepareToPlay). Input is only pulled
+    through the stretcher as fast as the output needs it: stretching (> 1) plays the
+    input back slower than it comes in, so a backlog builds up, past maxBacklogSeconds
+    the oldest of it is dropped. Squashing (< 1) catches up with the input, once the
+    backlog is used up the output has gaps.
+
+    RubberBand wants a couple of windows of input before it gives anything back, it is
+    given silence for that in prepareToPlay. After that its output comes in chunks, the
+    output FIFO starts out holding a pre-roll of silence to cover the wait for one, so
+    it doesn't underrun at any block size. The latency reported to the host is the
+    silence still inside RubberBand once it's been primed plus the pre-roll, i.e. the
+    delay through it unstretched. (Shifting the pitch moves that by up to a fraction
+    of a window either way, which isn't included.)
+    */
     class RealTimeStretchProcessor : public juce::AudioProcessor
     {
     public:
@@ -25,14 +50,21 @@ namespace OUS
         void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&) override;
 
         //==============================================================================
-        // TODO: Do it properly - this is not thread safe...
+        /** From the message thread (or one other, not the audio thread). The change is
+            made by the audio thread at its next block, ramped (see RatioCommandQueue) */
         void setStretchFactor(float newValue);
         void setPitchShift(float newValue);
 
+        /** The silence the output starts with, see the class description */
+        int getPreRollSamples() const { return mPreRoll; }
+
+        /** Blocks since prepareToPlay that the output couldn't (completely) fill */
+        int getNumUnderruns() const { return mNumUnderruns.load(); }
+
         //==============================================================================
         juce::AudioProcessorEditor* createEditor() override { return new juce::GenericAudioProcessorEditor(*this); }
         bool hasEditor() const override { return true; }
-        const String getName() const override { return "SimpleDelay"; }
+        const String getName() const override { return "RealTimeStretch"; }
         bool acceptsMidi() const override { return false; }
         bool producesMidi() const override { return false; }
         double getTailLengthSeconds() const override { return 0.0; }
@@ -48,15 +80,30 @@ namespace OUS
         void setStateInformation(const void* data, int sizeInBytes) override;
 
     private:
+        // The most RubberBand is given or asked for at once
+        static constexpr int chunkSize = 1024;
+        static constexpr double maxBacklogSeconds = 10.0;
+
+        /** Runs silence through the stretcher until it starts giving output back. Returns
+            how much of that silence is still to come out, i.e. the delay through RubberBand from now on */
+        int prime();
+
         //==============================================================================
         AudioParameterFloat* mStretchFactor;
         AudioParameterFloat* mPitchShift;
 
         std::unique_ptr<RubberBand::RubberBandStretcher> mRubberBand;
+        RatioCommandQueue mRatios;
 
-        juce::AudioSampleBuffer mInput;
+        std::vector<std::unique_ptr<RubberBand::RingBuffer<float>>> mInputBuffer;
+        std::vector<std::unique_ptr<RubberBand::RingBuffer<float>>> mOutputBuffer;
         juce::AudioSampleBuffer mScratchBuffer;
-        RubberBand::RingBuffer<float>** mOutputBuffer;
+        std::vector<float const*> mReadPointers;
+        std::vector<float*> mWritePointers;
+
+        int mNumChannels = 0;
+        int mPreRoll = 0;
+        std::atomic<int> mNumUnderruns{0};
 
         int mBlockSize;
         int mSampleRate;
@@ -0,0 +1,323 @@
+#include "StretchCache.h"
+
+#include <cstring>
+
+using namespace OUS;
+
+namespace
+{
+    // Bump whenever the stretch (or the cache layout) changes what a key maps to
+    constexpr int cacheMagic = 0x5453554f; // "OUST"
+    constexpr int cacheVersion = 1;
+
+    constexpr juce::uint64 fnvOffset = 14695981039346656037ull;
+    constexpr juce::uint64 fnvPrime = 1099511628211ull;
+
+    juce::uint64 fnv(juce::uint64 hash, juce::uint64 value)
+    {
+        return (hash ^ value) * fnvPrime;
+    }
+
+    size_t getNumBytes(SegmentedStretch const& stretch)
+    {
+        auto const& result = stretch.getResult();
+        return static_cast<size_t>(result.getNumChannels()) * static_cast<size_t>(result.getNumSamples()) * sizeof(float);
+    }
+} // namespace
+
+//==============================================================================
+bool StretchCache::Key::operator==(Key const& other) const
+{
+    return sourceHash == other.sourceHash && sampleRate == other.sampleRate && stretchFactor == other.stretchFactor && pitchFactor == other.pitchFactor && options == other.options;
+}
+
+juce::String StretchCache::Key::toString() const
+{
+    return juce::String::toHexString(sourceHash) + "_" + juce::String(sampleRate) + "_" + juce::String(stretchFactor) + "_" + juce::String(pitchFactor) + "_" + juce::String(options);
+}
+
+//==============================================================================
+juce::int64 StretchCache::hashSource(juce::AudioSampleBuffer const& source, double sampleRate)
+{
+    // FNV-1a over the samples' bits, it only has to tell sources apart not resist anyone
+    auto hash = fnvOffset;
+    hash = fnv(hash, static_cast<juce::uint64>(source.getNumChannels()));
+    hash = fnv(hash, static_cast<juce::uint64>(source.getNumSamples()));
+    hash = fnv(hash, static_cast<juce::uint64>(sampleRate));
+
+    for(int ch = 0; ch < source.getNumChannels(); ++ch)
+    {
+        auto const* samples = source.getReadPointer(ch);
+        for(int i = 0; i < source.getNumSamples(); ++i)
+        {
+            juce::uint32 bits;
+            std::memcpy(&bits, samples + i, sizeof(bits));
+            hash = fnv(hash, bits);
+        }
+    }
+
+    return static_cast<juce::int64>(hash);
+}
+
+juce::File StretchCache::getCacheDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("TheOfficeOfUnspecifiedServices")
+        .getChildFile("StretchCache");
+}
+
+//==============================================================================
+void StretchCache::setMemoryBudget(size_t numBytes)
+{
+    juce::ScopedLock lock(mLock);
+    mMemoryBudget = numBytes;
+    evict();
+}
+
+size_t StretchCache::getMemoryBudget() const
+{
+    juce::ScopedLock lock(mLock);
+    return mMemoryBudget;
+}
+
+size_t StretchCache::getMemoryUsed() const
+{
+    juce::ScopedLock lock(mLock);
+    return mMemoryUsed;
+}
+
+void StretchCache::setDiskCacheEnabled(bool enabled)
+{
+    juce::ScopedLock lock(mLock);
+    mDiskCacheEnabled = enabled;
+}
+
+void StretchCache::setDiskBudget(juce::int64 numBytes)
+{
+    juce::ScopedLock lock(mLock);
+    mDiskBudget = numBytes;
+}
+
+//==============================================================================
+bool StretchCache::contains(Key const& key) const
+{
+    juce::ScopedLock lock(mLock);
+    for(auto const& entry : mEntries)
+    {
+        if(entry.key == key)
+        {
+            return true;
+        }
+    }
+
+    return mDiskCacheEnabled && getCacheFile(key).existsAsFile();
+}
+
+SegmentedStretch::Ptr StretchCache::find(Key const& key)
+{
+    {
+        juce::ScopedLock lock(mLock);
+        for(auto it = mEntries.begin(); it != mEntries.end(); ++it)
+        {
+            if(it->key == key)
+            {
+                mEntries.splice(mEntries.begin(), mEntries, it);
+                return mEntries.front().stretch;
+            }
+        }
+
+        if(!mDiskCacheEnabled)
+        {
+            return nullptr;
+        }
+    }
+
+    // Reading back can take a while, don't hold everyone else up
+    auto const cacheFile = getCacheFile(key);
+    auto stretch = readFromDisk(cacheFile);
+    if(stretch == nullptr)
+    {
+        return nullptr;
+    }
+
+    // Recently used, so the last to be trimmed
+    cacheFile.setLastModificationTime(juce::Time::getCurrentTime());
+
+    juce::ScopedLock lock(mLock);
+    insert(key, stretch);
+    return stretch;
+}
+
+void StretchCache::add(Key const& key, SegmentedStretch::Ptr stretch)
+{
+    if(stretch == nullptr)
+    {
+        return;
+    }
+
+    bool writeThrough = false;
+    {
+        juce::ScopedLock lock(mLock);
+        insert(key, stretch);
+        writeThrough = mDiskCacheEnabled;
+    }
+
+    // Not being able to cache just means stretching it again next time
+    if(writeThrough)
+    {
+        writeToDisk(getCacheFile(key), *stretch);
+        trimDiskCache();
+    }
+}
+
+void StretchCache::clear()
+{
+    juce::ScopedLock lock(mLock);
+    mEntries.clear();
+    mMemoryUsed = 0;
+}
+
+//==============================================================================
+juce::File StretchCache::getCacheFile(Key const& key) const
+{
+    return getCacheDirectory().getChildFile(juce::String::toHexString(key.toString().hashCode64()) + ".stretch");
+}
+
+void StretchCache::insert(Key const& key, SegmentedStretch::Ptr stretch)
+{
+    for(auto it = mEntries.begin(); it != mEntries.end(); ++it)
+    {
+        if(it->key == key)
+        {
+            mMemoryUsed -= it->numBytes;
+            mEntries.erase(it);
+            break;
+        }
+    }
+
+    auto const numBytes = getNumBytes(*stretch);
+    mEntries.push_front({key, std::move(stretch), numBytes});
+    mMemoryUsed += numBytes;
+
+    evict();
+}
+
+void StretchCache::evict()
+{
+    // Anything still in use (e.g. being played) lives on with its users, it just won't be found here
+    while(mMemoryUsed > mMemoryBudget && !mEntries.empty())
+    {
+        mMemoryUsed -= mEntries.back().numBytes;
+        mEntries.pop_back();
+    }
+}
+
+//==============================================================================
+SegmentedStretch::Ptr StretchCache::readFromDisk(juce::File const& cacheFile)
+{
+    juce::FileInputStream stream(cacheFile);
+    if(!stream.openedOk() || stream.readInt() != cacheMagic || stream.readInt() != cacheVersion)
+    {
+        return nullptr;
+    }
+
+    auto const sampleRate = stream.readDouble();
+    auto const numChannels = stream.readInt();
+    auto const numSamples = stream.readInt();
+
+    auto const numBytes = static_cast<juce::int64>(numSamples) * static_cast<juce::int64>(sizeof(float));
+    if(sampleRate <= 0.0 || numChannels < 1 || numSamples < 0 || stream.getNumBytesRemaining() != numChannels * numBytes)
+    {
+        return nullptr;
+    }
+
+    juce::AudioSampleBuffer result(numChannels, numSamples);
+    for(int ch = 0; ch < numChannels; ++ch)
+    {
+        if(stream.read(result.getWritePointer(ch), static_cast<int>(numBytes)) != static_cast<int>(numBytes))
+        {
+            return nullptr;
+        }
+    }
+
+    return std::make_shared<SegmentedStretch const>(std::move(result), sampleRate);
+}
+
+void StretchCache::writeToDisk(juce::File const& cacheFile, SegmentedStretch const& stretch)
+{
+    if(!cacheFile.getParentDirectory().createDirectory())
+    {
+        return;
+    }
+
+    auto const& result = stretch.getResult();
+
+    // Write to a temporary file first so a half written cache is never read
+    juce::TemporaryFile temporaryFile(cacheFile);
+    {
+        juce::FileOutputStream stream(temporaryFile.getFile());
+        if(!stream.openedOk())
+        {
+            return;
+        }
+
+        stream.writeInt(cacheMagic);
+        stream.writeInt(cacheVersion);
+        stream.writeDouble(stretch.getSampleRate());
+        stream.writeInt(result.getNumChannels());
+        stream.writeInt(result.getNumSamples());
+
+        for(int ch = 0; ch < result.getNumChannels(); ++ch)
+        {
+            stream.write(result.getReadPointer(ch), static_cast<size_t>(result.getNumSamples()) * sizeof(float));
+        }
+
+        stream.flush();
+        if(stream.getStatus().failed())
+        {
+            return;
+        }
+    }
+
+    temporaryFile.overwriteTargetFileWithTemporary();
+}
+
+void StretchCache::trimDiskCache() const
+{
+    juce::int64 budget;
+    {
+        juce::ScopedLock lock(mLock);
+        budget = mDiskBudget;
+    }
+
+    auto files = getCacheDirectory().findChildFiles(juce::File::findFiles, false, "*.stretch");
+
+    juce::int64 total = 0;
+    for(auto const& file : files)
+    {
+        total += file.getSize();
+    }
+
+    if(total <= budget)
+    {
+        return;
+    }
+
+    // Least recently used (written or read back) first
+    std::sort(files.begin(), files.end(), [](juce::File const& a, juce::File const& b)
+              { return a.getLastModificationTime() < b.getLastModificationTime(); });
+
+    for(auto const& file : files)
+    {
+        if(total <= budget)
+        {
+            break;
+        }
+
+        auto const size = file.getSize();
+        if(file.deleteFile())
+        {
+            total -= size;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+#include "OfflineStretcher.h"
+
+#include <list>
+
+namespace OUS
+{
+    //==============================================================================
+    /*
+    StretchCache
+
+    Keeps finished stretches around so going back to a setting doesn't stretch
+    the file again. Least recently used first out, once the stretches held in
+    memory add up to more than the memory budget.
+
+    Optionally (setDiskCacheEnabled) every stretch is also written to disk, so
+    one that's fallen out of memory (or was made in an earlier session) is read
+    back instead of being stretched. The disk cache has its own budget, the
+    least recently used files are deleted to stay under it.
+
+    Stretches are keyed by the content of the source (see hashSource) rather than
+    its file, so the same audio loaded from anywhere finds the same stretches.
+
+    Safe to use from any thread.
+    */
+    class StretchCache
+    {
+    public:
+        struct Key
+        {
+            juce::int64 sourceHash = 0;
+            double sampleRate = 0.0;
+            float stretchFactor = 1.0f;
+            float pitchFactor = 1.0f;
+            int options = SegmentedStretch::options;
+
+            bool operator==(Key const& other) const;
+            juce::String toString() const;
+        };
+
+        static constexpr size_t defaultMemoryBudget = 512 * 1024 * 1024;
+        static constexpr juce::int64 defaultDiskBudget = 4ll * 1024 * 1024 * 1024;
+
+        StretchCache() = default;
+
+        /** Hashes the audio (and its layout), for Key::sourceHash. Reads all of it, so
+            hash a source once when it's loaded rather than per stretch */
+        static juce::int64 hashSource(juce::AudioSampleBuffer const& source, double sampleRate);
+
+        static juce::File getCacheDirectory();
+
+        /** Evicts straight away if the cache is now over budget */
+        void setMemoryBudget(size_t numBytes);
+        size_t getMemoryBudget() const;
+        size_t getMemoryUsed() const;
+
+        void setDiskCacheEnabled(bool enabled);
+        void setDiskBudget(juce::int64 numBytes);
+
+        /** Whether find would succeed, without reading anything back from disk */
+        bool contains(Key const& key) const;
+
+        /** The stretch for key (now the most recently used), or nullptr */
+        SegmentedStretch::Ptr find(Key const& key);
+
+        /** Only add finished stretches */
+        void add(Key const& key, SegmentedStretch::Ptr stretch);
+
+        void clear();
+
+    private:
+        struct Entry
+        {
+            Key key;
+            SegmentedStretch::Ptr stretch;
+            size_t numBytes = 0;
+        };
+
+        juce::File getCacheFile(Key const& key) const;
+
+        /** Call with mLock held */
+        void insert(Key const& key, SegmentedStretch::Ptr stretch);
+        void evict();
+
+        static SegmentedStretch::Ptr readFromDisk(juce::File const& cacheFile);
+        static void writeToDisk(juce::File const& cacheFile, SegmentedStretch const& stretch);
+        void trimDiskCache() const;
+
+        juce::CriticalSection mLock;
+
+        // Most recently used first
+        std::list<Entry> mEntries;
+        size_t mMemoryBudget = defaultMemoryBudget;
+        size_t mMemoryUsed = 0;
+
+        bool mDiskCacheEnabled = false;
+        juce::int64 mDiskBudget = defaultDiskBudget;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StretchCache)
+    };
+} // namespace OUS
@@ -0,0 +1,232 @@
+#include "StretchScheduler.h"
+
+using namespace OUS;
+
+StretchScheduler::StretchScheduler()
+: juce::Thread("Stretch scheduler")
+{
+    startThread();
+}
+
+StretchScheduler::~StretchScheduler()
+{
+    cancelPendingUpdate();
+
+    {
+        juce::ScopedLock lock(mLock);
+        mPending = false;
+        supersede();
+    }
+
+    stopThread(4000);
+}
+
+//==============================================================================
+void StretchScheduler::setSource(juce::AudioSampleBuffer const& source, double sampleRate)
+{
+    auto copy = std::make_shared<juce::AudioSampleBuffer const>(source);
+    auto const hash = StretchCache::hashSource(source, sampleRate);
+
+    juce::ScopedLock lock(mLock);
+    mSource = std::move(copy);
+    mSourceHash = hash;
+    mSampleRate = sampleRate;
+    mPending = false;
+    supersede();
+}
+
+void StretchScheduler::request(float stretchFactor, float pitchFactor)
+{
+    {
+        juce::ScopedLock lock(mLock);
+        mStretchFactor = stretchFactor;
+        mPitchShiftFactor = pitchFactor;
+        mPending = true;
+        mRequestTime = juce::Time::getMillisecondCounter();
+        supersede();
+    }
+
+    notify();
+}
+
+void StretchScheduler::cancel()
+{
+    juce::ScopedLock lock(mLock);
+    mPending = false;
+    supersede();
+}
+
+void StretchScheduler::supersede()
+{
+    ++mGeneration;
+    mSuperseded = true;
+
+    mStarted = nullptr;
+    mCompleted = nullptr;
+    mProgress = -1.0;
+}
+
+void StretchScheduler::publish(juce::uint32 generation, std::function<void()> const& update)
+{
+    juce::ScopedLock lock(mLock);
+    if(generation == mGeneration)
+    {
+        update();
+        triggerAsyncUpdate();
+    }
+}
+
+//==============================================================================
+void StretchScheduler::run()
+{
+    while(!threadShouldExit())
+    {
+        std::shared_ptr<juce::AudioSampleBuffer const> source;
+        StretchCache::Key key;
+        auto sampleRate = 0.0;
+        auto stretchFactor = 1.0f;
+        auto pitchFactor = 1.0f;
+        auto generation = static_cast<juce::uint32>(0);
+        auto waitFor = -1;
+
+        {
+            juce::ScopedLock lock(mLock);
+            if(mPending && mSource != nullptr)
+            {
+                key = {mSourceHash, mSampleRate, mStretchFactor, mPitchShiftFactor, SegmentedStretch::options};
+
+                // Only start once the requests have settled, unless it's already been done
+                auto const elapsed = static_cast<int>(juce::Time::getMillisecondCounter() - mRequestTime);
+                if(elapsed >= coalesceMilliseconds || mCache.contains(key))
+                {
+                    source = mSource;
+                    sampleRate = mSampleRate;
+                    stretchFactor = mStretchFactor;
+                    pitchFactor = mPitchShiftFactor;
+                    generation = mGeneration;
+
+                    mPending = false;
+                    mSuperseded = false;
+                }
+                else
+                {
+                    waitFor = coalesceMilliseconds - elapsed;
+                }
+            }
+        }
+
+        if(source == nullptr)
+        {
+            wait(waitFor);
+            continue;
+        }
+
+        if(auto cached = mCache.find(key))
+        {
+            publish(generation, [this, cached]()
+                    {
+                        mStarted = cached;
+                        mCompleted = cached;
+                        mProgress = 1.0;
+                    });
+            continue;
+        }
+
+        // The source is kept alive (by source) for as long as the stretch reads it
+        auto stretch = std::make_shared<SegmentedStretch>(*source, sampleRate, stretchFactor, pitchFactor);
+        publish(generation, [this, stretch]()
+                {
+                    mStarted = stretch;
+                    mProgress = 0.0;
+                });
+
+        auto const completed = stretch->run([this]()
+                                            { return threadShouldExit() || mSuperseded.load(); },
+                                            [this, generation](double progress)
+                                            {
+                                                publish(generation, [this, progress]()
+                                                        { mProgress = progress; });
+                                            });
+        if(completed)
+        {
+            publish(generation, [this, stretch]()
+                    {
+                        mCompleted = stretch;
+                        mProgress = 1.0;
+                    });
+
+            // After handing it out, as this may also write it to disk
+            mCache.add(key, stretch);
+        }
+    }
+}
+
+void StretchScheduler::handleAsyncUpdate()
+{
+    Stretch started;
+    Stretch completed;
+    auto progress = -1.0;
+
+    {
+        juce::ScopedLock lock(mLock);
+        std::swap(started, mStarted);
+        std::swap(completed, mCompleted);
+        std::swap(progress, mProgress);
+    }
+
+    if(started != nullptr && onStarted != nullptr)
+    {
+        onStarted(started);
+    }
+
+    if(progress >= 0.0 && onProgress != nullptr)
+    {
+        onProgress(progress);
+    }
+
+    if(completed != nullptr && onComplete != nullptr)
+    {
+        onComplete(completed);
+    }
+}
+
+//==============================================================================
+StretchPreviewSource::StretchPreviewSource(StretchScheduler::Stretch stretch)
+: mStretch(std::move(stretch))
+{
+}
+
+void StretchPreviewSource::getNextAudioBlock(juce::AudioSourceChannelInfo const& bufferToFill)
+{
+    auto const& result = mStretch->getResult();
+    auto const position = mPosition.load();
+    auto const numReady = std::min(mStretch->getNumReady(), result.getNumSamples());
+    auto const available = juce::jlimit(0, bufferToFill.numSamples, numReady - position);
+
+    for(int ch = 0; ch < bufferToFill.buffer->getNumChannels(); ++ch)
+    {
+        if(available > 0 && result.getNumChannels() > 0)
+        {
+            bufferToFill.buffer->copyFrom(ch, bufferToFill.startSample, result, ch % result.getNumChannels(), position, available);
+        }
+
+        bufferToFill.buffer->clear(ch, bufferToFill.startSample + available, bufferToFill.numSamples - available);
+    }
+
+    mPosition = position + available;
+}
+
+void StretchPreviewSource::setNextReadPosition(juce::int64 newPosition)
+{
+    mPosition = static_cast<int>(juce::jlimit(static_cast<juce::int64>(0), getTotalLength(), newPosition));
+}
+
+juce::int64 StretchPreviewSource::getNextReadPosition() const
+{
+    return mPosition.load();
+}
+
+juce::int64 StretchPreviewSource::getTotalLength() const
+{
+    return mStretch->getResult().getNumSamples();
+}
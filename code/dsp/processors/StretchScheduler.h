@@ -0,0 +1,127 @@
+#pragma once
+
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+#include "OfflineStretcher.h"
+#include "StretchCache.h"
+
+#include <memory>
+
+namespace OUS
+{
+    //==============================================================================
+    /*
+    StretchScheduler
+
+    Runs offline stretches of one source in the background, for UIs where the stretch
+    follows a slider. Each request supersedes the last:
+     - requests are coalesced, a job only starts once they've stopped coming for
+       coalesceMilliseconds (i.e. the slider has been let go of, or paused)
+     - a job still running when a new request comes in is cancelled
+     - a job is handed out as soon as it starts (onStarted), so its result can be
+       played up to SegmentedStretch::getNumReady while the rest is still stretching
+       (see StretchPreviewSource)
+     - finished stretches are kept in a StretchCache, a request for one of those is
+       handed out (started and completed) straight away
+
+    The callbacks are all made on the message thread, and only for the latest job.
+    */
+    class StretchScheduler
+    : private juce::Thread
+    , private juce::AsyncUpdater
+    {
+    public:
+        using Stretch = SegmentedStretch::Ptr;
+
+        static constexpr int coalesceMilliseconds = 150;
+
+        StretchScheduler();
+        ~StretchScheduler() override;
+
+        /** Copies the audio to stretch, cancelling anything in progress on the old one */
+        void setSource(juce::AudioSampleBuffer const& source, double sampleRate);
+
+        /** Asks for the source to be stretched, superseding any earlier request */
+        void request(float stretchFactor, float pitchFactor);
+
+        /** Drops the pending request and cancels the job in progress */
+        void cancel();
+
+        /** To set its budgets, or turn on the disk cache */
+        StretchCache& getCache() { return mCache; }
+
+        // A job has started, its result fills in from the start as it goes
+        std::function<void(Stretch)> onStarted = nullptr;
+        // 0 to 1, for the job in progress
+        std::function<void(double)> onProgress = nullptr;
+        // The job is done, its result is final (and shared, with the cache, so copy it rather than change it)
+        std::function<void(Stretch)> onComplete = nullptr;
+
+    private:
+        // juce::Thread
+        void run() override;
+
+        // juce::AsyncUpdater
+        void handleAsyncUpdate() override;
+
+        /** Cancels the job in progress and anything it's waiting to pass on. Call with mLock held */
+        void supersede();
+
+        /** Hands something to the message thread, unless the job it's from has been superseded */
+        void publish(juce::uint32 generation, std::function<void()> const& update);
+
+        juce::CriticalSection mLock;
+        std::shared_ptr<juce::AudioSampleBuffer const> mSource;
+        juce::int64 mSourceHash = 0;
+        double mSampleRate = 44100.0;
+
+        StretchCache mCache;
+
+        bool mPending = false;
+        float mStretchFactor = 1.0f;
+        float mPitchShiftFactor = 1.0f;
+        juce::uint32 mRequestTime = 0;
+
+        // Set by a new request (or source) to cancel the job in progress
+        std::atomic<bool> mSuperseded{false};
+
+        // Waiting to be passed on to the message thread
+        Stretch mStarted;
+        Stretch mCompleted;
+        double mProgress = -1.0;
+        juce::uint32 mGeneration = 0;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StretchScheduler)
+    };
+
+    //==============================================================================
+    /*
+    StretchPreviewSource
+
+    Plays a SegmentedStretch's result while it is still being stretched. Playback
+    only moves on through what's ready, if it catches up it waits (in silence) for
+    the stretch.
+    */
+    class StretchPreviewSource : public juce::PositionableAudioSource
+    {
+    public:
+        explicit StretchPreviewSource(StretchScheduler::Stretch stretch);
+
+        void prepareToPlay(int, double) override {}
+        void releaseResources() override {}
+        void getNextAudioBlock(juce::AudioSourceChannelInfo const& bufferToFill) override;
+
+        void setNextReadPosition(juce::int64 newPosition) override;
+        juce::int64 getNextReadPosition() const override;
+        juce::int64 getTotalLength() const override;
+        bool isLooping() const override { return false; }
+
+    private:
+        StretchScheduler::Stretch mStretch;
+        std::atomic<int> mPosition{0};
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StretchPreviewSource)
+    };
+} // namespace OUS
@@ -0,0 +1,154 @@
+#include "YinPitchDetector.h"
+
+using namespace OUS;
+
+namespace
+{
+    // Windows quieter than this (mean square, -50dB as aubio) have no pitch
+    double constexpr silence = 1.0e-5;
+
+    // The shortest period looked for, as aubio
+    int constexpr minPeriod = 2;
+
+    int getOrder(int fftSize)
+    {
+        int order = 0;
+        while((1 << order) < fftSize)
+        {
+            ++order;
+        }
+
+        return order;
+    }
+} // namespace
+
+YinPitchDetector::YinPitchDetector(int windowSize, double sampleRate, float threshold)
+: mWindowSize(windowSize)
+, mHalfSize(windowSize / 2)
+, mSampleRate(sampleRate)
+, mThreshold(threshold)
+, mFFT(getOrder(windowSize))
+, mFFTSize(mFFT.getSize())
+{
+    // The correlation is only needed for lags under half the window, which a transform the
+    // length of the window already gets without wrapping round
+    mSignal.assign(static_cast<size_t>(2 * mFFTSize), 0.0f);
+    mFirstHalf.assign(static_cast<size_t>(2 * mFFTSize), 0.0f);
+    mEnergy.assign(static_cast<size_t>(mWindowSize + 1), 0.0);
+    mDifference.assign(static_cast<size_t>(mHalfSize), 0.0f);
+}
+
+float YinPitchDetector::detect(float const* window, float& confidence)
+{
+    float difference = 1.0f;
+    auto const period = getPeriod(window, difference);
+    if(mEnergy.back() / mWindowSize < silence || period <= 0.0f)
+    {
+        confidence = 0.0f;
+        return 0.0f;
+    }
+
+    confidence = juce::jlimit(0.0f, 1.0f, 1.0f - difference);
+    return static_cast<float>(mSampleRate / period);
+}
+
+float YinPitchDetector::getPeriod(float const* window, float& difference)
+{
+    computeDifference(window);
+
+    // Cumulative mean normalised difference, which starts at 1 and only dips at periods
+    auto* d = mDifference.data();
+    d[0] = 1.0f;
+    double sum = 0.0;
+    for(int tau = 1; tau < mHalfSize; ++tau)
+    {
+        sum += d[tau];
+        d[tau] = sum > 0.0 ? static_cast<float>(d[tau] * tau / sum) : 1.0f;
+    }
+
+    // The first dip under the threshold (to the bottom of it), or the lowest point if none is
+    auto period = -1;
+    for(int tau = minPeriod; tau < mHalfSize; ++tau)
+    {
+        if(d[tau] < mThreshold)
+        {
+            while(tau + 1 < mHalfSize && d[tau + 1] < d[tau])
+            {
+                ++tau;
+            }
+
+            period = tau;
+            break;
+        }
+    }
+
+    if(period < 0)
+    {
+        if(mHalfSize <= minPeriod)
+        {
+            difference = 1.0f;
+            return 0.0f;
+        }
+
+        period = static_cast<int>(std::distance(d, std::min_element(d + minPeriod, d + mHalfSize)));
+    }
+
+    difference = d[period];
+    if(period <= 0 || period >= mHalfSize - 1)
+    {
+        return static_cast<float>(period);
+    }
+
+    // Parabolic interpolation through the dip and its neighbours
+    auto const previous = d[period - 1];
+    auto const next = d[period + 1];
+    auto const curvature = previous - 2.0f * d[period] + next;
+    auto const offset = curvature > 0.0f ? 0.5f * (previous - next) / curvature : 0.0f;
+    return static_cast<float>(period) + juce::jlimit(-0.5f, 0.5f, offset);
+}
+
+void YinPitchDetector::computeDifference(float const* window)
+{
+    std::fill(mSignal.begin(), mSignal.end(), 0.0f);
+    std::copy(window, window + mWindowSize, mSignal.begin());
+    std::fill(mFirstHalf.begin(), mFirstHalf.end(), 0.0f);
+    std::copy(window, window + mHalfSize, mFirstHalf.begin());
+
+    mFFT.performRealOnlyForwardTransform(mSignal.data(), true);
+    mFFT.performRealOnlyForwardTransform(mFirstHalf.data(), true);
+
+    // The cross correlation of the first half with the whole window, c(τ) = Σ x[j] x[j + τ],
+    // is the inverse of the first half's conjugate times the window
+    auto* spectrum = mFirstHalf.data();
+    auto const* signal = mSignal.data();
+    for(int i = 0; i <= mFFTSize / 2; ++i)
+    {
+        auto const re = spectrum[2 * i];
+        auto const im = spectrum[2 * i + 1];
+        spectrum[2 * i] = re * signal[2 * i] + im * signal[2 * i + 1];
+        spectrum[2 * i + 1] = re * signal[2 * i + 1] - im * signal[2 * i];
+    }
+
+    // Only the non negative frequencies are kept, fill in the rest (the conjugates)
+    // as not every juce FFT engine assumes them for a real only inverse
+    for(int i = 1; i < mFFTSize / 2; ++i)
+    {
+        spectrum[2 * (mFFTSize - i)] = spectrum[2 * i];
+        spectrum[2 * (mFFTSize - i) + 1] = -spectrum[2 * i + 1];
+    }
+
+    mFFT.performRealOnlyInverseTransform(spectrum);
+
+    for(int j = 0; j < mWindowSize; ++j)
+    {
+        mEnergy[static_cast<size_t>(j + 1)] = mEnergy[static_cast<size_t>(j)] + static_cast<double>(window[j]) * window[j];
+    }
+
+    // d(τ) = Σ x[j]² + Σ x[j + τ]² - 2 c(τ), which rounding can take (just) under 0
+    auto const firstHalfEnergy = mEnergy[static_cast<size_t>(mHalfSize)];
+    for(int tau = 0; tau < mHalfSize; ++tau)
+    {
+        auto const shiftedEnergy = mEnergy[static_cast<size_t>(tau + mHalfSize)] - mEnergy[static_cast<size_t>(tau)];
+        mDifference[static_cast<size_t>(tau)] = static_cast<float>(std::max(0.0, firstHalfEnergy + shiftedEnergy - 2.0 * spectrum[tau]));
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+#include <vector>
+
+namespace OUS
+{
+    //==============================================================================
+    /*
+    YinPitchDetector
+
+    YIN (de Cheveigné & Kawahara 2002, research/pitch/2002_JASA_YIN.pdf) with the
+    difference function worked out through an FFT, so a window costs O(W log W)
+    rather than the O(W²) of summing it directly.
+
+    For a window of W samples the difference is taken over the first half,
+    d(τ) = Σ (x[j] - x[j + τ])² for j < W / 2, which expands to the energy of the
+    first half, plus that of the half starting at τ (both running sums), less twice
+    their cross correlation (one FFT of each, one inverse). After that it's as the
+    paper (and aubio's yin, which it's a drop in for): cumulative mean normalised,
+    the first dip under the threshold (or failing that the lowest point), refined
+    by parabolic interpolation.
+
+    Everything is allocated up front, detect() can run on the audio thread.
+    */
+    class YinPitchDetector
+    {
+    public:
+        static constexpr float defaultThreshold = 0.15f;
+
+        YinPitchDetector(int windowSize, double sampleRate, float threshold = defaultThreshold);
+
+        int getWindowSize() const { return mWindowSize; }
+
+        /** The pitch (Hz) of the windowSize samples in window, 0 if it's silent. confidence
+            is 1 less the normalised difference at the period found, 0 - 1 */
+        float detect(float const* window, float& confidence);
+
+        /** The period (samples, fractional) of window and its normalised difference. Exposed
+            for comparing with the direct sum */
+        float getPeriod(float const* window, float& difference);
+
+    private:
+        void computeDifference(float const* window);
+
+        int const mWindowSize;
+        int const mHalfSize;
+        double const mSampleRate;
+        float const mThreshold;
+
+        juce::dsp::FFT mFFT;
+        int const mFFTSize;
+
+        std::vector<float> mSignal;    // the window, transformed
+        std::vector<float> mFirstHalf; // its first half, transformed
+        std::vector<double> mEnergy;   // running sum of the window squared
+        std::vector<float> mDifference;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(YinPitchDetector)
+    };
+} // namespace OUS
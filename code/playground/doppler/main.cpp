@@ -1,8 +1,33 @@
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+#include "../../applications/doppler_shift/DopplerMixer.h"
+
+#include <chrono>
 #include <cmath>
 #include <iostream>
+#include <tuple>
 
 #define PI 3.14159265
 
+// Doppler Shift's sums, away from the plugin.
+//
+// With no arguments, works out the frequency ratio as the source passes the
+// observer the long way round (calculateDoppler, from the angle to the observer)
+// and checks DopplerSource gets the same.
+//
+//   DopplerTest render scene.json out.wav
+//
+// renders a scene (see DopplerMixer) offline. Each source plays its "input"
+// (relative to the scene, mixed down to mono and looped) or, without one, a
+// sawtooth (110Hz, a fifth up for each source, back down every fourth). The scene can also say how many "seconds" to
+// render (30) and at what "sampleRate" (48000, inputs aren't resampled).
+//
+//   DopplerTest bench
+//
+// times the mixer with more and more sources, stereo and binaural.
+
 float calculateDoppler(float sourceSpeed, float sourceDirection, float sourcePositionX, float observerPositionY)
 {
     auto const sourceVelocity = sourceSpeed * sourceDirection;
@@ -42,11 +67,256 @@ float calculateDoppler(float sourceSpeed, float sourceDirection, float sourcePos
     return std::get<0>(newFrequencyTuple);
 }
 
+namespace
+{
+    float constexpr pathHalfWidth = 200.0f;
+    double constexpr maxDelaySeconds = 2.0;
+    int constexpr blockSize = 512;
+
+    // Runs a source along the plugin's path, from well before the observer to well past,
+    // comparing DopplerSource with calculateDoppler. Returns false if they disagree
+    bool check(float speed, float observerY)
+    {
+        auto passed = true;
+        for(float x = -60.0f; x <= 60.0f; x += 15.0f)
+        {
+            // calculateDoppler gives the ratio a second on from where it's told the source is
+            auto const expected = calculateDoppler(speed, 1.0f, x - speed, observerY);
+            auto const actual = OUS::DopplerSource::line(pathHalfWidth, x).getFrequencyRatio(speed, {0.0f, observerY});
+            if(std::abs(actual - expected) > 1.0e-4f)
+            {
+                std::cout << "  DopplerSource has " << actual << " at x=" << x << "\n";
+                passed = false;
+            }
+        }
+
+        return passed;
+    }
+
+    // A sawtooth at frequency, for the sources with no input
+    juce::AudioSampleBuffer generate(double sampleRate, double frequency)
+    {
+        auto const numSamples = static_cast<int>(sampleRate);
+        juce::AudioSampleBuffer buffer(1, numSamples);
+        auto* samples = buffer.getWritePointer(0);
+        for(int i = 0; i < numSamples; ++i)
+        {
+            samples[i] = static_cast<float>(0.2 * (2.0 * std::fmod(i * frequency / sampleRate, 1.0) - 1.0));
+        }
+
+        return buffer;
+    }
+
+    // The file, mixed down to mono
+    bool read(juce::File const& file, double sampleRate, juce::AudioSampleBuffer& buffer)
+    {
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+        if(reader == nullptr || reader->lengthInSamples == 0)
+        {
+            return false;
+        }
+
+        if(reader->sampleRate != sampleRate)
+        {
+            std::cout << file.getFileName() << " is at " << reader->sampleRate << "Hz, it'll play at " << sampleRate << "Hz\n";
+        }
+
+        juce::AudioSampleBuffer channels(static_cast<int>(reader->numChannels), static_cast<int>(reader->lengthInSamples));
+        reader->read(&channels, 0, channels.getNumSamples(), 0, true, true);
+
+        buffer.setSize(1, channels.getNumSamples());
+        buffer.copyFrom(0, 0, channels, 0, 0, channels.getNumSamples(), 1.0f / channels.getNumChannels());
+        for(int ch = 1; ch < channels.getNumChannels(); ++ch)
+        {
+            buffer.addFrom(0, 0, channels, ch, 0, channels.getNumSamples(), 1.0f / channels.getNumChannels());
+        }
+
+        return true;
+    }
+
+    // Copies the next numSamples of each (looped) input to the block
+    void fill(std::vector<juce::AudioSampleBuffer> const& inputs, juce::AudioSampleBuffer& block, juce::int64 position, int numSamples)
+    {
+        for(size_t s = 0; s < inputs.size(); ++s)
+        {
+            auto const& input = inputs[s];
+            auto* samples = block.getWritePointer(static_cast<int>(s));
+            for(int i = 0; i < numSamples; ++i)
+            {
+                samples[i] = input.getSample(0, static_cast<int>((position + i) % input.getNumSamples()));
+            }
+        }
+    }
+
+    int render(juce::File const& sceneFile, juce::File const& outputFile)
+    {
+        auto const scene = juce::JSON::parse(sceneFile);
+        auto const sampleRate = static_cast<double>(scene.getProperty("sampleRate", 48000.0));
+        auto const seconds = static_cast<double>(scene.getProperty("seconds", 30.0));
+
+        juce::String error;
+        auto const mixer = OUS::DopplerMixer::fromJson(scene, sampleRate, maxDelaySeconds, error);
+        if(mixer == nullptr)
+        {
+            std::cerr << "Couldn't load " << sceneFile.getFullPathName() << ": " << error << "\n";
+            return 1;
+        }
+
+        std::vector<juce::AudioSampleBuffer> inputs(static_cast<size_t>(mixer->getNumSources()));
+        for(int s = 0; s < mixer->getNumSources(); ++s)
+        {
+            auto const name = scene["sources"][s]["input"].toString();
+            auto& input = inputs[static_cast<size_t>(s)];
+            if(name.isEmpty())
+            {
+                input = generate(sampleRate, 110.0 * std::pow(1.5, s % 4));
+            }
+            else if(!read(sceneFile.getSiblingFile(name), sampleRate, input))
+            {
+                std::cerr << "Couldn't read " << name << "\n";
+                return 1;
+            }
+        }
+
+        outputFile.deleteFile();
+        juce::WavAudioFormat format;
+        auto stream = std::make_unique<juce::FileOutputStream>(outputFile);
+        std::unique_ptr<juce::AudioFormatWriter> writer(stream->openedOk() ? format.createWriterFor(stream.get(), sampleRate, 2, 24, {}, 0) : nullptr);
+        if(writer == nullptr)
+        {
+            std::cerr << "Couldn't write " << outputFile.getFullPathName() << "\n";
+            return 1;
+        }
+
+        // The writer has it now
+        stream.release();
+
+        juce::AudioSampleBuffer block(mixer->getNumSources(), blockSize);
+        juce::AudioSampleBuffer output(2, blockSize);
+        std::vector<float const*> pointers(inputs.size());
+        for(size_t s = 0; s < pointers.size(); ++s)
+        {
+            pointers[s] = block.getReadPointer(static_cast<int>(s));
+        }
+
+        auto const numSamples = static_cast<juce::int64>(seconds * sampleRate);
+        auto const latency = static_cast<juce::int64>(mixer->getLatency());
+        auto peak = 0.0f;
+        double processing = 0.0;
+        for(juce::int64 position = 0; position < numSamples + latency; position += blockSize)
+        {
+            auto const numThisBlock = static_cast<int>(std::min(static_cast<juce::int64>(blockSize), numSamples + latency - position));
+            fill(inputs, block, position, numThisBlock);
+            output.clear();
+
+            auto const start = std::chrono::steady_clock::now();
+            mixer->process(pointers.data(), static_cast<int>(pointers.size()), output, 0, numThisBlock);
+            processing += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            // Without the latency, so it starts where the scene does
+            auto const skip = static_cast<int>(std::clamp(latency - position, static_cast<juce::int64>(0), static_cast<juce::int64>(numThisBlock)));
+            peak = std::max(peak, output.getMagnitude(skip, numThisBlock - skip));
+            writer->writeFromAudioSampleBuffer(output, skip, numThisBlock - skip);
+        }
+
+        std::cout << "Rendered " << mixer->getNumSources() << " sources, " << seconds << "s, to " << outputFile.getFullPathName() << " in "
+                  << processing << "s (" << seconds / processing << "x real time), peak " << juce::Decibels::gainToDecibels(peak) << "dB\n";
+        if(peak > 1.0f)
+        {
+            std::cout << "It clips, turn the inputs down\n";
+        }
+
+        return 0;
+    }
+
+    int constexpr benchSourceCounts[] = {1, 8, 16, 32, 64};
+    double constexpr benchSampleRate = 48000.0;
+    double constexpr secondsOfBench = 10.0;
+
+    // CPU use (of one core) for numSources moving along assorted paths
+    double bench(OUS::DopplerMixer::Output output, int numSources)
+    {
+        OUS::DopplerMixer mixer(benchSampleRate, output, maxDelaySeconds);
+        mixer.setObserver({0.0f, 30.0f});
+
+        std::vector<juce::AudioSampleBuffer> inputs;
+        juce::Random random(1);
+        for(int s = 0; s < numSources; ++s)
+        {
+            auto const x = static_cast<float>(s);
+            mixer.addSource({{{-150.0f + x, -20.0f * (s % 5)}, {150.0f, 10.0f * (s % 3)}, {0.0f, -80.0f}}, s % 2 == 1, 7.0f * x}, 10.0f + x);
+
+            inputs.emplace_back(1, static_cast<int>(benchSampleRate));
+            for(int i = 0; i < inputs.back().getNumSamples(); ++i)
+            {
+                inputs.back().setSample(0, i, random.nextFloat() - 0.5f);
+            }
+        }
+
+        juce::AudioSampleBuffer block(numSources, blockSize);
+        juce::AudioSampleBuffer out(2, blockSize);
+        std::vector<float const*> pointers;
+        for(int s = 0; s < numSources; ++s)
+        {
+            pointers.push_back(block.getReadPointer(s));
+        }
+
+        auto const numBlocks = static_cast<int>(secondsOfBench * benchSampleRate) / blockSize;
+        double seconds = 0.0;
+        for(int b = 0; b < numBlocks; ++b)
+        {
+            fill(inputs, block, static_cast<juce::int64>(b) * blockSize, blockSize);
+            out.clear();
+
+            auto const start = std::chrono::steady_clock::now();
+            mixer.process(pointers.data(), numSources, out, 0, blockSize);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        return 100.0 * seconds * benchSampleRate / (numBlocks * blockSize);
+    }
+} // namespace
+
 int main(int argc, char* argv[])
 {
+    juce::String const command = argc > 1 ? argv[1] : "";
+    if(command == "render" && argc == 4)
+    {
+        auto const directory = juce::File::getCurrentWorkingDirectory();
+        return render(directory.getChildFile(argv[2]), directory.getChildFile(argv[3]));
+    }
+
+    if(command == "bench")
+    {
+        for(auto const output : {OUS::DopplerMixer::Output::Stereo, OUS::DopplerMixer::Output::Binaural})
+        {
+            std::cout << (output == OUS::DopplerMixer::Output::Stereo ? "Stereo" : "Binaural") << ", " << blockSize << " sample blocks at " << benchSampleRate << "Hz:\n";
+            for(auto const numSources : benchSourceCounts)
+            {
+                std::cout << "  " << numSources << " sources: " << bench(output, numSources) << "% CPU\n";
+            }
+        }
+
+        return 0;
+    }
+
+    if(command.isNotEmpty())
+    {
+        std::cerr << "Usage: DopplerTest [render scene.json out.wav | bench]\n";
+        return 1;
+    }
+
     calculateDoppler(10, 1.0, -10, 30);
     calculateDoppler(10, 1.0, -11, 30);
     calculateDoppler(10, 1.0, -9, 30);
     calculateDoppler(10, -1.0, 11, 30);
     calculateDoppler(10, -1.0, -40, 30);
+
+    std::cout << "Checking DopplerSource:\n";
+    auto passed = check(10.0f, 30.0f);
+    passed = check(50.0f, 5.0f) && passed;
+    std::cout << (passed ? "It agrees\n" : "It doesn't agree\n");
+    return passed ? 0 : 1;
 }
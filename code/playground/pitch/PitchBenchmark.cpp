@@ -0,0 +1,228 @@
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+#include "../../dsp/processors/YinPitchDetector.h"
+#include "aubio.h"
+
+#include <chrono>
+#include <iostream>
+
+// Compares the in tree YIN (YinPitchDetector, difference function through an
+// FFT) with aubio's (summed directly), for accuracy and speed, at the window
+// sizes PitchDetectionProcessor uses.
+//
+// Synthetic material has a known pitch: sines, harmonic tones, tones missing
+// their fundamental and sawtooths, from the lowest pitch the window can see up
+// 5 1/2 octaves, clean and with noise. Reports the gross errors (more than 50
+// cents out, usually an octave) and the mean error of the rest, in cents.
+//
+// Given a file, it also runs both through it (channel 0) a hop at a time and
+// reports how often they agree (within 50 cents, where both are confident).
+namespace
+{
+    double constexpr sampleRate = 44100.0;
+    int constexpr windowSizes[] = {1024, 2048, 3920};
+    int constexpr hopSize = 512;
+    int constexpr numSyntheticWindows = 400;
+    float constexpr grossError = 50.0f; // cents
+    float constexpr confident = 0.8f;
+
+    float getCents(float pitch, float reference)
+    {
+        return pitch > 0.0f && reference > 0.0f ? 1200.0f * std::abs(std::log2(pitch / reference)) : std::numeric_limits<float>::max();
+    }
+
+    // Window n of the synthetic material, returning its pitch
+    float generate(int n, int windowSize, juce::Random& random, std::vector<float>& window)
+    {
+        auto const lowest = 2.0 * sampleRate / windowSize;
+        auto const pitch = 1.2 * lowest * std::pow(2.0, 5.5 * (n % 100) / 100.0);
+        auto const kind = n % 4;
+        auto const noise = std::array<float, 3>{0.0f, 0.05f, 0.3f}[static_cast<size_t>((n / 4) % 3)];
+
+        for(int i = 0; i < windowSize; ++i)
+        {
+            auto const phase = juce::MathConstants<double>::twoPi * pitch * i / sampleRate;
+            auto value = 0.0;
+            if(kind == 0)
+            {
+                value = std::sin(phase);
+            }
+            else if(kind == 1 || kind == 2)
+            {
+                // Harmonic, or the same missing the fundamental
+                for(int harmonic = kind; harmonic < 10; ++harmonic)
+                {
+                    value += std::sin(harmonic * phase + harmonic) / harmonic;
+                }
+            }
+            else
+            {
+                value = 2.0 * std::fmod(pitch * i / sampleRate, 1.0) - 1.0;
+            }
+
+            window[static_cast<size_t>(i)] = static_cast<float>(0.3 * value) + noise * (2.0f * random.nextFloat() - 1.0f);
+        }
+
+        return static_cast<float>(pitch);
+    }
+
+    struct Detectors
+    {
+        explicit Detectors(int windowSize)
+        : yin(windowSize, sampleRate)
+        , aubio(new_aubio_pitch("yin", static_cast<uint_t>(windowSize), static_cast<uint_t>(windowSize), static_cast<uint_t>(sampleRate)))
+        , input(new_fvec(static_cast<uint_t>(windowSize)))
+        , output(new_fvec(1))
+        {
+        }
+
+        ~Detectors()
+        {
+            del_aubio_pitch(aubio);
+            del_fvec(input);
+            del_fvec(output);
+        }
+
+        float detectWithAubio(float const* window, float& confidence)
+        {
+            std::copy(window, window + yin.getWindowSize(), input->data);
+            aubio_pitch_do(aubio, input, output);
+            confidence = aubio_pitch_get_confidence(aubio);
+            return output->data[0];
+        }
+
+        OUS::YinPitchDetector yin;
+        aubio_pitch_t* aubio;
+        fvec_t* input;
+        fvec_t* output;
+    };
+
+    struct Score
+    {
+        int numGross = 0;
+        double cents = 0.0;
+        double seconds = 0.0;
+
+        void add(float pitch, float reference, double time)
+        {
+            auto const cents = getCents(pitch, reference);
+            numGross += cents > grossError ? 1 : 0;
+            this->cents += cents > grossError ? 0.0 : cents;
+            seconds += time;
+        }
+
+        void print(char const* name, int numWindows) const
+        {
+            std::cout << "    " << name << ": " << numGross << " gross errors, " << cents / std::max(1, numWindows - numGross) << " cents mean error, "
+                      << 1.0e6 * seconds / numWindows << "us a window\n";
+        }
+    };
+
+    template <typename Detect>
+    float timed(Detect&& detect, double& seconds)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        auto const pitch = detect();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return pitch;
+    }
+
+    void synthetic(int windowSize)
+    {
+        Detectors detectors(windowSize);
+        std::vector<float> window(static_cast<size_t>(windowSize));
+        juce::Random random(1);
+
+        Score fft;
+        Score aubio;
+        for(int n = 0; n < numSyntheticWindows; ++n)
+        {
+            auto const pitch = generate(n, windowSize, random, window);
+            auto confidence = 0.0f;
+            auto seconds = 0.0;
+
+            auto const fftPitch = timed([&] { return detectors.yin.detect(window.data(), confidence); }, seconds);
+            fft.add(fftPitch, pitch, seconds);
+
+            auto const aubioPitch = timed([&] { return detectors.detectWithAubio(window.data(), confidence); }, seconds);
+            aubio.add(aubioPitch, pitch, seconds);
+        }
+
+        std::cout << "  " << windowSize << " sample window:\n";
+        fft.print("FFT YIN  ", numSyntheticWindows);
+        aubio.print("aubio YIN", numSyntheticWindows);
+        std::cout << "    " << aubio.seconds / fft.seconds << "x faster\n";
+    }
+
+    void recorded(juce::AudioSampleBuffer const& source, int windowSize)
+    {
+        Detectors detectors(windowSize);
+        auto const* samples = source.getReadPointer(0);
+
+        int numWindows = 0;
+        int numConfident = 0;
+        int numAgreeing = 0;
+        double fftSeconds = 0.0;
+        double aubioSeconds = 0.0;
+        for(int start = 0; start + windowSize <= source.getNumSamples(); start += hopSize)
+        {
+            auto fftConfidence = 0.0f;
+            auto aubioConfidence = 0.0f;
+            auto seconds = 0.0;
+
+            auto const fftPitch = timed([&] { return detectors.yin.detect(samples + start, fftConfidence); }, seconds);
+            fftSeconds += seconds;
+            auto const aubioPitch = timed([&] { return detectors.detectWithAubio(samples + start, aubioConfidence); }, seconds);
+            aubioSeconds += seconds;
+
+            ++numWindows;
+            if(fftConfidence >= confident && aubioConfidence >= confident)
+            {
+                ++numConfident;
+                numAgreeing += getCents(fftPitch, aubioPitch) <= grossError ? 1 : 0;
+            }
+        }
+
+        std::cout << "  " << windowSize << " sample window: " << numAgreeing << " of " << numConfident << " confident windows (of " << numWindows << ") agree, FFT YIN "
+                  << 1.0e6 * fftSeconds / std::max(1, numWindows) << "us a window, aubio YIN " << 1.0e6 * aubioSeconds / std::max(1, numWindows) << "us\n";
+    }
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::cout << "Synthetic, " << numSyntheticWindows << " windows:\n";
+    for(auto const windowSize : windowSizes)
+    {
+        synthetic(windowSize);
+    }
+
+    if(argc > 1)
+    {
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+        auto const file = juce::File::getCurrentWorkingDirectory().getChildFile(argv[1]);
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+        if(reader == nullptr)
+        {
+            std::cerr << "Couldn't read " << argv[1] << "\n";
+            return 1;
+        }
+
+        juce::AudioSampleBuffer source(static_cast<int>(reader->numChannels), static_cast<int>(reader->lengthInSamples));
+        reader->read(&source, 0, source.getNumSamples(), 0, true, true);
+        if(reader->sampleRate != sampleRate)
+        {
+            std::cout << "(" << file.getFileName() << " is at " << reader->sampleRate << "Hz, the pitches will be out but the comparison holds)\n";
+        }
+
+        std::cout << file.getFileName() << ", a window every " << hopSize << " samples:\n";
+        for(auto const windowSize : windowSizes)
+        {
+            recorded(source, windowSize);
+        }
+    }
+
+    return 0;
+}
@@ -12,6 +12,7 @@ PitchDetectionPlugin::PitchDetectionPlugin()
 , mState(*this, nullptr, "pluginstate", {})
 {
     mState.state.addChild({"uiState", {{"width", 400}, {"height", 250}}, {}}, -1, nullptr);
+    mReadFrames.resize(PitchFrameQueue::capacity);
     startTimerHz(30);
 }
 
@@ -28,6 +29,8 @@ void PitchDetectionPlugin::prepareToPlay(double sampleRate,
     mBlockSize = maximumExpectedSamplesPerBlock;
     mSampleRate = static_cast<int>(sampleRate);
 
+    // It isn't hosted, so its own (stereo) bus doesn't say how many channels it's given
+    mPitchDetectionProcessor.setNumChannels(getTotalNumInputChannels());
     mPitchDetectionProcessor.prepareToPlay(sampleRate, maximumExpectedSamplesPerBlock);
 }
 
@@ -54,9 +57,21 @@ void PitchDetectionPlugin::setStateInformation(const void* data, int sizeInBytes
 
 void PitchDetectionPlugin::timerCallback()
 {
+    // Always drained, so the queue doesn't fill while there's no editor
+    auto const numFrames = mPitchDetectionProcessor.readFrames(mReadFrames.data(), static_cast<int>(mReadFrames.size()));
+    for(int index = 0; index < numFrames; ++index)
+    {
+        auto const& frame = mReadFrames[static_cast<size_t>(index)];
+        if(frame.channel >= static_cast<int>(mLatestFrames.size()))
+        {
+            mLatestFrames.resize(static_cast<size_t>(frame.channel + 1));
+        }
+
+        mLatestFrames[static_cast<size_t>(frame.channel)] = frame;
+    }
+
     if(auto* editor = dynamic_cast<PitchDetectionPluginEditor*>(getActiveEditor()))
     {
-        auto const pitch = mPitchDetectionProcessor.getMostRecentPitch();
-        editor->setPitch(pitch);
+        editor->setFrames(mLatestFrames);
     }
 }
@@ -7,6 +7,8 @@
 #include "../../dsp/processors/PitchDetectionProcessor.h"
 #include "../../ui/CustomLookAndFeel.h"
 
+#include <vector>
+
 namespace OUS
 {
     //==============================================================================
@@ -31,7 +33,7 @@ namespace OUS
         bool hasEditor() const override { return true; }
         const String getName() const override { return "PitchDetectionPlugin"; }
         bool acceptsMidi() const override { return false; }
-        bool producesMidi() const override { return false; }
+        bool producesMidi() const override { return true; }
         double getTailLengthSeconds() const override { return 0.0; }
         int getNumPrograms() override { return 1; }
         int getCurrentProgram() override { return 0; }
@@ -56,7 +58,13 @@ namespace OUS
         public:
             PitchDetectionPluginEditor(PitchDetectionPlugin& owner)
             : juce::AudioProcessorEditor(owner)
+            , mMidiToggle("MIDI")
+            , mMultiPitchToggle("Multi-pitch")
+            , mMidiAttachment(owner.mPitchDetectionProcessor.getState(), "midi", mMidiToggle)
+            , mMultiPitchAttachment(owner.mPitchDetectionProcessor.getState(), "multipitch", mMultiPitchToggle)
             {
+                addAndMakeVisible(mMidiToggle);
+                addAndMakeVisible(mMultiPitchToggle);
                 setSize(650, 400);
             }
 
@@ -65,9 +73,10 @@ namespace OUS
             }
 
             //==============================================================================
-            void setPitch(float pitch)
+            /** The latest frame of each channel */
+            void setFrames(std::vector<PitchFrame> const& frames)
             {
-                mLastDetectedPitch = pitch;
+                mFrames = frames;
                 repaint();
             }
 
@@ -79,22 +88,52 @@ namespace OUS
                 g.fillAll();
                 g.setColour(juce::Colours::black);
 
-                auto font = g.getCurrentFont();
-                font.setHeight(100);
-                g.setFont(font);
+                if(mFrames.empty())
+                {
+                    return;
+                }
 
-                auto const bounds = getLocalBounds();
-                g.drawText(juce::String(mLastDetectedPitch, 1) + " Hz", bounds, juce::Justification::centred);
+                // A row a channel, the text as big as fits
+                auto bounds = getLocalBounds();
+                bounds.removeFromTop(30);
+                auto const rowHeight = bounds.getHeight() / static_cast<int>(mFrames.size());
+                auto font = g.getCurrentFont();
+                for(auto const& frame : mFrames)
+                {
+                    auto row = bounds.removeFromTop(rowHeight);
+                    auto const detailBounds = row.removeFromBottom(row.getHeight() / 3);
+
+                    font.setHeight(std::min(100.0f, 0.8f * static_cast<float>(row.getHeight())));
+                    g.setFont(font);
+                    auto const prefix = mFrames.size() > 1 ? juce::String(frame.channel + 1) + ": " : juce::String();
+                    g.drawText(prefix + juce::String(frame.pitch, 1) + " Hz", row, juce::Justification::centred);
+
+                    auto detail = juce::String(juce::roundToInt(frame.confidence * 100.0f)) + "% confident";
+                    for(int index = 0; index < frame.numPitches; ++index)
+                    {
+                        detail += (index == 0 ? "  |  " : ", ") + juce::String(frame.pitches[static_cast<size_t>(index)], 1);
+                    }
+
+                    font.setHeight(std::min(30.0f, 0.8f * static_cast<float>(detailBounds.getHeight())));
+                    g.setFont(font);
+                    g.drawText(detail, detailBounds, juce::Justification::centred);
+                }
             }
 
             void resized() override
             {
-                auto bounds = getLocalBounds();
-                bounds.removeFromTop(20);
+                auto bounds = getLocalBounds().removeFromTop(30).reduced(5);
+                mMidiToggle.setBounds(bounds.removeFromLeft(100));
+                mMultiPitchToggle.setBounds(bounds.removeFromLeft(120));
             }
 
         private:
-            float mLastDetectedPitch{0.0f};
+            std::vector<PitchFrame> mFrames;
+
+            juce::ToggleButton mMidiToggle;
+            juce::ToggleButton mMultiPitchToggle;
+            juce::AudioProcessorValueTreeState::ButtonAttachment mMidiAttachment;
+            juce::AudioProcessorValueTreeState::ButtonAttachment mMultiPitchAttachment;
         };
 
         //==============================================================================
@@ -104,6 +143,10 @@ namespace OUS
         juce::AudioProcessorValueTreeState mState;
         PitchDetectionProcessor mPitchDetectionProcessor;
 
+        // Message thread, what's read from the processor and the latest of each channel
+        std::vector<PitchFrame> mReadFrames;
+        std::vector<PitchFrame> mLatestFrames;
+
         //==============================================================================
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PitchDetectionPlugin)
     };
@@ -0,0 +1,210 @@
+#include "../../dependencies/freeverb/allpass.hpp"
+#include "../../dependencies/freeverb/comb.hpp"
+#include "../../dependencies/freeverb/fdnmodel.hpp"
+#include "../../dependencies/freeverb/revmodel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+// Benchmarks the reverb engines used by MattVerb and GPTVerb.
+// Both plugins run revmodel, so this times it at the block sizes
+// a host is likely to use, against a per sample reference which
+// mirrors the original freeverb processreplace loop (without the
+// predelay, so the comparison slightly favours the reference).
+//
+// MattVerb can also run fdnmodel, which is timed at the same settings.
+// The room size maps both engines onto the same decay time, and both
+// run the same allpasses on their output, so the tails are of equal
+// length and density and the times compare the cost per instance.
+//
+// Finally revmodel's multichannel methods are timed with float and with
+// double buffers, as a 64 bit host uses them, against converting the
+// double buffers to float and back around the float methods.
+
+namespace
+{
+    int constexpr sampleRate = 44100;
+    int constexpr secondsOfAudio = 60;
+    int constexpr blockSizes[] = {32, 64, 128, 256, 512, 1024};
+    int constexpr numRuns = 5;
+
+    // The unmodified freeverb loop: one comb / allpass at a time, per sample
+    class ScalarReference
+    {
+    public:
+        ScalarReference()
+        {
+            int const combTunings[numcombs] = {combtuningL1, combtuningL2, combtuningL3, combtuningL4, combtuningL5, combtuningL6, combtuningL7, combtuningL8};
+            int const allpassTunings[numallpasses] = {allpasstuningL1, allpasstuningL2, allpasstuningL3, allpasstuningL4};
+
+            for(int i = 0; i < numcombs; ++i)
+            {
+                mBuffers.emplace_back(combTunings[i], 0.0f);
+                mCombL[i].setbuffer(mBuffers.back().data(), combTunings[i]);
+                mBuffers.emplace_back(combTunings[i] + stereospread, 0.0f);
+                mCombR[i].setbuffer(mBuffers.back().data(), combTunings[i] + stereospread);
+
+                for(auto* c : {&mCombL[i], &mCombR[i]})
+                {
+                    c->setfeedback(initialroom * scaleroom + offsetroom);
+                    c->setdamp(initialdamp * scaledamp);
+                }
+            }
+
+            for(int i = 0; i < numallpasses; ++i)
+            {
+                mBuffers.emplace_back(allpassTunings[i], 0.0f);
+                mAllpassL[i].setbuffer(mBuffers.back().data(), allpassTunings[i]);
+                mBuffers.emplace_back(allpassTunings[i] + stereospread, 0.0f);
+                mAllpassR[i].setbuffer(mBuffers.back().data(), allpassTunings[i] + stereospread);
+                mAllpassL[i].setfeedback(0.5f);
+                mAllpassR[i].setfeedback(0.5f);
+            }
+        }
+
+        void process(float* inL, float* inR, float* outL, float* outR, int numSamples)
+        {
+            for(int n = 0; n < numSamples; ++n)
+            {
+                float const input = (inL[n] + inR[n]) * fixedgain;
+                float wetL = 0.0f;
+                float wetR = 0.0f;
+
+                for(int i = 0; i < numcombs; ++i)
+                {
+                    wetL += mCombL[i].process(input);
+                    wetR += mCombR[i].process(input);
+                }
+
+                for(int i = 0; i < numallpasses; ++i)
+                {
+                    wetL = mAllpassL[i].process(wetL);
+                    wetR = mAllpassR[i].process(wetR);
+                }
+
+                outL[n] = wetL;
+                outR[n] = wetR;
+            }
+        }
+
+    private:
+        std::vector<std::vector<float>> mBuffers;
+        comb mCombL[numcombs];
+        comb mCombR[numcombs];
+        allpass mAllpassL[numallpasses];
+        allpass mAllpassR[numallpasses];
+    };
+
+    // Returns the best time taken in seconds (over numRuns) to process secondsOfAudio in blocks of blockSize
+    template <typename Sample>
+    double time(int blockSize, std::function<void(Sample*, Sample*, Sample*, Sample*, int)> const& process)
+    {
+        std::vector<Sample> inL(static_cast<size_t>(blockSize));
+        std::vector<Sample> inR(static_cast<size_t>(blockSize));
+        std::vector<Sample> outL(static_cast<size_t>(blockSize));
+        std::vector<Sample> outR(static_cast<size_t>(blockSize));
+
+        for(int i = 0; i < blockSize; ++i)
+        {
+            inL[static_cast<size_t>(i)] = static_cast<Sample>(std::rand()) / RAND_MAX * 2 - 1;
+            inR[static_cast<size_t>(i)] = static_cast<Sample>(std::rand()) / RAND_MAX * 2 - 1;
+        }
+
+        auto const numBlocks = sampleRate * secondsOfAudio / blockSize;
+        auto best = std::numeric_limits<double>::max();
+        for(int run = 0; run < numRuns; ++run)
+        {
+            auto const start = std::chrono::steady_clock::now();
+            for(int b = 0; b < numBlocks; ++b)
+            {
+                process(inL.data(), inR.data(), outL.data(), outR.data(), blockSize);
+            }
+
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        return best;
+    }
+
+    void report(char const* name, int blockSize, double seconds, double referenceSeconds)
+    {
+        std::cout << name
+                  << ", blockSize=" << blockSize
+                  << ", time=" << seconds << "s"
+                  << ", realtime=" << (secondsOfAudio / seconds) << "x"
+                  << ", speedup=" << (referenceSeconds / seconds) << "x"
+                  << "\n";
+    }
+} // namespace
+
+int main()
+{
+    std::cout << "Processing " << secondsOfAudio << "s of stereo audio at " << sampleRate << "Hz\n";
+
+    for(auto const blockSize : blockSizes)
+    {
+        ScalarReference reference;
+        auto const referenceTime = time<float>(blockSize, [&](float* inL, float* inR, float* outL, float* outR, int numSamples)
+                                        { reference.process(inL, inR, outL, outR, numSamples); });
+        report("scalar", blockSize, referenceTime, referenceTime);
+
+        auto* rev = new revmodel();
+        rev->setsamplerate(sampleRate);
+        auto const revmodelTime = time<float>(blockSize, [&](float* inL, float* inR, float* outL, float* outR, int numSamples)
+                                       { rev->processreplace(inL, inR, outL, outR, numSamples, 1); });
+        report("revmodel", blockSize, revmodelTime, referenceTime);
+        delete rev;
+
+        auto* fdn = new fdnmodel();
+        fdn->setsamplerate(sampleRate);
+        auto const fdnmodelTime = time<float>(blockSize, [&](float* inL, float* inR, float* outL, float* outR, int numSamples)
+                                       { fdn->processreplace(inL, inR, outL, outR, numSamples, 1); });
+        report("fdnmodel", blockSize, fdnmodelTime, referenceTime);
+        delete fdn;
+    }
+
+    std::cout << "\nPrecision (revmodel multichannel methods, stereo)\n";
+
+    for(auto const blockSize : blockSizes)
+    {
+        auto* rev = new revmodel();
+        rev->setsamplerate(sampleRate);
+        auto const floatTime = time<float>(blockSize, [&](float* inL, float* inR, float* outL, float* outR, int numSamples)
+                                           {
+                                               float* inputs[] = {inL, inR};
+                                               float* outputs[] = {outL, outR};
+                                               rev->processreplace(inputs, 2, outputs, 2, numSamples);
+                                           });
+        report("float", blockSize, floatTime, floatTime);
+
+        auto const doubleTime = time<double>(blockSize, [&](double* inL, double* inR, double* outL, double* outR, int numSamples)
+                                             {
+                                                 double* inputs[] = {inL, inR};
+                                                 double* outputs[] = {outL, outR};
+                                                 rev->processreplace(inputs, 2, outputs, 2, numSamples);
+                                             });
+        report("double", blockSize, doubleTime, floatTime);
+
+        // What a host does for a float only plugin on a 64 bit bus
+        std::vector<float> converted(static_cast<size_t>(blockSize) * 4);
+        auto const convertedTime = time<double>(blockSize, [&](double* inL, double* inR, double* outL, double* outR, int numSamples)
+                                                {
+                                                    float* inputs[] = {converted.data(), converted.data() + blockSize};
+                                                    float* outputs[] = {converted.data() + 2 * blockSize, converted.data() + 3 * blockSize};
+                                                    std::copy(inL, inL + numSamples, inputs[0]);
+                                                    std::copy(inR, inR + numSamples, inputs[1]);
+                                                    rev->processreplace(inputs, 2, outputs, 2, numSamples);
+                                                    std::copy(outputs[0], outputs[0] + numSamples, outL);
+                                                    std::copy(outputs[1], outputs[1] + numSamples, outR);
+                                                });
+        report("double (converted)", blockSize, convertedTime, floatTime);
+        delete rev;
+    }
+
+    return 0;
+}
@@ -0,0 +1,278 @@
+// clang-format off
+#include "JuceHeader.h"
+// clang-format on
+
+#include "../../dsp/processors/OfflineStretcher.h"
+#include "../../applications/doppler_shift/RubberbandPitchShifter.h"
+#include "../../dsp/processors/RealTimeStretchProcessor.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// Benchmarks the offline stretch used by Stretch Armstrong and the breakbeat
+// machine: SegmentedStretch on one thread (a single RubberBand stretcher working
+// through the file, as it used to) against every core.
+//
+// Stretches the file given on the command line, or otherwise ten minutes of
+// generated stereo audio (a chord with a beat on top, so the transient
+// detection has something to do).
+//
+// Then runs the live stretch (RealTimeStretchProcessor) at the block sizes a
+// host is likely to use, reporting its latency (as reported to the host and as
+// measured, by where a tone burst comes out), underruns and CPU use.
+//
+// Finally puts Doppler Shift's pitch shifter (RubberbandPitchShifter) under
+// sustained load at small block sizes, with its pitch swept the whole time,
+// counting underruns and any allocations made while it's processing. Exits
+// with an error if there are any.
+
+namespace
+{
+    // Counts allocations on the audio thread, i.e. while counting is set
+    std::atomic<bool> counting{false};
+    std::atomic<int> numAllocations{0};
+
+    void* allocate(std::size_t size)
+    {
+        if(counting.load(std::memory_order_relaxed))
+        {
+            numAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if(auto* p = std::malloc(size == 0 ? 1 : size))
+        {
+            return p;
+        }
+
+        throw std::bad_alloc();
+    }
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    double constexpr sampleRate = 44100.0;
+    int constexpr secondsOfAudio = 600;
+    float constexpr stretchFactor = 1.5f;
+    float constexpr pitchFactor = 1.0f;
+
+    juce::AudioSampleBuffer generate(int numSamples)
+    {
+        juce::AudioSampleBuffer buffer(2, numSamples);
+        juce::Random random(1);
+        for(int ch = 0; ch < 2; ++ch)
+        {
+            auto* samples = buffer.getWritePointer(ch);
+            for(int i = 0; i < numSamples; ++i)
+            {
+                auto const t = i / sampleRate;
+                auto const beat = std::fmod(t, 0.5);
+                auto const chord = std::sin(juce::MathConstants<double>::twoPi * 220.0 * t) + std::sin(juce::MathConstants<double>::twoPi * (277.2 + ch) * t) + std::sin(juce::MathConstants<double>::twoPi * 329.6 * t);
+                auto const hit = std::exp(-beat * 40.0) * (random.nextFloat() * 2.0 - 1.0);
+                samples[i] = static_cast<float>(0.2 * chord + 0.4 * hit);
+            }
+        }
+
+        return buffer;
+    }
+
+    int constexpr blockSizes[] = {32, 64, 128, 256, 512, 1024};
+    int constexpr secondsOfRealTime = 60;
+
+    // Runs the first secondsOfRealTime of source through the processor a block at a
+    // time, with a tone burst written over it after a second of silence
+    void report(juce::AudioSampleBuffer const& source, double rate, int blockSize, float pitchFactor)
+    {
+        OUS::RealTimeStretchProcessor processor;
+        processor.prepareToPlay(rate, blockSize);
+        processor.setPitchShift(pitchFactor);
+
+        auto const burstStart = static_cast<int>(rate);
+        auto const burstLength = 2048;
+        auto const numSamples = std::min(source.getNumSamples(), static_cast<int>(secondsOfRealTime * rate));
+
+        juce::AudioSampleBuffer block(2, blockSize);
+        juce::MidiBuffer midi;
+        double seconds = 0.0;
+        double burstEnergy = 0.0;
+        double burstCentre = 0.0;
+
+        for(int position = 0; position + blockSize <= numSamples; position += blockSize)
+        {
+            for(int ch = 0; ch < block.getNumChannels(); ++ch)
+            {
+                auto* samples = block.getWritePointer(ch);
+                for(int i = 0; i < blockSize; ++i)
+                {
+                    auto const n = position + i - burstStart;
+                    auto const burst = 0.5 * std::sin(juce::MathConstants<double>::pi * n / burstLength) * std::sin(juce::MathConstants<double>::twoPi * 1000.0 * n / rate);
+                    samples[i] = n < 0 ? 0.0f : n < burstLength ? static_cast<float>(burst) : source.getSample(std::min(ch, source.getNumChannels() - 1), position + i);
+                }
+            }
+
+            auto const start = std::chrono::steady_clock::now();
+            processor.processBlock(block, midi);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            // The burst comes out before the source does (which starts right after it)
+            auto const* out = block.getReadPointer(0);
+            for(int i = 0; i < blockSize && position + i < burstStart + burstLength + processor.getLatencySamples(); ++i)
+            {
+                auto const energy = static_cast<double>(out[i]) * out[i];
+                burstEnergy += energy;
+                burstCentre += energy * (position + i);
+            }
+        }
+
+        auto const measured = burstEnergy > 0.0 ? burstCentre / burstEnergy - (burstStart + burstLength / 2) : 0.0;
+        std::cout << "  " << blockSize << " samples: latency " << processor.getLatencySamples() << " reported, " << juce::roundToInt(measured) << " measured, "
+                  << processor.getNumUnderruns() << " underruns, " << 100.0 * seconds * rate / numSamples << "% CPU\n";
+    }
+
+    int constexpr sustainedBlockSizes[] = {32, 64, 128};
+    int constexpr secondsOfSustainedLoad = 120;
+
+    // Runs secondsOfSustainedLoad of source (looped) through the pitch shifter, sweeping
+    // the pitch between a fifth down and a fifth up every couple of seconds (as a source
+    // passing back and forth would). Returns false on any underrun or allocation
+    bool sustain(juce::AudioSampleBuffer const& source, double rate, int blockSize)
+    {
+        auto const numChannels = 2;
+        OUS::RubberbandPitchShifter shifter(static_cast<int>(rate), numChannels, blockSize);
+
+        juce::AudioSampleBuffer block(numChannels, blockSize);
+        auto const numBlocks = static_cast<int>(secondsOfSustainedLoad * rate) / blockSize;
+        auto const blocksPerChange = std::max(1, static_cast<int>(0.02 * rate) / blockSize);
+        double seconds = 0.0;
+        numAllocations = 0;
+
+        for(int b = 0; b < numBlocks; ++b)
+        {
+            auto const position = (b * blockSize) % (source.getNumSamples() - blockSize);
+            for(int ch = 0; ch < numChannels; ++ch)
+            {
+                block.copyFrom(ch, 0, source, std::min(ch, source.getNumChannels() - 1), position, blockSize);
+            }
+
+            // On the audio thread, as the plugin does it
+            if(b % blocksPerChange == 0)
+            {
+                auto const phase = std::sin(juce::MathConstants<double>::twoPi * b * blockSize / (2.0 * rate));
+                shifter.rampPitchRatio(static_cast<float>(std::pow(1.5, phase)));
+            }
+
+            auto const start = std::chrono::steady_clock::now();
+            counting = true;
+            shifter.process(block, static_cast<size_t>(blockSize));
+            counting = false;
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        std::cout << "  " << blockSize << " samples: latency " << shifter.getLatency() << ", " << shifter.getNumUnderruns() << " underruns, "
+                  << numAllocations << " allocations, " << 100.0 * seconds * rate / (numBlocks * blockSize) << "% CPU\n";
+
+        return shifter.getNumUnderruns() == 0 && numAllocations == 0;
+    }
+
+    double time(juce::AudioSampleBuffer const& source, double rate, int numThreads, int& numSegments, int& numSamples)
+    {
+        auto const start = std::chrono::steady_clock::now();
+
+        OUS::SegmentedStretch stretch(source, rate, stretchFactor, pitchFactor, numThreads);
+        stretch.run(nullptr, nullptr);
+
+        auto const end = std::chrono::steady_clock::now();
+
+        numSegments = stretch.getNumSegments();
+        numSamples = stretch.getResult().getNumSamples();
+        return std::chrono::duration<double>(end - start).count();
+    }
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    juce::AudioSampleBuffer source;
+    auto rate = sampleRate;
+
+    if(argc > 1)
+    {
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(juce::File::getCurrentWorkingDirectory().getChildFile(argv[1])));
+        if(reader == nullptr)
+        {
+            std::cerr << "Couldn't read " << argv[1] << "\n";
+            return 1;
+        }
+
+        source.setSize(static_cast<int>(reader->numChannels), static_cast<int>(reader->lengthInSamples));
+        reader->read(&source, 0, source.getNumSamples(), 0, true, true);
+        rate = reader->sampleRate;
+    }
+    else
+    {
+        source = generate(static_cast<int>(secondsOfAudio * sampleRate));
+    }
+
+    std::cout << "Stretching " << source.getNumSamples() / rate << "s of " << source.getNumChannels() << " channel audio by " << stretchFactor << "\n";
+
+    int numSegments = 0;
+    int numSamples = 0;
+    auto const single = time(source, rate, 1, numSegments, numSamples);
+    std::cout << "1 thread: " << single << "s (" << numSegments << " segment, " << numSamples << " samples out)\n";
+
+    auto const numCpus = juce::SystemStats::getNumCpus();
+    auto const multi = time(source, rate, numCpus, numSegments, numSamples);
+    std::cout << numCpus << " threads: " << multi << "s (" << numSegments << " segments, " << numSamples << " samples out), " << single / multi << "x faster\n";
+
+    for(auto const pitch : {1.0f, 2.0f})
+    {
+        std::cout << "Real time, pitch shifted by " << pitch << ":\n";
+        for(auto const blockSize : blockSizes)
+        {
+            report(source, rate, blockSize, pitch);
+        }
+    }
+
+    std::cout << "Doppler Shift pitch shifter, " << secondsOfSustainedLoad << "s with the pitch swept:\n";
+    auto passed = true;
+    for(auto const blockSize : sustainedBlockSizes)
+    {
+        passed = sustain(source, rate, blockSize) && passed;
+    }
+
+    return passed ? 0 : 1;
+}
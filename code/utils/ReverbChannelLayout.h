@@ -0,0 +1,170 @@
+//------------------------------------------------------------------------
+// Copyright(c) 2023 the office of unspecified services.
+//------------------------------------------------------------------------
+
+#pragma once
+
+#include "../dependencies/freeverb/tuning.h"
+#include "pluginterfaces/vst/ivstaudioprocessor.h"
+#include "pluginterfaces/vst/vstspeaker.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace OUS
+{
+
+    //------------------------------------------------------------------------
+    //  ReverbChannelLayout
+    //------------------------------------------------------------------------
+    /** Maps the channels of a VST3 bus arrangement onto the channels of the freeverb
+        models' multichannel process methods (revmodel and fdnmodel).
+
+        Supported are mono, stereo, quad and 5.1, either with the same arrangement in
+        and out or mono in to any of them. The models pair their outputs off for the
+        width, so the channels are ordered L, R, Ls, Rs, C to keep each left/right
+        pair together. The LFE channel isn't reverberated, it's passed straight through.
+
+        Nothing is allocated, so the helpers are safe to use on the audio thread.
+    */
+    class ReverbChannelLayout
+    {
+    public:
+        static constexpr Steinberg::int32 maxChannels = maxchannels;
+
+        ReverbChannelLayout(Steinberg::Vst::SpeakerArrangement input = Steinberg::Vst::SpeakerArr::kStereo, Steinberg::Vst::SpeakerArrangement output = Steinberg::Vst::SpeakerArr::kStereo)
+        {
+            mNumBusInputs = Steinberg::Vst::SpeakerArr::getChannelCount(input);
+            mNumBusOutputs = Steinberg::Vst::SpeakerArr::getChannelCount(output);
+            mNumInputs = orderChannels(input, mInputs, mLfeInput);
+            mNumOutputs = orderChannels(output, mOutputs, mLfeOutput);
+        }
+
+        /** Whether the arrangements are ones we can process */
+        static bool isSupported(Steinberg::Vst::SpeakerArrangement input, Steinberg::Vst::SpeakerArrangement output)
+        {
+            auto const isKnown = [](Steinberg::Vst::SpeakerArrangement arrangement)
+            {
+                return arrangement == Steinberg::Vst::SpeakerArr::kMono || arrangement == Steinberg::Vst::SpeakerArr::kStereo || arrangement == Steinberg::Vst::SpeakerArr::k40Music || arrangement == Steinberg::Vst::SpeakerArr::k51;
+            };
+
+            return isKnown(input) && isKnown(output) && (input == output || input == Steinberg::Vst::SpeakerArr::kMono);
+        }
+
+        /** Whether the buffers the host passed match the arrangement */
+        bool matches(Steinberg::Vst::AudioBusBuffers const& input, Steinberg::Vst::AudioBusBuffers const& output) const
+        {
+            return input.numChannels == mNumBusInputs && output.numChannels == mNumBusOutputs;
+        }
+
+        /** Reverberated channels, i.e. all but the LFE */
+        Steinberg::int32 getNumInputs() const { return mNumInputs; }
+        Steinberg::int32 getNumOutputs() const { return mNumOutputs; }
+
+        /** Fills inputs / outputs (of at least maxChannels) with the bus buffers in model order, starting at offset */
+        template <typename Sample>
+        void getChannels(Sample** busInputs, Sample** busOutputs, Steinberg::int32 offset, Sample** inputs, Sample** outputs) const
+        {
+            for(Steinberg::int32 i = 0; i < mNumInputs; ++i)
+            {
+                inputs[i] = busInputs[mInputs[i]] + offset;
+            }
+
+            for(Steinberg::int32 i = 0; i < mNumOutputs; ++i)
+            {
+                outputs[i] = busOutputs[mOutputs[i]] + offset;
+            }
+        }
+
+        /** Passes the LFE channel (if there is one) through, or clears it if there is only an output LFE */
+        template <typename Sample>
+        void processLfe(Sample** busInputs, Sample** busOutputs, Steinberg::int32 offset, Steinberg::int32 numSamples) const
+        {
+            if(mLfeOutput < 0)
+            {
+                return;
+            }
+
+            auto* output = busOutputs[mLfeOutput] + offset;
+            if(mLfeInput < 0)
+            {
+                std::fill(output, output + numSamples, Sample(0));
+            }
+            else if(busInputs[mLfeInput] != busOutputs[mLfeOutput])
+            {
+                std::memcpy(output, busInputs[mLfeInput] + offset, static_cast<size_t>(numSamples) * sizeof(Sample));
+            }
+        }
+
+        /** Copies the input to the output, spreading a mono input to every output channel */
+        template <typename Sample>
+        void bypass(Sample** busInputs, Sample** busOutputs, Steinberg::int32 offset, Steinberg::int32 numSamples) const
+        {
+            for(Steinberg::int32 channel = 0; channel < mNumBusOutputs; ++channel)
+            {
+                auto const* input = busInputs[mNumBusInputs == mNumBusOutputs ? channel : 0];
+                if(busOutputs[channel] != input)
+                {
+                    std::memcpy(busOutputs[channel] + offset, input + offset, static_cast<size_t>(numSamples) * sizeof(Sample));
+                }
+            }
+        }
+
+        /** Whether the host has flagged every channel of the bus as silent */
+        static bool isSilent(Steinberg::Vst::AudioBusBuffers const& buffers)
+        {
+            auto const mask = (static_cast<Steinberg::uint64>(1) << buffers.numChannels) - 1;
+            return buffers.numChannels > 0 && (buffers.silenceFlags & mask) == mask;
+        }
+
+        /** Clears every channel of the bus and flags them silent, so the host can skip them */
+        static void setSilent(Steinberg::Vst::AudioBusBuffers& buffers, Steinberg::int32 numSamples, Steinberg::int32 symbolicSampleSize)
+        {
+            for(Steinberg::int32 channel = 0; channel < buffers.numChannels; ++channel)
+            {
+                if(symbolicSampleSize == Steinberg::Vst::kSample64)
+                {
+                    std::fill(buffers.channelBuffers64[channel], buffers.channelBuffers64[channel] + numSamples, 0.0);
+                }
+                else
+                {
+                    std::fill(buffers.channelBuffers32[channel], buffers.channelBuffers32[channel] + numSamples, 0.0f);
+                }
+            }
+
+            buffers.silenceFlags = (static_cast<Steinberg::uint64>(1) << buffers.numChannels) - 1;
+        }
+
+    private:
+        /** Writes the arrangement's channel indices in model order, returning how many (excluding the LFE) there are */
+        static Steinberg::int32 orderChannels(Steinberg::Vst::SpeakerArrangement arrangement, Steinberg::int32* channels, Steinberg::int32& lfe)
+        {
+            using namespace Steinberg::Vst;
+
+            lfe = SpeakerArr::getSpeakerIndex(arrangement, kSpeakerLfe);
+
+            Steinberg::int32 count = 0;
+            for(auto const speaker : {kSpeakerL, kSpeakerR, kSpeakerLs, kSpeakerRs, kSpeakerC, kSpeakerM})
+            {
+                auto const index = SpeakerArr::getSpeakerIndex(arrangement, speaker);
+                if(index >= 0 && count < maxChannels)
+                {
+                    channels[count++] = index;
+                }
+            }
+
+            return count;
+        }
+
+        Steinberg::int32 mNumBusInputs = 0;
+        Steinberg::int32 mNumBusOutputs = 0;
+        Steinberg::int32 mNumInputs = 0;
+        Steinberg::int32 mNumOutputs = 0;
+        Steinberg::int32 mInputs[maxChannels] = {};
+        Steinberg::int32 mOutputs[maxChannels] = {};
+        Steinberg::int32 mLfeInput = -1;
+        Steinberg::int32 mLfeOutput = -1;
+    };
+
+    //------------------------------------------------------------------------
+} // namespace OUS
@@ -0,0 +1,140 @@
+//------------------------------------------------------------------------
+// Copyright(c) 2023 the office of unspecified services.
+//------------------------------------------------------------------------
+
+#pragma once
+
+#include "pluginterfaces/vst/ivstparameterchanges.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace OUS
+{
+
+    //------------------------------------------------------------------------
+    //  SampleAccurateParameterChanges
+    //------------------------------------------------------------------------
+    /** Walks the points of every IParamValueQueue of a process call in sample order,
+        so the block can be split at each automation point rather than applying the last
+        value of each queue to the whole block.
+
+        Points closer together than the granularity are applied together at the start of
+        the sub block they fall in (so up to granularity - 1 samples early): each sub block
+        runs from offset to getNextOffset(offset), and applyUntil(getNextOffset(offset) - 1)
+        is called before it's processed. This bounds the number of splits (and so the per split
+        overhead of the reverb) regardless of how dense the host automation is. The cost is
+        proportional to the number of points.
+
+        Nothing is allocated, so this is safe to construct on the audio thread.
+    */
+    class SampleAccurateParameterChanges
+    {
+    public:
+        static constexpr Steinberg::int32 maxQueues = 32;
+        static constexpr Steinberg::int32 defaultGranularity = 32;
+
+        SampleAccurateParameterChanges(Steinberg::Vst::IParameterChanges* changes, Steinberg::int32 granularity = defaultGranularity)
+        : mGranularity(std::max(granularity, 1))
+        {
+            if(changes == nullptr)
+            {
+                return;
+            }
+
+            mNumQueues = changes->getParameterCount();
+            for(Steinberg::int32 i = 0; i < std::min(mNumQueues, maxQueues); ++i)
+            {
+                mQueues[i] = changes->getParameterData(i);
+                mNumPoints[i] = mQueues[i] != nullptr ? mQueues[i]->getPointCount() : 0;
+                mNextPoint[i] = 0;
+            }
+
+            // More queues than we track (there are far fewer parameters than this in
+            // our plugins) still get their last value applied at the start of the block
+            mChanges = changes;
+        }
+
+        /** Calls apply(id, value) for every point not yet applied with a sample offset <= offset */
+        template <typename Callback>
+        void applyUntil(Steinberg::int32 offset, Callback&& apply)
+        {
+            if(mChanges != nullptr)
+            {
+                applyUntracked(apply);
+            }
+
+            for(Steinberg::int32 i = 0; i < std::min(mNumQueues, maxQueues); ++i)
+            {
+                auto* queue = mQueues[i];
+                while(mNextPoint[i] < mNumPoints[i])
+                {
+                    Steinberg::int32 sampleOffset = 0;
+                    Steinberg::Vst::ParamValue value = 0.0;
+                    if(queue->getPoint(mNextPoint[i], sampleOffset, value) != Steinberg::kResultTrue || sampleOffset > offset)
+                    {
+                        break;
+                    }
+
+                    apply(queue->getParameterId(), value);
+                    ++mNextPoint[i];
+                }
+            }
+        }
+
+        /** Calls apply(id, value) for every point not yet applied */
+        template <typename Callback>
+        void applyAll(Callback&& apply)
+        {
+            applyUntil(std::numeric_limits<Steinberg::int32>::max(), apply);
+        }
+
+        /** Returns the end of the sub block which starts at offset. This is the offset of the next
+            point not yet applied, but no less than granularity samples away and no more than numSamples.
+            Call before applyUntil(end - 1), which then applies every point in the sub block */
+        Steinberg::int32 getNextOffset(Steinberg::int32 offset, Steinberg::int32 numSamples) const
+        {
+            Steinberg::int32 next = numSamples;
+            for(Steinberg::int32 i = 0; i < std::min(mNumQueues, maxQueues); ++i)
+            {
+                Steinberg::int32 sampleOffset = 0;
+                Steinberg::Vst::ParamValue value = 0.0;
+                if(mNextPoint[i] < mNumPoints[i] && mQueues[i]->getPoint(mNextPoint[i], sampleOffset, value) == Steinberg::kResultTrue)
+                {
+                    next = std::min(next, sampleOffset);
+                }
+            }
+
+            return std::min(std::max(next, offset + mGranularity), numSamples);
+        }
+
+    private:
+        template <typename Callback>
+        void applyUntracked(Callback&& apply)
+        {
+            for(Steinberg::int32 i = maxQueues; i < mNumQueues; ++i)
+            {
+                if(auto* queue = mChanges->getParameterData(i))
+                {
+                    Steinberg::int32 sampleOffset = 0;
+                    Steinberg::Vst::ParamValue value = 0.0;
+                    if(queue->getPoint(queue->getPointCount() - 1, sampleOffset, value) == Steinberg::kResultTrue)
+                    {
+                        apply(queue->getParameterId(), value);
+                    }
+                }
+            }
+
+            mChanges = nullptr;
+        }
+
+        Steinberg::Vst::IParameterChanges* mChanges = nullptr;
+        Steinberg::int32 mGranularity;
+        Steinberg::int32 mNumQueues = 0;
+        Steinberg::Vst::IParamValueQueue* mQueues[maxQueues] = {};
+        Steinberg::int32 mNumPoints[maxQueues] = {};
+        Steinberg::int32 mNextPoint[maxQueues] = {};
+    };
+
+    //------------------------------------------------------------------------
+} // namespace OUS